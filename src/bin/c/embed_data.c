@@ -17,10 +17,52 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+// Write a C file that embeds the input with the assembler's .incbin
+// directive, instead of spelling out every byte, so it compiles
+// instantly. Only for ELF targets with GNU-style inline assembly.
+static int write_incbin(FILE *out, const char *inPath, const char *varName, size_t dataLen) {
+#ifdef _WIN32
+  (void) out; (void) inPath; (void) varName; (void) dataLen;
+  fprintf(stderr, "--incbin is not supported on this platform\n");
+  return 1;
+#else
+  // the path is written as given, for the assembler to resolve against
+  // its include directories, so the output doesn't depend on where the
+  // build is
+  for (const char *it = inPath; *it; ++it) {
+    if (*it == '"' || *it == '\\' || *it == '\n') {
+      fprintf(stderr, "Cannot embed path with special characters: %s\n", inPath);
+      return 1;
+    }
+  }
+
+  fprintf(out, "#include <stdint.h>\n");
+  fprintf(out, "__asm__(\n");
+  fprintf(out, "  \".section .rodata\\n\"\n");
+  fprintf(out, "  \".balign 4\\n\"\n");
+  fprintf(out, "  \"%s_incbin:\\n\"\n", varName);
+  fprintf(out, "  \".incbin \\\"%s\\\"\\n\"\n", inPath);
+  fprintf(out, "  \".previous\\n\"\n");
+  fprintf(out, ");\n");
+  fprintf(out, "extern const unsigned char %s_incbin[] __asm__(\"%s_incbin\");\n", varName, varName);
+  fprintf(out, "const unsigned char *%s = %s_incbin;\n", varName, varName);
+  fprintf(out, "const uint32_t %s_len = %zu;\n\n", varName, dataLen);
+  return 0;
+#endif
+}
 
 int main(int argc, char **argv) {
+  const char *progName = argv[0];
+  const char *incbinPath = NULL;
+  if (argc > 2 && strcmp(argv[1], "--incbin") == 0) {
+    incbinPath = argv[2];
+    argc -= 2;
+    argv += 2;
+  }
   if (argc < 4) {
-    fprintf(stderr, "Usage: %s <out-name> <in-name> <var-name>\n", argv[0]);
+    fprintf(stderr, "Usage: %s [--incbin <asm-path>] <out-name> <in-name> <var-name>\n", progName);
     return 1;
   }
 
@@ -40,6 +82,13 @@ int main(int argc, char **argv) {
   size_t dataLen = ftell(in);
   fseek(in, 0, SEEK_SET);
 
+  if (incbinPath) {
+    int ret = write_incbin(out, incbinPath, varName, dataLen);
+    fclose(in);
+    fclose(out);
+    return ret;
+  }
+
   fprintf(out, "#include <stdint.h>\n");
   fprintf(out, "#include <stdalign.h>\n");
   fprintf(out, "static const struct {\n");
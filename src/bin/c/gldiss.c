@@ -38,6 +38,7 @@ Err *gs_main() {
     Image *img;
     GS_TRY(gs_index_image(allocMeta.count, buf, &img));
     gs_free(buf, allocMeta);
+    GS_TRY(gs_verify_image(img));
 
     gs_stderr_dump(img);
   }
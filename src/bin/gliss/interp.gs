@@ -24,6 +24,6 @@
           apply
           concat
           (map
-           (comp read-all open-file)
+           (comp read-all open-source-file)
            prog-args))))
     (apply compile-program src-exprs)))
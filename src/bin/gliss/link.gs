@@ -16,19 +16,22 @@
 ;;; along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 (define (main)
-  (let ((prog-args (program-args))
+  (let ((all-args (program-args))
+        (shake (not (and all-args (string=? "--no-shake" (car all-args)))))
+        (prog-args (if shake all-args (cdr all-args)))
         (_ (when (or (nil? prog-args) (nil? (cdr prog-args)))
-             (raise "Usage: glissc <out-file> [in-files ...]")))
+             (raise "Usage: glissc [--no-shake] <out-file> [in-files ...]")))
         (src-exprs
          (call-in-new-scope
           apply
           concat
           (map
-           (comp read-all open-file)
+           (comp read-all open-source-file)
            (cdr prog-args))))
+        (expanded (call-in-new-scope apply expand-program src-exprs))
         (iw (new-image-writer))
-        (start (bytecomp! iw (call-in-new-scope apply compile-program src-exprs)))
+        (start (bytecomp-program! iw (if shake (shake-program expanded) expanded)))
         (_ (image-writer-set-start! iw start))
-        (bv (new-bytevector 0)))
-    (image-writer->bytes iw bv)
-    (write-file (car prog-args) (bytevector->bytestring bv))))
+        (out (open-output-port (car prog-args))))
+    (image-writer->port iw out)
+    (close-port out)))
@@ -18,27 +18,103 @@
 #include "bytecode/image.h"
 #include "bytecode/interp.h"
 #include "bytecode/primitives.h"
+#include "bytecode/snapshot.h"
 #include "driver.h"
 #include "gc/gc.h"
 #include "logging.h"
 #include "rt.h"
+#include "util/io.h"
 
-Err *gs_run_raw_image(u32 size, const u8 *buf) {
-  Image *img;
-  GS_TRY(gs_index_image(size, buf, &img));
-  GS_TRY(gs_run_image(img));
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// GLISS_VERIFY_CACHE names a file of SHA-256 digests of images, one
+// per line in hex, that have already been fully verified; such images
+// are trusted as-is. The file is a trust root, like the runtime itself:
+// anyone who can write to it can have any image run unverified.
+static Err *verify_with_cache(Image *img) {
+  const char *cachePath = getenv("GLISS_VERIFY_CACHE");
+  if (!cachePath || !*cachePath) GS_RET_OK;
+
+  u8 digest[GS_SHA256_LEN];
+  gs_image_digest(img, digest);
+  char hex[GS_SHA256_LEN * 2 + 1];
+  for (u32 i = 0; i < GS_SHA256_LEN; ++i) {
+    snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  }
+
+  FILE *cache = fopen(cachePath, "r");
+  if (cache) {
+    char trusted[GS_SHA256_LEN * 2 + 1];
+    while (fscanf(cache, "%64s", trusted) == 1) {
+      if (strcmp(trusted, hex) == 0) {
+        fclose(cache);
+        LOG_INFO("Image %s found in verification cache", hex);
+        gs_trust_image(img);
+        GS_RET_OK;
+      }
+    }
+    fclose(cache);
+  }
+
+  GS_TRY(gs_verify_image(img));
+  cache = fopen(cachePath, "a");
+  if (cache) {
+    fprintf(cache, "%s\n", hex);
+    fclose(cache);
+  } else {
+    LOG_WARN("Could not write verification cache %s", cachePath);
+  }
   GS_RET_OK;
 }
 
-Err *gs_run_image(Image *img) {
-  GS_TRY(gs_alloc_sym_table());
+// GLISS_SNAPSHOT names a heap snapshot file, which is loaded instead
+// of running the image's start function if it was taken of the same
+// image, and is (re)written after running it otherwise
+static Err *load_snapshot(const char *path, u64 hash, bool *loaded) {
+  *loaded = false;
+  FILE *probe = fopen(path, "r");
+  if (!probe) GS_RET_OK;
+  fclose(probe);
 
-  PUSH_RAW_GC_ROOTS(2, top);
-  roots_top.arr[0].len = 1;
-  roots_top.arr[0].arr = (anyptr *)&gs_global_syms;
+  AllocMeta meta;
+  u8 *buf;
+  GS_TRY(gs_read_file(path, &meta, &buf));
+  Err *err = gs_snapshot_load(hash, meta.count, buf, loaded);
+  gs_free(buf, meta);
+  return err;
+}
+
+static Err *save_snapshot(const char *path, u64 hash) {
+  AllocMeta meta;
+  u8 *buf;
+  GS_TRY(gs_snapshot_save(hash, &meta, &buf));
+  FILE *file = fopen(path, "w");
+  bool written = file && fwrite(buf, 1, meta.count, file) == meta.count;
+  if (file) fclose(file);
+  gs_free(buf, meta);
+  if (!written) {
+    LOG_WARN("Could not write snapshot %s", path);
+  }
+  GS_RET_OK;
+}
 
+// run the image's start function, with the symbol table already allocated
+static Err *gs_init_image(Image *img) {
   GS_TRY(gs_add_primitives());
 
+  if (img->bindings.len) {
+    GS_TRY(gs_bake_image(img));
+    Val *baked = img->constantsBaked->values;
+    for (BindingInfo *bd = img->bindings.pairs; bd != img->bindings.pairs + img->bindings.len; ++bd) {
+      Symbol *sym = VAL2PTR(Symbol, baked[get32le(bd->symbol)]);
+      GS_TRY(gs_set_symbol_value(sym, baked[get32le(bd->binding)]));
+    }
+    LOG_INFO("Applied %" PRIu32 " bindings", img->bindings.len);
+  }
+
   if (img->start.code) {
     InterpClosure *start;
     GS_TRY(gs_interp_closure(img, img->start.code - 1, NULL, 0, &start));
@@ -47,13 +123,17 @@ Err *gs_run_image(Image *img) {
 
     GS_TRY(gs_gc_push_scope());
     PUSH_DIRECT_GC_ROOTS(0, start, NULL);
-    GS_TRY_C(gs_call(&start->parent, 0, NULL, 0, NULL), POP_GC_ROOTS(top));
+    GS_TRY(gs_call(&start->parent, 0, NULL, 0, NULL));
     POP_GC_ROOTS(start);
-    GS_TRY_C(gs_gc_pop_scope(), POP_GC_ROOTS(top));
+    GS_TRY(gs_gc_pop_scope());
   } else {
     LOG_INFO("%s", "No start function defined");
   }
 
+  GS_RET_OK;
+}
+
+static Err *gs_run_main(void) {
   Symbol *main;
   GS_TRY(gs_intern(GS_UTF8_CSTR("main"), &main));
   if (main->value == PTR2VAL_GC(main)) {
@@ -63,12 +143,58 @@ Err *gs_run_image(Image *img) {
     GS_TRY(gs_gc_push_scope());
     PUSH_DIRECT_GC_ROOTS(0, main, NULL);
     Val ret;
-    GS_TRY_C(gs_call(&main->fn, 0, NULL, 1, &ret), POP_GC_ROOTS(top));
+    GS_TRY(gs_call(&main->fn, 0, NULL, 1, &ret));
     POP_GC_ROOTS(main);
-    GS_TRY_C(gs_gc_pop_scope(), POP_GC_ROOTS(top));
+    GS_TRY(gs_gc_pop_scope());
   }
 
   LOG_INFO("%s", "Done");
+  GS_RET_OK;
+}
+
+static Err *gs_run_raw_image0(u32 size, const u8 *buf, const char *snapshotPath) {
+  u64 hash = gs_hash_image_bytes(size, buf);
+  bool loaded;
+  GS_TRY(load_snapshot(snapshotPath, hash, &loaded));
+  if (!loaded) {
+    Image *img;
+    GS_TRY(gs_index_image(size, buf, &img));
+    GS_TRY(verify_with_cache(img));
+    GS_TRY(gs_alloc_sym_table());
+    GS_TRY(gs_init_image(img));
+    GS_TRY(save_snapshot(snapshotPath, hash));
+  }
+  GS_TRY(gs_run_main());
+  GS_RET_OK;
+}
+
+Err *gs_run_raw_image(u32 size, const u8 *buf) {
+  const char *snapshotPath = getenv("GLISS_SNAPSHOT");
+  if (snapshotPath && *snapshotPath) {
+    PUSH_RAW_GC_ROOTS(1, top);
+    roots_top.arr[0].len = 1;
+    roots_top.arr[0].arr = (anyptr *)&gs_global_syms;
+    GS_TRY_C(gs_run_raw_image0(size, buf, snapshotPath), POP_GC_ROOTS(top));
+    POP_GC_ROOTS(top);
+    GS_RET_OK;
+  }
+
+  Image *img;
+  GS_TRY(gs_index_image(size, buf, &img));
+  GS_TRY(verify_with_cache(img));
+  GS_TRY(gs_run_image(img));
+  GS_RET_OK;
+}
+
+Err *gs_run_image(Image *img) {
+  GS_TRY(gs_alloc_sym_table());
+
+  PUSH_RAW_GC_ROOTS(1, top);
+  roots_top.arr[0].len = 1;
+  roots_top.arr[0].arr = (anyptr *)&gs_global_syms;
+
+  GS_TRY_C(gs_init_image(img), POP_GC_ROOTS(top));
+  GS_TRY_C(gs_run_main(), POP_GC_ROOTS(top));
 
   POP_GC_ROOTS(top);
   GS_RET_OK;
@@ -36,17 +36,19 @@ int main(int argc, const char **argv) {
   gs_argc = argc;
   gs_argv = argv;
 
-  Err *err;
+  bool failed = false;
   GS_WITH_ALLOC(&gs_c_alloc) {
-    err = gs_main0();
+    Err *err = gs_main0();
     if (err) {
       gs_write_error(err);
+      failed = true;
     }
     err = gs_gc_dispose(&gc);
     if (err) {
       gs_write_error(err);
+      failed = true;
     }
   }
 
-  return err != 0;
+  return failed;
 }
@@ -0,0 +1,359 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "assemble.h"
+#include "image.h"
+#include "ops.h"
+#include "le_unaligned.h"
+#include "primitives.h"
+#include "../gc/gc.h"
+#include "tck.h"
+#include "../logging.h"
+
+#include <string.h>
+
+typedef struct Buf {
+  u8 *data;
+  u32 len;
+  u32 cap;
+} Buf;
+
+typedef struct Label {
+  Val key;
+  u32 ip;
+  bool placed;
+  // head of the list of branches waiting for this label, in refs
+  u32 firstRef;
+} Label;
+
+#define NO_REF UINT32_MAX
+
+typedef struct LabelRef {
+  // position of the branch offset to patch
+  u32 pos;
+  u32 next;
+} LabelRef;
+
+typedef struct Assembler {
+  Buf code;
+  Buf stackMap;
+
+  Label *labels;
+  u32 labelc, labelCap;
+  // open addressing table of 1 + label index, 0 if empty
+  u32 *slots;
+  u32 slotCap;
+  LabelRef *refs;
+  u32 refc, refCap;
+
+  i64 stack;
+  u32 maxStack;
+  u32 locals;
+
+  Closure *addConst;
+  Closure *addCode;
+} Assembler;
+
+static Err *grow(anyptr *arr, u32 *cap, u32 needed, u32 size, u32 align) {
+  if (needed <= *cap) GS_RET_OK;
+  u32 newCap = *cap ? *cap : 16;
+  while (newCap < needed) {
+    GS_FAIL_IF(newCap > UINT32_MAX / 2, "integer overflow", NULL);
+    newCap *= 2;
+  }
+  anyptr newArr = *arr
+    ? gs_realloc(*arr, GS_ALLOC_ALIGN_SIZE(align, size, *cap), GS_ALLOC_ALIGN_SIZE(align, size, newCap))
+    : gs_alloc(GS_ALLOC_ALIGN_SIZE(align, size, newCap));
+  GS_FAIL_IF(!newArr, "Allocation failed", NULL);
+  *arr = newArr;
+  *cap = newCap;
+  GS_RET_OK;
+}
+
+#define GROW(ARR, CAP, NEEDED)                                          \
+  grow((anyptr *) &(ARR), &(CAP), (NEEDED), sizeof(*(ARR)), alignof(__typeof__(*(ARR))))
+
+static Err *emit(Buf *buf, u32 count, const u8 *bytes) {
+  GS_FAIL_IF(buf->len > UINT32_MAX - count, "integer overflow", NULL);
+  GS_TRY(GROW(buf->data, buf->cap, buf->len + count));
+  memcpy(buf->data + buf->len, bytes, count);
+  buf->len += count;
+  GS_RET_OK;
+}
+
+static Err *emit_u8(Buf *buf, u8 byte) {
+  return emit(buf, 1, &byte);
+}
+
+static void put_u32(u8 *at, u32 word) {
+  at[0] = word & 0xFF;
+  at[1] = (word >> 8) & 0xFF;
+  at[2] = (word >> 16) & 0xFF;
+  at[3] = word >> 24;
+}
+
+static Err *emit_u32(Buf *buf, u32 word) {
+  u8 bytes[4];
+  put_u32(bytes, word);
+  return emit(buf, 4, bytes);
+}
+
+static Err *emit_u16(Buf *buf, u16 half) {
+  u8 bytes[2] = { half & 0xFF, half >> 8 };
+  return emit(buf, 2, bytes);
+}
+
+static void push(Assembler *as, i64 pushed) {
+  as->stack += pushed;
+  if (as->stack > as->maxStack) as->maxStack = (u32) as->stack;
+}
+
+static bool sym_is(Val val, const char *name) {
+  if (!is_symbol0(val)) return false;
+  InlineUtf8Str *symName = VAL2PTR(Symbol, val)->name;
+  size_t len = strlen(name);
+  return symName->len == len && memcmp(symName->bytes, name, len) == 0;
+}
+
+// the nth element of a list, or nil
+static Val nth(Val list, u32 n) {
+  for (; n && is_type(list, CONS_TYPE); --n) list = VAL2PTR(Cons, list)->cdr;
+  return is_type(list, CONS_TYPE) ? VAL2PTR(Cons, list)->car : VAL_NIL;
+}
+
+static Err *u8_operand(Val val, u8 *out) {
+  GS_FAIL_IF(!VAL_IS_FIXNUM(val) || VAL2UFIX(val) > UINT8_MAX, "Bad byte operand", NULL);
+  *out = (u8) VAL2UFIX(val);
+  GS_RET_OK;
+}
+
+static Err *call_for_index(Closure *f, Val arg, u32 *out) {
+  Val ret;
+  GS_TRY(gs_call(f, 1, &arg, 1, &ret));
+  GS_FAIL_IF(!VAL_IS_FIXNUM(ret) || VAL2UFIX(ret) > UINT32_MAX, "Bad index", NULL);
+  *out = (u32) VAL2UFIX(ret);
+  GS_RET_OK;
+}
+
+static u32 hash_label(Val key, u32 cap) {
+  u64 h = key * 0x9E3779B97F4A7C15ULL;
+  return (u32) (h >> 32) & (cap - 1);
+}
+
+static Err *find_label(Assembler *as, Val key, Label **out) {
+  if (as->slotCap) {
+    for (u32 i = hash_label(key, as->slotCap);; i = (i + 1) & (as->slotCap - 1)) {
+      u32 slot = as->slots[i];
+      if (!slot) break;
+      if (as->labels[slot - 1].key == key) {
+        *out = &as->labels[slot - 1];
+        GS_RET_OK;
+      }
+    }
+  }
+
+  if ((as->labelc + 1) * 2 > as->slotCap) {
+    u32 newCap = as->slotCap ? as->slotCap * 2 : 16;
+    u32 *newSlots = gs_alloc(GS_ALLOC_META(u32, newCap));
+    GS_FAIL_IF(!newSlots, "Allocation failed", NULL);
+    memset(newSlots, 0, newCap * sizeof(u32));
+    for (u32 l = 0; l < as->labelc; ++l) {
+      u32 i = hash_label(as->labels[l].key, newCap);
+      while (newSlots[i]) i = (i + 1) & (newCap - 1);
+      newSlots[i] = l + 1;
+    }
+    if (as->slots) gs_free(as->slots, GS_ALLOC_META(u32, as->slotCap));
+    as->slots = newSlots;
+    as->slotCap = newCap;
+  }
+
+  GS_TRY(GROW(as->labels, as->labelCap, as->labelc + 1));
+  u32 i = hash_label(key, as->slotCap);
+  while (as->slots[i]) i = (i + 1) & (as->slotCap - 1);
+  as->slots[i] = ++as->labelc;
+  Label *lbl = *out = &as->labels[as->labelc - 1];
+  *lbl = (Label) { .key = key, .ip = 0, .placed = false, .firstRef = NO_REF };
+  GS_RET_OK;
+}
+
+static Err *emit_ldc(Assembler *as, Val what) {
+  u32 idx;
+  GS_TRY(call_for_index(as->addConst, what, &idx));
+  GS_TRY(emit_u8(&as->code, LDC));
+  GS_TRY(emit_u32(&as->code, idx));
+  GS_RET_OK;
+}
+
+static Err *emit_insn(Assembler *as, Val insn) {
+  Val op = nth(insn, 0);
+  Buf *code = &as->code;
+  if (sym_is(op, "load")) {
+    push(as, 1);
+    Val what = nth(insn, 1);
+    Val kind = nth(what, 0);
+    if (sym_is(kind, "top")) {
+      GS_TRY(emit_ldc(as, nth(what, 1)));
+      GS_TRY(emit_u8(code, SYM_DEREF));
+    } else if (sym_is(kind, "this")) {
+      GS_TRY(emit_u8(code, THIS_REF));
+    } else {
+      u8 opc;
+      if (sym_is(kind, "arg")) opc = ARG_REF;
+      else if (sym_is(kind, "rest-arg")) opc = RESTARG_REF;
+      else if (sym_is(kind, "var")) opc = LOCAL_REF;
+      else if (sym_is(kind, "closed")) opc = CLOSURE_REF;
+      else GS_FAILWITH("Uncompilable load", NULL);
+      u8 operand;
+      GS_TRY(u8_operand(nth(what, 1), &operand));
+      if (opc == LOCAL_REF && operand + 1u > as->locals) as->locals = operand + 1u;
+      GS_TRY(emit_u8(code, opc));
+      GS_TRY(emit_u8(code, operand));
+    }
+  } else if (sym_is(op, "set!")) {
+    push(as, -1);
+    Val what = nth(insn, 1);
+    GS_FAIL_IF(!sym_is(nth(what, 0), "var"), "Uncompilable set!", NULL);
+    u8 operand;
+    GS_TRY(u8_operand(nth(what, 1), &operand));
+    if (operand + 1u > as->locals) as->locals = operand + 1u;
+    GS_TRY(emit_u8(code, LOCAL_SET));
+    GS_TRY(emit_u8(code, operand));
+  } else if (sym_is(op, "const")) {
+    push(as, 1);
+    GS_TRY(emit_ldc(as, nth(insn, 1)));
+  } else if (sym_is(op, "drop")) {
+    push(as, -1);
+    GS_TRY(emit_u8(code, DROP));
+  } else if (sym_is(op, "call")) {
+    u8 argc;
+    GS_TRY(u8_operand(nth(insn, 1), &argc));
+    u8 retc = 1;
+    GS_TRY(emit_u8(code, CALL));
+    GS_TRY(emit_u8(code, argc));
+    GS_TRY(emit_u8(code, retc));
+    // pops the function and arguments, pushes the returns
+    push(as, (i64) retc - (argc + 1));
+  } else if (sym_is(op, "br") || sym_is(op, "br-if-not")) {
+    if (sym_is(op, "br")) {
+      Val dropped = nth(insn, 2);
+      GS_FAIL_IF(!VAL_IS_FIXNUM(dropped), "Not a number", NULL);
+      push(as, -VAL2SFIX(dropped));
+      GS_TRY(emit_u8(code, BR));
+    } else {
+      push(as, -1);
+      GS_TRY(emit_u8(code, BR_IF_NOT));
+    }
+    Label *lbl;
+    GS_TRY(find_label(as, nth(insn, 1), &lbl));
+    u32 pos = code->len;
+    if (lbl->placed) {
+      GS_TRY(emit_u32(code, lbl->ip - (pos + 4)));
+    } else {
+      GS_TRY(GROW(as->refs, as->refCap, as->refc + 1));
+      as->refs[as->refc] = (LabelRef) { .pos = pos, .next = lbl->firstRef };
+      lbl->firstRef = as->refc++;
+      GS_TRY(emit_u32(code, 0));
+    }
+  } else if (sym_is(op, "label")) {
+    Label *lbl;
+    GS_TRY(find_label(as, nth(insn, 1), &lbl));
+    GS_FAIL_IF(lbl->placed, "Label placed twice", NULL);
+    u32 ip = code->len;
+    for (u32 ref = lbl->firstRef; ref != NO_REF; ref = as->refs[ref].next) {
+      u32 pos = as->refs[ref].pos;
+      put_u32(code->data + pos, ip - (pos + 4));
+    }
+    lbl->placed = true;
+    lbl->ip = ip;
+    lbl->firstRef = NO_REF;
+    push(as, 0);
+    GS_FAIL_IF(as->stack < 0, "Negative stack height", NULL);
+    GS_TRY(emit_u32(&as->stackMap, ip));
+    GS_TRY(emit_u32(&as->stackMap, (u32) as->stack));
+  } else if (sym_is(op, "lambda")) {
+    Val argcV = nth(insn, 1);
+    GS_FAIL_IF(!VAL_IS_FIXNUM(argcV) || VAL2UFIX(argcV) > UINT16_MAX, "Bad capture count", NULL);
+    u16 argc = (u16) VAL2UFIX(argcV);
+    u32 bodyIdx;
+    GS_TRY(call_for_index(as->addCode, nth(insn, 2), &bodyIdx));
+    push(as, -((i64) argc - 1));
+    GS_TRY(emit_u8(code, LAMBDA));
+    GS_TRY(emit_u32(code, bodyIdx));
+    GS_TRY(emit_u16(code, argc));
+  } else {
+    GS_FAILWITH("Uncompilable insn", NULL);
+  }
+  GS_FAIL_IF(as->stack < 0, "Negative stack height", NULL);
+  GS_RET_OK;
+}
+
+static Err *write_code(Assembler *as, InlineBytes **out) {
+  for (u32 i = 0; i < as->labelc; ++i) {
+    GS_FAIL_IF(!as->labels[i].placed, "Label never placed", NULL);
+  }
+  GS_FAIL_IF(as->stack > UINT8_MAX, "Stack too high to return", NULL);
+  push(as, 0);
+  GS_TRY(emit_u8(&as->code, RET));
+  GS_TRY(emit_u8(&as->code, (u8) as->stack));
+
+  u32 codeLen = as->code.len;
+  u32 paddedLen = pad_to_align(codeLen);
+  u32 stackMapLen = as->stackMap.len / 8;
+  u64 total = sizeof(u32) * 4 + (u64) paddedLen + as->stackMap.len;
+  GS_FAIL_IF(total > UINT32_MAX, "Code too large", NULL);
+
+  InlineBytes *bs;
+  GS_TRY(gs_gc_alloc_array(BYTESTRING_TYPE, (u32) total, (anyptr *)&bs));
+  memset(bs->bytes, 0, bs->len);
+  put_u32(bs->bytes, codeLen);
+  put_u32(bs->bytes + 4, as->maxStack);
+  put_u32(bs->bytes + 8, as->locals);
+  put_u32(bs->bytes + 12, stackMapLen);
+  u8 *body = bs->bytes + sizeof(u32) * 4;
+  memcpy(body, as->code.data, codeLen);
+  if (as->stackMap.len) {
+    memcpy(body + paddedLen, as->stackMap.data, as->stackMap.len);
+  }
+  *out = bs;
+  GS_RET_OK;
+}
+
+Err *gs_assemble_code(Val insns, Closure *addConst, Closure *addCode, InlineBytes **out) {
+  Assembler as = {0};
+  as.addConst = addConst;
+  as.addCode = addCode;
+
+  Err *err = NULL;
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) err = (X); goto cleanup;
+
+  for (Val it = insns; it != VAL_NIL; it = VAL2PTR(Cons, it)->cdr) {
+    GS_FAIL_IF(!is_type(it, CONS_TYPE), "Not a list", NULL);
+    GS_TRY(emit_insn(&as, VAL2PTR(Cons, it)->car));
+  }
+  GS_TRY(write_code(&as, out));
+
+cleanup:
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) GS_FAIL_HERE_DEFAULT(X)
+  if (as.code.data) gs_free(as.code.data, GS_ALLOC_META(u8, as.code.cap));
+  if (as.stackMap.data) gs_free(as.stackMap.data, GS_ALLOC_META(u8, as.stackMap.cap));
+  if (as.labels) gs_free(as.labels, GS_ALLOC_META(Label, as.labelCap));
+  if (as.slots) gs_free(as.slots, GS_ALLOC_META(u32, as.slotCap));
+  if (as.refs) gs_free(as.refs, GS_ALLOC_META(LabelRef, as.refCap));
+  return err;
+}
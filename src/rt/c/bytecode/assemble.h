@@ -0,0 +1,32 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "../rt.h"
+
+/**
+ * Assemble the serial instructions produced by `compile` in grt.gs,
+ * such as (br-if-not label), (call 3) or (const (foo bar baz)), into
+ * an encoded CodeInfo block with its stack map, following the same
+ * rules as `code-body-writer-emit!`.
+ *
+ * Constants and nested lambda bodies are handed to the given
+ * closures, which must return their index in the image being
+ * written: addConst is called with the constant value, and addCode
+ * with the instruction list of the body.
+ */
+Err *gs_assemble_code(Val insns, Closure *addConst, Closure *addCode, InlineBytes **out);
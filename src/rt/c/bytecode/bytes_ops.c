@@ -0,0 +1,135 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bytes_ops.h"
+
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#  define X86_DISPATCH 1
+#  include <immintrin.h>
+#endif
+
+static u32 count_scalar(const u8 *p, u32 len, u8 byte) {
+  u32 count = 0;
+  for (u32 i = 0; i < len; ++i) count += p[i] == byte;
+  return count;
+}
+
+// check each position from start in turn
+static bool search_tail(const u8 *hay, u32 len, Bytes needle, u32 start, u32 *out) {
+  for (u32 i = start; i + needle.len <= len; ++i) {
+    if (hay[i] == needle.bytes[0] && memcmp(hay + i, needle.bytes, needle.len) == 0) {
+      *out = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool search_scalar(const u8 *hay, u32 len, Bytes needle, u32 *out) {
+  return search_tail(hay, len, needle, 0, out);
+}
+
+#ifdef X86_DISPATCH
+
+// kernels for a vector width, which compare W bytes of hay at a time;
+// search compares the first and last bytes of the needle at each
+// position, and only checks the rest where both match
+#define DEFINE_KERNELS(SUFFIX, TARGET, W, VEC, LOAD, SET1, CMPEQ, AND, MOVEMASK) \
+  TARGET static u32 count_##SUFFIX(const u8 *p, u32 len, u8 byte) {    \
+    VEC needle = SET1((char) byte);                                     \
+    u32 count = 0, i = 0;                                               \
+    for (; i + W <= len; i += W) {                                      \
+      u32 mask = (u32) MOVEMASK(CMPEQ(LOAD((const VEC *) (p + i)), needle)); \
+      count += (u32) __builtin_popcount(mask);                          \
+    }                                                                   \
+    return count + count_scalar(p + i, len - i, byte);                  \
+  }                                                                     \
+  TARGET static bool search_##SUFFIX(const u8 *hay, u32 len, Bytes needle, u32 *out) { \
+    VEC first = SET1((char) needle.bytes[0]);                           \
+    VEC last = SET1((char) needle.bytes[needle.len - 1]);               \
+    u32 i = 0;                                                          \
+    for (; i + needle.len - 1 + W <= len; i += W) {                     \
+      VEC fs = CMPEQ(LOAD((const VEC *) (hay + i)), first);             \
+      VEC ls = CMPEQ(LOAD((const VEC *) (hay + i + needle.len - 1)), last); \
+      u32 mask = (u32) MOVEMASK(AND(fs, ls));                           \
+      while (mask) {                                                    \
+        u32 bit = (u32) __builtin_ctz(mask);                            \
+        if (memcmp(hay + i + bit, needle.bytes, needle.len) == 0) {     \
+          *out = i + bit;                                               \
+          return true;                                                  \
+        }                                                               \
+        mask &= mask - 1;                                               \
+      }                                                                 \
+    }                                                                   \
+    return search_tail(hay, len, needle, i, out);                       \
+  }
+
+DEFINE_KERNELS(
+  sse2, , 16, __m128i,
+  _mm_loadu_si128, _mm_set1_epi8, _mm_cmpeq_epi8, _mm_and_si128, _mm_movemask_epi8
+)
+DEFINE_KERNELS(
+  avx2, __attribute__((target("avx2"))), 32, __m256i,
+  _mm256_loadu_si256, _mm256_set1_epi8, _mm256_cmpeq_epi8, _mm256_and_si256, _mm256_movemask_epi8
+)
+
+#undef DEFINE_KERNELS
+
+#endif
+
+static struct {
+  u32 (*count)(const u8 *p, u32 len, u8 byte);
+  bool (*search)(const u8 *hay, u32 len, Bytes needle, u32 *out);
+} kernels;
+
+static void pick_kernels(void) {
+  kernels.count = count_scalar;
+  kernels.search = search_scalar;
+#ifdef X86_DISPATCH
+  // SSE2 is part of x86-64
+  kernels.count = count_sse2;
+  kernels.search = search_sse2;
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.count = count_avx2;
+    kernels.search = search_avx2;
+  }
+#endif
+}
+
+u32 gs_bytes_count(Bytes bytes, u8 byte) {
+  if (!kernels.count) pick_kernels();
+  return kernels.count(bytes.bytes, bytes.len, byte);
+}
+
+bool gs_bytes_search(Bytes hay, Bytes needle, u32 *out) {
+  if (!needle.len) {
+    *out = 0;
+    return true;
+  }
+  if (needle.len > hay.len) return false;
+  if (!kernels.search) pick_kernels();
+  return kernels.search(hay.bytes, hay.len, needle, out);
+}
+
+i32 gs_bytes_compare(Bytes lhs, Bytes rhs) {
+  u32 common = lhs.len < rhs.len ? lhs.len : rhs.len;
+  int cmp = common ? memcmp(lhs.bytes, rhs.bytes, common) : 0;
+  if (!cmp) return lhs.len < rhs.len ? -1 : lhs.len > rhs.len;
+  return cmp < 0 ? -1 : 1;
+}
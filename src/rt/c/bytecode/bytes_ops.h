@@ -0,0 +1,47 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "../rt.h"
+
+/**
+ * Bulk operations on bytes.
+ *
+ * Finding, filling and comparing go through memchr, memset and
+ * memcmp, which the C library already vectorises for the CPU it runs
+ * on. Counting and substring search have no libc equivalent, so they
+ * are vectorised here with SSE2 or AVX2, picked the first time they
+ * are used by asking the CPU what it supports, and fall back to
+ * scalar loops elsewhere.
+ */
+
+/**
+ * The number of times byte occurs in bytes.
+ */
+u32 gs_bytes_count(Bytes bytes, u8 byte);
+
+/**
+ * Find the first occurrence of needle in hay, returning false if
+ * there is none.
+ */
+bool gs_bytes_search(Bytes hay, Bytes needle, u32 *out);
+
+/**
+ * Compare bytes lexicographically, with a prefix ordered first,
+ * returning -1, 0 or 1.
+ */
+i32 gs_bytes_compare(Bytes lhs, Bytes rhs);
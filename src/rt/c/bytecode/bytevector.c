@@ -0,0 +1,118 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "bytevector.h"
+#include "utf8.h"
+#include "../gc/gc.h"
+
+#include <string.h>
+
+// string builders share the layout of bytevectors, and differ only in
+// the type of their buffer, which for them is a string whose bytes
+// start after its code point length and index
+static Err *alloc_buf(TypeIdx bufTy, u32 cap, InlineBytes **out) {
+  if (bufTy == STRING_TYPE) return gs_string_alloc(cap, (InlineUtf8Str **)out);
+  return gs_gc_alloc_array(BYTESTRING_TYPE, cap, (anyptr *)out);
+}
+
+static u8 *buf_bytes(InlineBytes *buf, TypeIdx bufTy) {
+  return bufTy == STRING_TYPE ? ((InlineUtf8Str *) buf)->bytes : buf->bytes;
+}
+
+static Err *buffer_alloc(TypeIdx ty, TypeIdx bufTy, u32 cap, ByteVector **out) {
+  ByteVector *bv;
+  GS_TRY(gs_gc_alloc(ty, (anyptr *)&bv));
+  bv->len = 0;
+  bv->buf = NULL;
+  if (cap) {
+    InlineBytes *buf;
+    GS_TRY(alloc_buf(bufTy, cap, &buf));
+    GS_TRY(gs_gc_write_barrier(bv, &bv->buf, buf, FieldGcRaw));
+    bv->buf = buf;
+  }
+  *out = bv;
+  GS_RET_OK;
+}
+
+static Err *buffer_reserve(ByteVector *bv, TypeIdx bufTy, u32 n, u8 **out) {
+  u32 cap = bv->buf ? bv->buf->len : 0;
+  u64 needed = (u64) bv->len + n;
+  if (needed > cap) {
+    GS_FAIL_IF(needed > UINT32_MAX, "Bytevector too large", NULL);
+    u64 newCap = cap ? cap : 16;
+    while (newCap < needed) newCap *= 2;
+    if (newCap > UINT32_MAX) newCap = UINT32_MAX;
+    InlineBytes *buf;
+    GS_TRY(alloc_buf(bufTy, (u32) newCap, &buf));
+    if (bv->len) memcpy(buf_bytes(buf, bufTy), buf_bytes(bv->buf, bufTy), bv->len);
+    GS_TRY(gs_gc_write_barrier(bv, &bv->buf, buf, FieldGcRaw));
+    bv->buf = buf;
+  }
+  *out = buf_bytes(bv->buf, bufTy) + bv->len;
+  bv->len = (u32) needed;
+  GS_RET_OK;
+}
+
+static Err *buffer_take(ByteVector *bv, TypeIdx bufTy, InlineBytes **out) {
+  if (!bv->buf) {
+    GS_TRY(alloc_buf(bufTy, 0, out));
+    GS_RET_OK;
+  }
+  InlineBytes *buf = bv->buf;
+  gs_gc_shrink_array(buf, bv->len);
+  bv->buf = NULL;
+  bv->len = 0;
+  *out = buf;
+  GS_RET_OK;
+}
+
+Err *gs_bytevector_alloc(u32 cap, ByteVector **out) {
+  return buffer_alloc(BYTE_VECTOR_TYPE, BYTESTRING_TYPE, cap, out);
+}
+
+Err *gs_bytevector_reserve(ByteVector *bv, u32 n, u8 **out) {
+  return buffer_reserve(bv, BYTESTRING_TYPE, n, out);
+}
+
+Err *gs_bytevector_take(ByteVector *bv, InlineBytes **out) {
+  return buffer_take(bv, BYTESTRING_TYPE, out);
+}
+
+Err *gs_string_builder_alloc(u32 cap, StringBuilder **out) {
+  return buffer_alloc(STRING_BUILDER_TYPE, STRING_TYPE, cap, (ByteVector **)out);
+}
+
+Err *gs_string_builder_reserve(StringBuilder *sb, u32 n, u8 **out) {
+  return buffer_reserve((ByteVector *)sb, STRING_TYPE, n, out);
+}
+
+Err *gs_string_builder_push_char(StringBuilder *sb, u32 c) {
+  u8 enc[4];
+  u32 n = gs_utf8_encode(c, enc);
+  GS_FAIL_IF(!n, "Not a code point", NULL);
+  u8 *dst;
+  GS_TRY(gs_string_builder_reserve(sb, n, &dst));
+  memcpy(dst, enc, n);
+  GS_RET_OK;
+}
+
+Err *gs_string_builder_take(StringBuilder *sb, InlineUtf8Str **out) {
+  GS_TRY(buffer_take((ByteVector *)sb, STRING_TYPE, (InlineBytes **)out));
+  // which also checks what was printed into it
+  GS_TRY(gs_string_seal(*out));
+  GS_RET_OK;
+}
@@ -0,0 +1,48 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "primitives.h"
+
+Err *gs_bytevector_alloc(u32 cap, ByteVector **out);
+
+/**
+ * Grow a bytevector by n bytes, reallocating its buffer if it is
+ * full, and set out to the first of them. Their contents are left
+ * unspecified.
+ */
+Err *gs_bytevector_reserve(ByteVector *bv, u32 n, u8 **out);
+
+/**
+ * Take the contents of a bytevector as a bytestring, which is its
+ * buffer shrunk in place, leaving the bytevector empty.
+ */
+Err *gs_bytevector_take(ByteVector *bv, InlineBytes **out);
+
+/**
+ * String builders are bytevectors whose buffer is a string, so that
+ * taking their contents leaves a string rather than a bytestring.
+ */
+Err *gs_string_builder_alloc(u32 cap, StringBuilder **out);
+Err *gs_string_builder_reserve(StringBuilder *sb, u32 n, u8 **out);
+
+/**
+ * Push the UTF-8 encoding of a code point.
+ */
+Err *gs_string_builder_push_char(StringBuilder *sb, u32 c);
+
+Err *gs_string_builder_take(StringBuilder *sb, InlineUtf8Str **out);
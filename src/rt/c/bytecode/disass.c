@@ -16,6 +16,7 @@
  */
 
 #include "image.h"
+#include "primitives.h"
 #include "le_unaligned.h"
 #include "../util/cast.h"
 #include "ops.h"
@@ -26,6 +27,13 @@
 #define eprintf(...) fprintf(stderr, __VA_ARGS__)
 
 static void dump_constant(Image *img, u32 idx) {
+  if (!img->constants) {
+    // a live image
+    eprintf(BLUE);
+    pr0(stderr, img->constantsBaked->values[idx]);
+    eprintf(NONE);
+    return;
+  }
   ConstInfo *ci = img->constants->values[idx];
   u32 ty = get32le(ci->ty);
   eprintf("%u " BLUE, ty);
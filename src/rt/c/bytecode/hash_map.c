@@ -0,0 +1,368 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hash_map.h"
+#include "../gc/gc.h"
+#include "tck.h"
+
+#include <string.h>
+
+#define LEVEL_BITS 5
+#define LEVEL_MASK 31
+// nodes at or below this shift hold colliding keys
+#define HASH_BITS 32
+
+bool gs_eq_hashable(Val key) {
+  return !VAL_IS_PTR(key) || is_symbol0(key);
+}
+
+u32 gs_eq_hash(Val key) {
+  u64 x;
+  if (is_symbol0(key)) {
+    x = VAL2PTR(Symbol, key)->hash;
+  } else if (VAL_IS_PTR(key)) {
+    return 0;
+  } else {
+    x = key;
+  }
+  // spread the bits, so that each level of the trie sees all of them
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return (u32) x;
+}
+
+static u32 bit_of(u32 hash, u32 shift) {
+  return (u32) 1 << ((hash >> shift) & LEVEL_MASK);
+}
+
+static u32 index_of(u32 map, u32 bit) {
+  return __builtin_popcount(map & (bit - 1));
+}
+
+static Err *alloc_node(u32 datamap, u32 nodemap, u32 len, HashMapNode **out) {
+  GS_TRY(gs_gc_alloc_array(HASH_MAP_NODE_TYPE, len, (anyptr *)out));
+  (*out)->datamap = datamap;
+  (*out)->nodemap = nodemap;
+  GS_RET_OK;
+}
+
+// a copy of node with the maps given, and removec slots from at
+// replaced with insertc slots from insert
+static Err *splice(
+  HashMapNode *node, u32 datamap, u32 nodemap,
+  u32 at, u32 removec, const Val *insert, u32 insertc,
+  HashMapNode **out
+) {
+  HashMapNode *copy;
+  GS_TRY(alloc_node(datamap, nodemap, node->len - removec + insertc, &copy));
+  memcpy(copy->slots, node->slots, at * sizeof(Val));
+  if (insertc) memcpy(copy->slots + at, insert, insertc * sizeof(Val));
+  memcpy(
+    copy->slots + at + insertc,
+    node->slots + at + removec,
+    (node->len - at - removec) * sizeof(Val)
+  );
+  *out = copy;
+  GS_RET_OK;
+}
+
+// a node holding just these two entries, at the given shift
+static Err *pair_node(
+  u32 shift,
+  u32 hash1, Val key1, Val value1,
+  u32 hash2, Val key2, Val value2,
+  HashMapNode **out
+) {
+  if (shift >= HASH_BITS) {
+    GS_TRY(alloc_node(0, 0, 4, out));
+    Val *slots = (*out)->slots;
+    slots[0] = key1; slots[1] = value1;
+    slots[2] = key2; slots[3] = value2;
+    GS_RET_OK;
+  }
+  u32 bit1 = bit_of(hash1, shift);
+  u32 bit2 = bit_of(hash2, shift);
+  if (bit1 == bit2) {
+    HashMapNode *child;
+    GS_TRY(pair_node(shift + LEVEL_BITS, hash1, key1, value1, hash2, key2, value2, &child));
+    GS_TRY(alloc_node(0, bit1, 1, out));
+    (*out)->slots[0] = PTR2VAL_GC(child);
+    GS_RET_OK;
+  }
+  GS_TRY(alloc_node(bit1 | bit2, 0, 4, out));
+  Val *slots = (*out)->slots;
+  if (bit1 > bit2) {
+    slots[0] = key2; slots[1] = value2;
+    slots[2] = key1; slots[3] = value1;
+  } else {
+    slots[0] = key1; slots[1] = value1;
+    slots[2] = key2; slots[3] = value2;
+  }
+  GS_RET_OK;
+}
+
+static Err *node_assoc(
+  HashMapNode *node, u32 shift, u32 hash,
+  Val key, Val value,
+  HashMapNode **out, bool *added
+) {
+  if (shift >= HASH_BITS) {
+    for (u32 i = 0; i < node->len; i += 2) {
+      if (node->slots[i] == key) {
+        if (node->slots[i + 1] == value) {
+          *out = node;
+          GS_RET_OK;
+        }
+        return splice(node, 0, 0, i + 1, 1, &value, 1, out);
+      }
+    }
+    *added = true;
+    Val entry[] = { key, value };
+    return splice(node, 0, 0, node->len, 0, entry, 2, out);
+  }
+
+  u32 bit = bit_of(hash, shift);
+  u32 datac = __builtin_popcount(node->datamap);
+  if (node->datamap & bit) {
+    u32 idx = index_of(node->datamap, bit);
+    Val oldKey = node->slots[2 * idx];
+    Val oldValue = node->slots[2 * idx + 1];
+    if (oldKey == key) {
+      if (oldValue == value) {
+        *out = node;
+        GS_RET_OK;
+      }
+      return splice(node, node->datamap, node->nodemap, 2 * idx + 1, 1, &value, 1, out);
+    }
+
+    // push both entries down into a new child
+    *added = true;
+    HashMapNode *child;
+    GS_TRY(pair_node(
+      shift + LEVEL_BITS,
+      gs_eq_hash(oldKey), oldKey, oldValue,
+      hash, key, value,
+      &child
+    ));
+    HashMapNode *copy;
+    GS_TRY(alloc_node(node->datamap ^ bit, node->nodemap | bit, node->len - 1, &copy));
+    u32 childAt = 2 * (datac - 1) + index_of(node->nodemap, bit);
+    Val *dst = copy->slots;
+    Val *src = node->slots;
+    memcpy(dst, src, 2 * idx * sizeof(Val));
+    memcpy(dst + 2 * idx, src + 2 * idx + 2, (childAt - 2 * idx) * sizeof(Val));
+    dst[childAt] = PTR2VAL_GC(child);
+    memcpy(dst + childAt + 1, src + childAt + 2, (node->len - childAt - 2) * sizeof(Val));
+    *out = copy;
+    GS_RET_OK;
+  }
+
+  if (node->nodemap & bit) {
+    u32 slot = 2 * datac + index_of(node->nodemap, bit);
+    HashMapNode *child = VAL2PTR(HashMapNode, node->slots[slot]);
+    HashMapNode *newChild;
+    GS_TRY(node_assoc(child, shift + LEVEL_BITS, hash, key, value, &newChild, added));
+    if (newChild == child) {
+      *out = node;
+      GS_RET_OK;
+    }
+    Val childV = PTR2VAL_GC(newChild);
+    return splice(node, node->datamap, node->nodemap, slot, 1, &childV, 1, out);
+  }
+
+  *added = true;
+  Val entry[] = { key, value };
+  u32 idx = index_of(node->datamap, bit);
+  return splice(node, node->datamap | bit, node->nodemap, 2 * idx, 0, entry, 2, out);
+}
+
+// whether a node holds just one entry, and no children, so its parent
+// can hold that entry instead
+static bool is_single(HashMapNode *node) {
+  return node->nodemap == 0 && node->len == 2;
+}
+
+// out is set to NULL if the node is left empty
+static Err *node_dissoc(
+  HashMapNode *node, u32 shift, u32 hash, Val key,
+  HashMapNode **out, bool *removed
+) {
+  *out = node;
+  if (shift >= HASH_BITS) {
+    for (u32 i = 0; i < node->len; i += 2) {
+      if (node->slots[i] == key) {
+        *removed = true;
+        if (node->len == 2) {
+          *out = NULL;
+          GS_RET_OK;
+        }
+        return splice(node, 0, 0, i, 2, NULL, 0, out);
+      }
+    }
+    GS_RET_OK;
+  }
+
+  u32 bit = bit_of(hash, shift);
+  u32 datac = __builtin_popcount(node->datamap);
+  if (node->datamap & bit) {
+    u32 idx = index_of(node->datamap, bit);
+    if (node->slots[2 * idx] != key) GS_RET_OK;
+    *removed = true;
+    if (node->len == 2) {
+      *out = NULL;
+      GS_RET_OK;
+    }
+    return splice(node, node->datamap ^ bit, node->nodemap, 2 * idx, 2, NULL, 0, out);
+  }
+
+  if (node->nodemap & bit) {
+    u32 slot = 2 * datac + index_of(node->nodemap, bit);
+    HashMapNode *child = VAL2PTR(HashMapNode, node->slots[slot]);
+    HashMapNode *newChild;
+    GS_TRY(node_dissoc(child, shift + LEVEL_BITS, hash, key, &newChild, removed));
+    if (newChild == child) GS_RET_OK;
+    if (!newChild) {
+      if (node->len == 1) {
+        *out = NULL;
+        GS_RET_OK;
+      }
+      return splice(node, node->datamap, node->nodemap ^ bit, slot, 1, NULL, 0, out);
+    }
+    if (is_single(newChild)) {
+      // pull the remaining entry up into this node
+      u32 idx = index_of(node->datamap, bit);
+      HashMapNode *copy;
+      GS_TRY(alloc_node(node->datamap | bit, node->nodemap ^ bit, node->len + 1, &copy));
+      Val *dst = copy->slots;
+      Val *src = node->slots;
+      memcpy(dst, src, 2 * idx * sizeof(Val));
+      dst[2 * idx] = newChild->slots[0];
+      dst[2 * idx + 1] = newChild->slots[1];
+      memcpy(dst + 2 * idx + 2, src + 2 * idx, (slot - 2 * idx) * sizeof(Val));
+      memcpy(dst + slot + 2, src + slot + 1, (node->len - slot - 1) * sizeof(Val));
+      *out = copy;
+      GS_RET_OK;
+    }
+    Val childV = PTR2VAL_GC(newChild);
+    return splice(node, node->datamap, node->nodemap, slot, 1, &childV, 1, out);
+  }
+
+  GS_RET_OK;
+}
+
+void gs_hash_map_get(HashMap *map, Val key, bool *found, Val *out) {
+  *found = false;
+  if (!map || !gs_eq_hashable(key)) return;
+  u32 hash = gs_eq_hash(key);
+  HashMapNode *node = map->root;
+  for (u32 shift = 0; node; shift += LEVEL_BITS) {
+    if (shift >= HASH_BITS) {
+      for (u32 i = 0; i < node->len; i += 2) {
+        if (node->slots[i] == key) {
+          *found = true;
+          *out = node->slots[i + 1];
+          return;
+        }
+      }
+      return;
+    }
+    u32 bit = bit_of(hash, shift);
+    if (node->datamap & bit) {
+      u32 idx = index_of(node->datamap, bit);
+      if (node->slots[2 * idx] == key) {
+        *found = true;
+        *out = node->slots[2 * idx + 1];
+      }
+      return;
+    }
+    if (!(node->nodemap & bit)) return;
+    u32 slot = 2 * __builtin_popcount(node->datamap) + index_of(node->nodemap, bit);
+    node = VAL2PTR(HashMapNode, node->slots[slot]);
+  }
+}
+
+static Err *new_map(u32 count, HashMapNode *root, HashMap **out) {
+  if (!root) {
+    *out = NULL;
+    GS_RET_OK;
+  }
+  GS_TRY(gs_gc_alloc(HASH_MAP_TYPE, (anyptr *)out));
+  (*out)->count = count;
+  (*out)->root = root;
+  GS_RET_OK;
+}
+
+Err *gs_hash_map_assoc(HashMap *map, Val key, Val value, HashMap **out) {
+  if (!gs_eq_hashable(key)) {
+    GS_FAILWITH_VAL_MSG("Hash map keys must be symbols or immediates", key);
+  }
+  u32 hash = gs_eq_hash(key);
+  HashMapNode *root;
+  bool added = false;
+  if (!map) {
+    GS_TRY(alloc_node(bit_of(hash, 0), 0, 2, &root));
+    root->slots[0] = key;
+    root->slots[1] = value;
+    added = true;
+  } else {
+    GS_TRY(node_assoc(map->root, 0, hash, key, value, &root, &added));
+    if (root == map->root) {
+      *out = map;
+      GS_RET_OK;
+    }
+  }
+  return new_map((map ? map->count : 0) + added, root, out);
+}
+
+Err *gs_hash_map_dissoc(HashMap *map, Val key, HashMap **out) {
+  if (!map || !gs_eq_hashable(key)) {
+    *out = map;
+    GS_RET_OK;
+  }
+  HashMapNode *root;
+  bool removed = false;
+  GS_TRY(node_dissoc(map->root, 0, gs_eq_hash(key), key, &root, &removed));
+  if (root == map->root) {
+    *out = map;
+    GS_RET_OK;
+  }
+  return new_map(map->count - removed, root, out);
+}
+
+static Err *push_entries(HashMapNode *node, Val *acc) {
+  u32 datac = node->nodemap ? __builtin_popcount(node->datamap) : node->len / 2;
+  for (u32 i = 0; i < datac; ++i) {
+    Val entry;
+    GS_TRY(gs_alloc_list(node->slots + 2 * i, 2, &entry));
+    Cons *cons;
+    GS_TRY(gs_gc_alloc(CONS_TYPE, (anyptr *)&cons));
+    cons->car = entry;
+    cons->cdr = *acc;
+    *acc = PTR2VAL_GC(cons);
+  }
+  for (u32 i = 2 * datac; i < node->len; ++i) {
+    GS_TRY(push_entries(VAL2PTR(HashMapNode, node->slots[i]), acc));
+  }
+  GS_RET_OK;
+}
+
+Err *gs_hash_map_entries(HashMap *map, Val *out) {
+  *out = VAL_NIL;
+  if (map) GS_TRY(push_entries(map->root, out));
+  GS_RET_OK;
+}
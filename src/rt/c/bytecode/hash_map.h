@@ -0,0 +1,48 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "primitives.h"
+
+/**
+ * Persistent hash maps keyed by eq?, as hash array mapped tries.
+ *
+ * Maps are never modified once built: assoc and dissoc copy the path
+ * to the changed entry and share the rest. A NULL map is empty.
+ *
+ * Keys are symbols and immediates, the values gs_eq_hash can hash.
+ * Other objects have no hash that survives them moving, and the
+ * tries are shared, so they cannot be rehashed after a collection
+ * the way hash tables are.
+ */
+
+/**
+ * A hash of a value that agrees with eq? and survives the value
+ * moving, or being snapshotted. Symbols hash by name, and immediates
+ * by their bits; other values all hash to 0.
+ */
+u32 gs_eq_hash(Val key);
+// whether key has a hash from gs_eq_hash, so can be a hash map key
+bool gs_eq_hashable(Val key);
+
+// look up key, setting found, and out to its value if it was found
+void gs_hash_map_get(HashMap *map, Val key, bool *found, Val *out);
+// fails if key is not gs_eq_hashable
+Err *gs_hash_map_assoc(HashMap *map, Val key, Val value, HashMap **out);
+Err *gs_hash_map_dissoc(HashMap *map, Val key, HashMap **out);
+// the entries of a map as a list of (key value) lists, in no particular order
+Err *gs_hash_map_entries(HashMap *map, Val *out);
@@ -0,0 +1,246 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hash_table.h"
+#include "hash_map.h"
+#include "../gc/gc.h"
+#include "tck.h"
+
+#include <string.h>
+
+#define MIN_CAPACITY 8
+// bucket markers, constants that are never the value of an expression
+#define SLOT_EMPTY ((Val) 0x12)
+#define SLOT_REMOVED ((Val) 0x1A)
+// how many values of a list or tree gs_equal_hash looks at
+#define HASH_BUDGET 32
+
+static bool bytes_equal(Bytes lhs, Bytes rhs) {
+  return lhs.len == rhs.len && memcmp(lhs.bytes, rhs.bytes, lhs.len) == 0;
+}
+
+bool gs_equal(Val lhs, Val rhs) {
+  while (lhs != rhs) {
+    if (is_type(lhs, CONS_TYPE) && is_type(rhs, CONS_TYPE)) {
+      Cons *l = VAL2PTR(Cons, lhs), *r = VAL2PTR(Cons, rhs);
+      if (!gs_equal(l->car, r->car)) return false;
+      lhs = l->cdr;
+      rhs = r->cdr;
+    } else if (is_string0(lhs) && is_string0(rhs)) {
+      return bytes_equal(string_bytes(lhs), string_bytes(rhs));
+    } else if (is_bytestring0(lhs) && is_bytestring0(rhs)) {
+      return bytes_equal(bytestring_bytes(lhs), bytestring_bytes(rhs));
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static u32 mix(u64 x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return (u32) x;
+}
+
+// the hash of a value compared by identity
+static u32 identity_hash(Val val, bool *byAddress) {
+  if (VAL_IS_NOGC_PTR(val) || (byAddress && VAL_IS_GC_PTR(val) && !is_symbol0(val))) {
+    if (VAL_IS_GC_PTR(val)) *byAddress = true;
+    return mix(val);
+  }
+  return gs_eq_hash(val);
+}
+
+static u32 hash_within(Val val, bool *byAddress, u32 *budget) {
+  if (!*budget) return 0;
+  --*budget;
+  if (is_type(val, CONS_TYPE)) {
+    u64 h = 0xc0115;
+    while (is_type(val, CONS_TYPE) && *budget) {
+      Cons *cons = VAL2PTR(Cons, val);
+      h = h * 31 + hash_within(cons->car, byAddress, budget);
+      val = cons->cdr;
+    }
+    return mix(h * 31 + hash_within(val, byAddress, budget));
+  } else if (is_string0(val)) {
+    return mix(gs_hash_bytes(string_bytes(val)));
+  } else if (is_bytestring0(val)) {
+    return mix(~gs_hash_bytes(bytestring_bytes(val)));
+  }
+  return identity_hash(val, byAddress);
+}
+
+u32 gs_equal_hash(Val val, bool *byAddress) {
+  u32 budget = HASH_BUDGET;
+  return hash_within(val, byAddress, &budget);
+}
+
+static u32 key_hash(HashTable *table, Val key, bool *byAddress) {
+  return table->flags & HASH_TABLE_EQUAL
+    ? gs_equal_hash(key, byAddress)
+    : identity_hash(key, byAddress);
+}
+
+static bool key_equal(HashTable *table, Val lhs, Val rhs) {
+  return lhs == rhs || ((table->flags & HASH_TABLE_EQUAL) && gs_equal(lhs, rhs));
+}
+
+// the number of buckets in a table
+static u32 capacity(HashTable *table) {
+  return table->slots->len / 2;
+}
+
+static Err *put_slot(Array *slots, u32 idx, Val val) {
+  if (VAL_IS_GC_PTR(val)) {
+    GS_TRY(gs_gc_write_barrier(slots, &slots->data[idx], VAL2PTR(u8, val), FieldGcTagged));
+  }
+  slots->data[idx] = val;
+  GS_RET_OK;
+}
+
+static Err *alloc_slots(u32 cap, Array **out) {
+  GS_TRY(gs_gc_alloc_array(ARRAY_TYPE, 2 * cap, (anyptr *)out));
+  for (u32 i = 0; i < 2 * cap; i += 2) {
+    (*out)->data[i] = SLOT_EMPTY;
+    (*out)->data[i + 1] = VAL_NIL;
+  }
+  GS_RET_OK;
+}
+
+// the bucket of key, or else the first free bucket where it could be
+// inserted, preferring removed buckets to empty ones
+static u32 probe(HashTable *table, Val key, u32 hash, bool *found) {
+  u32 mask = capacity(table) - 1;
+  Val *data = table->slots->data;
+  u32 free = (u32) -1;
+  for (u32 i = hash & mask;; i = (i + 1) & mask) {
+    Val slot = data[2 * i];
+    if (slot == SLOT_EMPTY) {
+      *found = false;
+      return free == (u32) -1 ? i : free;
+    } else if (slot == SLOT_REMOVED) {
+      if (free == (u32) -1) free = i;
+    } else if (key_equal(table, slot, key)) {
+      *found = true;
+      return i;
+    }
+  }
+}
+
+// reinsert every entry into cap fresh buckets, recomputing hashes
+static Err *rehash(HashTable *table, u32 cap) {
+  Array *old = table->slots, *slots;
+  GS_TRY(alloc_slots(cap, &slots));
+  GS_TRY(gs_gc_write_barrier(table, &table->slots, slots, FieldGcRaw));
+  table->slots = slots;
+  table->used = table->count;
+  table->flags &= ~(HASH_TABLE_BY_ADDRESS | HASH_TABLE_STALE);
+  table->epoch = gs_gc_epoch();
+  bool byAddress = false;
+  for (u32 i = 0; i < old->len; i += 2) {
+    Val key = old->data[i];
+    if (key == SLOT_EMPTY || key == SLOT_REMOVED) continue;
+    bool found;
+    u32 idx = probe(table, key, key_hash(table, key, &byAddress), &found);
+    slots->data[2 * idx] = key;
+    slots->data[2 * idx + 1] = old->data[i + 1];
+  }
+  if (byAddress) table->flags |= HASH_TABLE_BY_ADDRESS;
+  GS_RET_OK;
+}
+
+// rehash if keys hashed by address may have moved since the last time
+static Err *refresh(HashTable *table) {
+  if ((table->flags & HASH_TABLE_STALE) ||
+      ((table->flags & HASH_TABLE_BY_ADDRESS) && table->epoch != gs_gc_epoch())) {
+    GS_TRY(rehash(table, capacity(table)));
+  }
+  GS_RET_OK;
+}
+
+Err *gs_hash_table_new(bool equal, HashTable **out) {
+  HashTable *table;
+  GS_TRY(gs_gc_alloc(HASH_TABLE_TYPE, (anyptr *)&table));
+  table->count = table->used = 0;
+  table->flags = equal ? HASH_TABLE_EQUAL : 0;
+  table->epoch = gs_gc_epoch();
+  GS_TRY(alloc_slots(MIN_CAPACITY, &table->slots));
+  *out = table;
+  GS_RET_OK;
+}
+
+Err *gs_hash_table_get(HashTable *table, Val key, bool *found, Val *out) {
+  GS_TRY(refresh(table));
+  bool byAddress;
+  u32 idx = probe(table, key, key_hash(table, key, &byAddress), found);
+  if (*found) *out = table->slots->data[2 * idx + 1];
+  GS_RET_OK;
+}
+
+Err *gs_hash_table_set(HashTable *table, Val key, Val value) {
+  GS_TRY(refresh(table));
+  bool byAddress = false, found;
+  u32 hash = key_hash(table, key, &byAddress);
+  u32 idx = probe(table, key, hash, &found);
+  if (!found) {
+    u32 cap = capacity(table);
+    if (table->slots->data[2 * idx] == SLOT_EMPTY && (table->used + 1) * 4 > cap * 3) {
+      // if most used buckets were removed, clearing them is enough
+      GS_TRY(rehash(table, (table->count + 1) * 2 > cap ? cap * 2 : cap));
+      idx = probe(table, key, hash, &found);
+    }
+    if (table->slots->data[2 * idx] == SLOT_EMPTY) table->used++;
+    table->count++;
+    GS_TRY(put_slot(table->slots, 2 * idx, key));
+    if (byAddress) {
+      // refreshed above, so any other keys hashed by address are up to date
+      table->flags |= HASH_TABLE_BY_ADDRESS;
+      table->epoch = gs_gc_epoch();
+    }
+  }
+  return put_slot(table->slots, 2 * idx + 1, value);
+}
+
+Err *gs_hash_table_remove(HashTable *table, Val key, bool *removed) {
+  GS_TRY(refresh(table));
+  bool byAddress;
+  u32 idx = probe(table, key, key_hash(table, key, &byAddress), removed);
+  if (*removed) {
+    table->slots->data[2 * idx] = SLOT_REMOVED;
+    table->slots->data[2 * idx + 1] = VAL_NIL;
+    table->count--;
+  }
+  GS_RET_OK;
+}
+
+Err *gs_hash_table_entries(HashTable *table, Val *out) {
+  *out = VAL_NIL;
+  for (u32 i = 0; i < table->slots->len; i += 2) {
+    Val *slot = table->slots->data + i;
+    if (*slot == SLOT_EMPTY || *slot == SLOT_REMOVED) continue;
+    Val entry;
+    GS_TRY(gs_alloc_list(slot, 2, &entry));
+    Cons *cons;
+    GS_TRY(gs_gc_alloc(CONS_TYPE, (anyptr *)&cons));
+    cons->car = entry;
+    cons->cdr = *out;
+    *out = PTR2VAL_GC(cons);
+  }
+  GS_RET_OK;
+}
@@ -0,0 +1,56 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "primitives.h"
+
+/**
+ * Mutable hash tables, keyed by either eq? or equal?.
+ *
+ * Tables use open addressing with linear probing, and grow once
+ * three quarters of their buckets have been used. Keys that can only
+ * be hashed by their address, such as closures, make the table
+ * rehash the first time it is used after the GC may have moved them.
+ */
+
+#define HASH_TABLE_EQUAL 1
+// some key was hashed by its address
+#define HASH_TABLE_BY_ADDRESS 2
+// every key must be rehashed before the table is used, as when it
+// was loaded from a snapshot
+#define HASH_TABLE_STALE 4
+
+/**
+ * Structural equality: conses are equal if their cars and cdrs are,
+ * strings and bytestrings if their bytes are, and anything else only
+ * if it is eq?.
+ */
+bool gs_equal(Val lhs, Val rhs);
+/**
+ * A hash of a value that agrees with gs_equal. Objects compared by
+ * identity hash by their address if byAddress is given, setting it
+ * to true, or otherwise all hash alike, as in gs_eq_hash.
+ */
+u32 gs_equal_hash(Val val, bool *byAddress);
+
+Err *gs_hash_table_new(bool equal, HashTable **out);
+// look up key, setting found, and out to its value if it was found
+Err *gs_hash_table_get(HashTable *table, Val key, bool *found, Val *out);
+Err *gs_hash_table_set(HashTable *table, Val key, Val value);
+Err *gs_hash_table_remove(HashTable *table, Val key, bool *removed);
+// the entries of a table as a list of (key value) lists, in no particular order
+Err *gs_hash_table_entries(HashTable *table, Val *out);
@@ -20,6 +20,7 @@
 #include "interp.h"
 #include "../logging.h"
 #include "primitives.h"
+#include "utf8.h"
 #include "../gc/gc.h"
 #include "ops.h"
 #include "le_unaligned.h"
@@ -28,17 +29,8 @@
 #include <stddef.h>
 #include <string.h>
 
-#ifndef __BYTE_ORDER__
-#  error "unknown byte order"
-#else
-#  if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-u32 get32le(u32le le) { return le.raw; }
-u64 get64le(u64le le) { return le.raw; }
-#  else
-u32 get32le(u32le le) { return __builtin_bswap32(le.raw); }
-u64 get64le(u64le le) { return __builtin_bswap64(le.raw); }
-#  endif
-#endif
+u32 get32le(u32le le) { return GS_LE32(le.raw); }
+u64 get64le(u64le le) { return GS_LE64(le.raw); }
 
 typedef struct ImageReader {
   const u8 *buf;
@@ -65,6 +57,19 @@ static Err *next_u32(ImageReader *rd, u32le *out) {
   return next_raw(rd, out);
 }
 
+static Err *next_code(ImageReader *rd, CodeInfo **out) {
+  CodeInfo *ci = *out = (CodeInfo *) (rd->buf + rd->pos);
+  GS_TRY_MSG(skipN(rd, sizeof(u32) * 4 /* len, locals, maxStack, stackMapLen */), "code header");
+  u32 len = get32le(ci->len);
+  u32 paddedLen = pad_to_align(len);
+  GS_FAIL_IF(paddedLen < len, "integer overflow", NULL);
+  GS_TRY_MSG(skipN(rd, paddedLen), "code instructions");
+  u32 stackMapLen = get32le(ci->stackMapLen);
+  GS_FAIL_IF(stackMapLen > UINT32_MAX / 4, "integer overflow", NULL);
+  GS_TRY_MSG(skipN(rd, stackMapLen * 8), "code stack map");
+  GS_RET_OK;
+}
+
 Err *gs_index_image(u32 len, const u8 *buf, Image **retP) {
   LOG_DEBUG("Indexing image at %p", buf);
 
@@ -117,6 +122,9 @@ Err *gs_index_image(u32 len, const u8 *buf, Image **retP) {
       GS_TRY_MSG(next_u32(&rd, &val), "constant count");
       u32 constCount = get32le(val);
       GS_TRY(gs_gc_alloc_array(OPAQUE_ARRAY_TYPE, constCount, (anyptr *)&ret->constants));
+      GS_FAIL_IF(constCount > UINT32_MAX / sizeof(u32), "integer overflow", NULL);
+      GS_TRY(gs_gc_alloc_array(BYTESTRING_TYPE, constCount * sizeof(u32), (anyptr *)&ret->stringLengths));
+      u32 *stringLengths = (u32 *) ret->stringLengths->bytes;
       ConstInfo **values = ret->constants->values;
       for (u32 constIdx = 0; constIdx < constCount; ++constIdx) {
         ConstInfo *thisPtr = values[constIdx] = (ConstInfo *) (rd.buf + rd.pos);
@@ -147,6 +155,16 @@ Err *gs_index_image(u32 len, const u8 *buf, Image **retP) {
           u32 paddedLen = pad_to_align(len);
           GS_FAIL_IF(paddedLen < len, "integer overflow", NULL);
           GS_TRY_MSG(skipN(&rd, paddedLen), "byte data");
+          if (get32le(thisPtr->ty) == CString) {
+            GS_FAIL_IF(
+              !gs_utf8_validate(
+                (Utf8Str) { ((struct ConstBytevec *) thisPtr)->data, len },
+                &stringLengths[constIdx]
+              ),
+              "invalid UTF-8 in string constant",
+              NULL
+            );
+          }
           break;
         }
         case CDirect: {
@@ -166,23 +184,7 @@ Err *gs_index_image(u32 len, const u8 *buf, Image **retP) {
       GS_TRY(gs_gc_alloc_array(OPAQUE_ARRAY_TYPE, len, (anyptr *)&ret->codes));
       CodeInfo **values = ret->codes->values;
       for (u32 i = 0; i < len; ++i) {
-        CodeInfo *ci = values[i] = (CodeInfo *) (rd.buf + rd.pos);
-        GS_TRY_MSG(skipN(&rd, sizeof(u32) * 4 /* len, locals, maxStack, stackMapLen */), "code header");
-        u32 len = get32le(values[i]->len);
-        u32 paddedLen = pad_to_align(len);
-        GS_FAIL_IF(paddedLen < len, "integer overflow", NULL);
-        GS_TRY_MSG(skipN(&rd, paddedLen), "code instructions");
-        u32 stackMapLen = get32le(ci->stackMapLen);
-        GS_FAIL_IF(stackMapLen > UINT32_MAX / 4, "integer overflow", NULL);
-        GS_TRY_MSG(skipN(&rd, stackMapLen * 8), "code stack map");
-        err = gs_verify_code(ret, ci);
-        if (err) {
-          LOG_ERROR("Failed verification of code %" PRIu32, i);
-          if (LOG_LEVEL >= LVLNO_ERROR) {
-            gs_stderr_dump_code(ret, ci);
-          }
-          GS_FAILWITH("Verification failed", err);
-        }
+        GS_TRY(next_code(&rd, &values[i]));
       }
       break;
     }
@@ -206,6 +208,30 @@ Err *gs_index_image(u32 len, const u8 *buf, Image **retP) {
       }
       break;
     }
+    case SecSymbols: {
+      GS_TRY_MSG(next_u32(&rd, &val), "symbol count");
+      u32 len = ret->symbols.len = get32le(val);
+      ret->symbols.entries = (SymbolInfo *) (rd.buf + rd.pos);
+      GS_FAIL_IF(len > UINT32_MAX / sizeof(SymbolInfo), "integer overflow", NULL);
+      GS_TRY_MSG(skipN(&rd, len * sizeof(SymbolInfo)), "symbol vector");
+      if (len > 0) {
+        GS_FAIL_IF(!ret->constants, "no constants", NULL);
+        for (SymbolInfo *si = ret->symbols.entries; si != ret->symbols.entries + len; ++si) {
+          GS_FAIL_IF(get32le(si->symbol) >= ret->constants->len, "symbol constant out of bounds", NULL);
+          GS_FAIL_IF(
+            get32le(ret->constants->values[get32le(si->symbol)]->ty) != CSymbol,
+            "not a symbol",
+            NULL
+          );
+          GS_FAIL_IF(
+            si != ret->symbols.entries && get32le(si->hash) < get32le(si[-1].hash),
+            "symbols not sorted by hash",
+            NULL
+          );
+        }
+      }
+      break;
+    }
     case SecStart: {
       GS_TRY(next_u32(&rd, &val));
       u32 codeRef = get32le(val);
@@ -221,14 +247,68 @@ Err *gs_index_image(u32 len, const u8 *buf, Image **retP) {
 #undef GS_FAIL_HERE
 #define GS_FAIL_HERE(X) GS_FAIL_HERE_DEFAULT(X)
 
-  GS_FAIL_IF(minCodeLen > (!ret->codes ? 0 : ret->codes->len), "code reference out of bounds", NULL);
+  u32 codeCount = !ret->codes ? 0 : ret->codes->len;
+  GS_FAIL_IF(minCodeLen > codeCount, "code reference out of bounds", NULL);
+
+  GS_TRY(gs_gc_alloc_array(BYTESTRING_TYPE, (codeCount + 7) / 8, (anyptr *)&ret->verified));
+  memset(ret->verified->bytes, 0, ret->verified->len);
+  ret->verifiedc = 0;
+  ret->symbols.verified = false;
+
+#if !GS_LAZY_VERIFY
+  GS_TRY(gs_verify_image(ret));
+#endif
 
   *retP = ret;
 
   GS_RET_OK;
 }
 
-static Err *bake_constant(Val *baked_so_far, ConstInfo *info, Val *out) {
+Err *gs_live_image(u32 codec, InlineBytes **codes, u32 constc, Val *consts, Image **retP) {
+  Image *ret;
+  GS_TRY(gs_gc_alloc(IMAGE_TYPE, (anyptr *)&ret));
+  memset(ret, 0, sizeof(Image));
+
+  u64 len = 0;
+  for (u32 i = 0; i < codec; ++i) {
+    GS_FAIL_IF(codes[i]->len % U32_ALIGN != 0, "bad alignment of code", NULL);
+    len += codes[i]->len;
+  }
+  GS_FAIL_IF(len > UINT32_MAX, "integer overflow", NULL);
+
+  // as in gs_index_image, codes point into the buffer, so it must not move
+  gs_gc_force_next_large();
+  GS_TRY(gs_gc_alloc_array(BYTESTRING_TYPE, (u32) len, (anyptr *)&ret->buf));
+  u8 *pos = ret->buf->bytes;
+  for (u32 i = 0; i < codec; ++i) {
+    memcpy(pos, codes[i]->bytes, codes[i]->len);
+    pos += codes[i]->len;
+  }
+
+  ImageReader rd = { ret->buf->bytes, (u32) len, 0 };
+  GS_TRY(gs_gc_alloc_array(OPAQUE_ARRAY_TYPE, codec, (anyptr *)&ret->codes));
+  for (u32 i = 0; i < codec; ++i) {
+    u32 start = rd.pos;
+    GS_TRY(next_code(&rd, &ret->codes->values[i]));
+    GS_FAIL_IF(rd.pos - start != codes[i]->len, "trailing bytes after code", NULL);
+  }
+
+  // constants are already live, there is nothing to bake
+  GS_TRY(gs_gc_alloc_array(ARRAY_TYPE, constc, (anyptr *)&ret->constantsBaked));
+  memcpy(ret->constantsBaked->values, consts, constc * sizeof(Val));
+
+  GS_TRY(gs_gc_alloc_array(BYTESTRING_TYPE, (codec + 7) / 8, (anyptr *)&ret->verified));
+  memset(ret->verified->bytes, 0, ret->verified->len);
+  ret->verifiedc = 0;
+  ret->symbols.verified = true;
+
+  *retP = ret;
+  GS_RET_OK;
+}
+
+static Err *bake_constant(Image *img, u32 constIdx, Val *out) {
+  ConstInfo *info = img->constants->values[constIdx];
+  Val *baked_so_far = img->constantsBaked->values;
   u32 cTy;
   switch (cTy = get32le(info->ty)) {
   case CDirect: {
@@ -252,10 +332,16 @@ static Err *bake_constant(Val *baked_so_far, ConstInfo *info, Val *out) {
     break;
   }
   case CString: {
+    // the image buffer never moves, so the string can borrow its bytes
     struct ConstBytevec *bv = (anyptr) info;
-    InlineUtf8Str *theStr;
-    GS_TRY(gs_gc_alloc_array(STRING_TYPE, get32le(bv->len), (anyptr *)&theStr));
-    memcpy(theStr->bytes, bv->data, theStr->len);
+    ExternalUtf8Str *theStr;
+    GS_TRY(gs_gc_alloc(EXTERNAL_STRING_TYPE, (anyptr *)&theStr));
+    theStr->owner = img->buf;
+    theStr->len = get32le(bv->len);
+    theStr->bytes = bv->data;
+    theStr->index = NULL;
+    // validated and counted when the image was indexed
+    theStr->cpLen = ((u32 *) img->stringLengths->bytes)[constIdx];
     *out = PTR2VAL_GC(theStr);
     break;
   }
@@ -275,6 +361,19 @@ static Err *bake_constant(Val *baked_so_far, ConstInfo *info, Val *out) {
     *out = ret;
     break;
   }
+  case CLambda: {
+    struct ConstLambda *cl = (anyptr) info;
+    u32 capturec = get32le(cl->captured.len);
+    GS_FAIL_IF(capturec > UINT16_MAX, "too many captures", NULL);
+    Val captured[capturec];
+    for (u32 i = 0; i < capturec; ++i) {
+      captured[i] = baked_so_far[get32le(cl->captured.elements[i])];
+    }
+    InterpClosure *cls;
+    GS_TRY(gs_interp_closure(img, get32le(cl->code), captured, (u16) capturec, &cls));
+    *out = PTR2VAL_GC(cls);
+    break;
+  }
   default: {
     LOG_ERROR("Unknown constant type: %" PRIu32, cTy);
     GS_FAILWITH("Unknown constant type", NULL);
@@ -310,6 +409,82 @@ static Err *lookup_label(
   GS_FAILWITH("Entry not found", NULL);
 }
 
+Err *gs_verify_code_ref(Image *img, u32 codeRef) {
+  GS_FAIL_IF(!img->codes || codeRef >= img->codes->len, "code out of bounds", NULL);
+  if (gs_code_verified(img, codeRef)) GS_RET_OK;
+  CodeInfo *ci = img->codes->values[codeRef];
+  Err *err = gs_verify_code(img, ci);
+  if (err) {
+    LOG_ERROR("Failed verification of code %" PRIu32, codeRef);
+    if (LOG_LEVEL >= LVLNO_ERROR) {
+      gs_stderr_dump_code(img, ci);
+    }
+    GS_FAILWITH("Verification failed", err);
+  }
+  img->verified->bytes[codeRef / 8] |= 1 << (codeRef % 8);
+  img->verifiedc++;
+  GS_RET_OK;
+}
+
+Err *gs_verify_symbols(Image *img) {
+  if (img->symbols.verified) GS_RET_OK;
+  SymbolInfo *entries = img->symbols.entries;
+  for (u32 i = 0; i < img->symbols.len; ++i) {
+    struct ConstBytevec *bv = (anyptr) img->constants->values[get32le(entries[i].symbol)];
+    Utf8Str name = { bv->data, get32le(bv->len) };
+    // a bad hash would send the symbol to the wrong bucket, and intern a duplicate
+    GS_FAIL_IF((u32) gs_hash_bytes(name) != get32le(entries[i].hash), "Wrong symbol hash", NULL);
+  }
+  img->symbols.verified = true;
+  GS_RET_OK;
+}
+
+Err *gs_verify_image(Image *img) {
+  GS_TRY(gs_verify_symbols(img));
+  u32 codeCount = !img->codes ? 0 : img->codes->len;
+  for (u32 i = 0; i < codeCount && img->verifiedc < codeCount; ++i) {
+    GS_TRY(gs_verify_code_ref(img, i));
+  }
+  GS_RET_OK;
+}
+
+void gs_trust_image(Image *img) {
+  u32 codeCount = !img->codes ? 0 : img->codes->len;
+  memset(img->verified->bytes, 0xFF, img->verified->len);
+  img->verifiedc = codeCount;
+  img->symbols.verified = true;
+}
+
+u64 gs_hash_image_bytes(u32 len, const u8 *bytes) {
+  // FNV-1a, seeded with the verifier version
+  u64 h = 0xcbf29ce484222325ULL ^ GS_VERIFIER_VERSION;
+  for (u32 i = 0; i < len; ++i) {
+    h ^= bytes[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+void gs_image_digest(Image *img, u8 out[GS_SHA256_LEN]) {
+  u8 version[4] = {
+    (u8) GS_VERIFIER_VERSION,
+    (u8) (GS_VERIFIER_VERSION >> 8),
+    (u8) (GS_VERIFIER_VERSION >> 16),
+    (u8) (GS_VERIFIER_VERSION >> 24),
+  };
+  Sha256 ctx;
+  gs_sha256_init(&ctx);
+  gs_sha256_update(&ctx, version, sizeof(version));
+  gs_sha256_update(&ctx, img->buf->bytes, img->buf->len);
+  gs_sha256_final(&ctx, out);
+}
+
+static u32 image_constc(Image *img) {
+  if (img->constants) return img->constants->len;
+  if (img->constantsBaked) return img->constantsBaked->len;
+  return 0;
+}
+
 Err *gs_verify_code(Image *img, CodeInfo *ci) {
   u32 maxStack = get32le(ci->maxStack);
   u32 maxLocals = get32le(ci->locals);
@@ -403,7 +578,7 @@ Err *gs_verify_code(Image *img, CodeInfo *ci) {
     case LDC: {
       EXPECT_INSNS(4);
       u32 idx = read_u32(&ip);
-      GS_FAIL_IF(!img->constants || idx >= img->constants->len, "Constant out of bounds", NULL);
+      GS_FAIL_IF(idx >= image_constc(img), "Constant out of bounds", NULL);
       PUSH(1);
       break;
     }
@@ -472,6 +647,49 @@ Err *gs_verify_code(Image *img, CodeInfo *ci) {
   GS_RET_OK;
 }
 
+// how many symbols ahead to prefetch symbol table buckets
+#define SYMBOL_PREFETCH_DISTANCE 8
+
+static Err *bake_symbols(Image *img) {
+  // hashes of an image that wasn't verified or trusted are only checked
+  // for symbols that aren't interned yet, which would have to be
+  // hashed by gs_intern anyway
+  Err *(*intern)(Utf8Str, u32, Symbol **) = img->symbols.verified ? gs_intern_verified : gs_intern_hashed;
+  SymbolInfo *entries = img->symbols.entries;
+  u32 len = img->symbols.len;
+  for (u32 i = 0; i < len && i < SYMBOL_PREFETCH_DISTANCE; ++i) {
+    gs_prefetch_symbol_bucket(get32le(entries[i].hash));
+  }
+  for (u32 i = 0; i < len; ++i) {
+    if (i + SYMBOL_PREFETCH_DISTANCE < len) {
+      gs_prefetch_symbol_bucket(get32le(entries[i + SYMBOL_PREFETCH_DISTANCE].hash));
+    }
+    u32 constIdx = get32le(entries[i].symbol);
+    struct ConstBytevec *bv = (anyptr) img->constants->values[constIdx];
+    Symbol *sym;
+    GS_TRY(
+      intern(
+        (Utf8Str) {
+          bv->data,
+          get32le(bv->len)
+        },
+        get32le(entries[i].hash),
+        &sym
+      )
+    );
+    GS_TRY(
+      gs_gc_write_barrier(
+        img->constantsBaked,
+        &img->constantsBaked->values[constIdx],
+        sym,
+        FieldGcTagged
+      )
+    );
+    img->constantsBaked->values[constIdx] = PTR2VAL_GC(sym);
+  }
+  GS_RET_OK;
+}
+
 Err *gs_bake_image(Image *img) {
   if (!img->constantsBaked) {
     anyptr constantsBaked;
@@ -479,12 +697,14 @@ Err *gs_bake_image(Image *img) {
     GS_TRY(gs_gc_write_barrier(img, &img->constantsBaked, constantsBaked, FieldGcRaw));
     img->constantsBaked = constantsBaked;
     memset(img->constantsBaked->values, 0, img->constants->len * sizeof(Val));
+    GS_TRY(bake_symbols(img));
     for (u32 i = 0; i < img->constants->len; ++i) {
+      if (img->constantsBaked->values[i] != 0) continue; // a symbol, already baked
       Val out;
       GS_TRY(
         bake_constant(
-          img->constantsBaked->values,
-          img->constants->values[i],
+          img,
+          i,
           &out
         )
       );
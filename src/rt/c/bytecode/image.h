@@ -2,6 +2,7 @@
 
 #include "../rt.h"
 #include "../gc/gc_type.h"
+#include "../util/sha256.h"
 
 // integers are encoded in little-endian byte order
 typedef struct u32le { u32 raw; } u32le;
@@ -86,11 +87,19 @@ typedef struct BindingInfo {
   ConstRef binding;
 } BindingInfo;
 
+// a symbol constant with its precomputed hash, the low 32 bits of
+// gs_hash_bytes of its name
+typedef struct SymbolInfo {
+  ConstRef symbol;
+  u32le hash;
+} SymbolInfo;
+
 enum Sections {
   SecConstants = 1,
   SecCodes = 2,
   SecBindings = 3,
   SecStart = 4,
+  SecSymbols = 5,
 };
 
 DEFINE_GC_TYPE(
@@ -111,12 +120,18 @@ DEFINE_GC_TYPE(
     u32 len;
     Val values[1];
   } /* Array */ *, constantsBaked,
+  // code point length of each string constant, as u32s indexed like
+  // the constants, counted when the strings are validated on indexing
+  GC(FIX, Raw), InlineBytes *, stringLengths,
 
   // code table
   GC(FIX, Raw), struct {
     u32 len;
     CodeInfo *values[1];
   } /* OpaqueArray */ *, codes,
+  // one bit per code, set once the code has passed verification
+  GC(FIX, Raw), InlineBytes *, verified,
+  NOGC(FIX), u32, verifiedc,
 
   // binding assoc list
   NOGC(FIX), struct {
@@ -124,6 +139,14 @@ DEFINE_GC_TYPE(
     BindingInfo *pairs;
   }, bindings,
 
+  // hashed symbol constants, sorted by hash, interned in one pass when baking
+  NOGC(FIX), struct {
+    u32 len;
+    SymbolInfo *entries;
+    // set once the hashes have been checked against the names
+    bool verified;
+  }, symbols,
+
   // start code block, called to run
   NOGC(FIX), struct {
     // C-side: 0 if absent, 1-indexed,
@@ -132,8 +155,40 @@ DEFINE_GC_TYPE(
   }, start
 );
 
+// codes are verified lazily, when they are first called, unless this
+// is 0
+#ifndef GS_LAZY_VERIFY
+#  define GS_LAZY_VERIFY 1
+#endif
+
+// bumped whenever the verifier gets stricter, so hashes of images
+// verified by an older runtime are no longer trusted
+#define GS_VERIFIER_VERSION 1
+
 Err *gs_verify_code(Image *img, CodeInfo *ci);
 Err *gs_index_image(u32 len, const u8 *buf, Image **ret);
+// create an image from encoded codes and constant values that are
+// already live, as in a running program, so there is nothing to bake
+Err *gs_live_image(u32 codec, InlineBytes **codes, u32 constc, Val *consts, Image **ret);
+
+static inline bool gs_code_verified(Image *img, u32 codeRef) {
+  return (img->verified->bytes[codeRef / 8] >> (codeRef % 8)) & 1;
+}
+// verify a single code of the image, if it hasn't been already
+Err *gs_verify_code_ref(Image *img, u32 codeRef);
+// check the symbol section's hashes, if they haven't been already
+Err *gs_verify_symbols(Image *img);
+// verify every code of the image, and its symbol hashes
+Err *gs_verify_image(Image *img);
+// mark every code and symbol hash of the image as verified, without checking them
+void gs_trust_image(Image *img);
+// SHA-256 digest of the image contents and verifier version, for
+// caching verification results
+void gs_image_digest(Image *img, u8 out[GS_SHA256_LEN]);
+// quick hash of an image that hasn't been indexed yet, to tell which
+// image a snapshot was taken of; it is not collision resistant, so
+// must not decide whether an image is trusted
+u64 gs_hash_image_bytes(u32 len, const u8 *bytes);
 Err *gs_bake_image(Image *img);
 
 void gs_stderr_dump_code(Image *img, CodeInfo *ci);
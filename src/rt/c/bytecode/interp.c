@@ -29,7 +29,6 @@
 
 struct ShadowStack gs_shadow_stack = { 0, NULL };
 
-static Err *gs_interp_closure_call(GS_CLOSURE_ARGS);
 
 Err *gs_interp_closure(Image *img, u32 codeRef, Val *args, u16 argv, InterpClosure **out) {
   InterpClosure *cls;
@@ -53,7 +52,7 @@ void gs_stderr_dump_closure(InterpClosure *closure) {
 }
 
 static Err *gs_interp(
-  InterpClosure *self, // must be verified
+  InterpClosure *self, // verified on first call
   u16 argc,
   Val *args,
   u16 retc,
@@ -62,6 +61,9 @@ static Err *gs_interp(
   GS_FAIL_IF(gs_shadow_stack.depth >= GS_STACK_MAX_DEPTH, "Stack overflow", NULL);
 
   GS_TRY(gs_bake_image(self->img));
+  if (!gs_code_verified(self->img, self->codeRef)) {
+    GS_TRY(gs_verify_code_ref(self->img, self->codeRef));
+  }
   CodeInfo *insns = self->img->codes->values[self->codeRef];
   Val stack[get32le(insns->maxStack)];
   Val locals[get32le(insns->locals)];
@@ -189,7 +191,7 @@ void gs_interp_dump_stack() {
   }
 }
 
-static Err *gs_interp_closure_call(GS_CLOSURE_ARGS) {
+Err *gs_interp_closure_call(GS_CLOSURE_ARGS) {
   InterpClosure *closureSelf = (InterpClosure *)self;
   Utf8Str name = closureSelf->assignedTo
     ? GS_DECAY_BYTES(closureSelf->assignedTo->name)
@@ -26,5 +26,6 @@ DEFINE_GC_TYPE(
 );
 
 Err *gs_interp_closure(Image *img, u32 codeRef, Val *args, u16 argc, InterpClosure **out);
+Err *gs_interp_closure_call(GS_CLOSURE_ARGS);
 
 void gs_interp_dump_stack();
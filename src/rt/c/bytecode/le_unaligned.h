@@ -2,22 +2,51 @@
 
 #include "../rt_prims.h"
 
+#include <string.h>
+
+#ifndef __BYTE_ORDER__
+#  error "unknown byte order"
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#  define GS_LE16(X) (X)
+#  define GS_LE32(X) (X)
+#  define GS_LE64(X) (X)
+#else
+#  define GS_LE16(X) __builtin_bswap16(X)
+#  define GS_LE32(X) __builtin_bswap32(X)
+#  define GS_LE64(X) __builtin_bswap64(X)
+#endif
+
+/**
+ * Unaligned little-endian loads and stores, which compile to single
+ * moves on targets that allow them.
+ */
+#define GS_LE_ACCESSORS(BITS)                                   \
+  static inline u##BITS gs_load_u##BITS##le(const u8 *src) {    \
+    u##BITS value;                                              \
+    memcpy(&value, src, sizeof(value));                         \
+    return GS_LE##BITS(value);                                  \
+  }                                                             \
+  static inline void gs_store_u##BITS##le(u8 *dst, u##BITS value) { \
+    value = GS_LE##BITS(value);                                 \
+    memcpy(dst, &value, sizeof(value));                         \
+  }
+
+GS_LE_ACCESSORS(16)
+GS_LE_ACCESSORS(32)
+GS_LE_ACCESSORS(64)
+
+#undef GS_LE_ACCESSORS
+
 static inline u16 read_u16(u8 **ip) {
-  u8 lo = *(*ip)++;
-  u8 hi = *(*ip)++;
-  return ((u16) hi << INSN_BITS) | (u16) lo;
+  u16 value = gs_load_u16le(*ip);
+  *ip += sizeof(value);
+  return value;
 }
 
 static inline u32 read_u32(u8 **ip) {
-  u8 ll = *(*ip)++;
-  u8 lh = *(*ip)++;
-  u8 hl = *(*ip)++;
-  u8 hh = *(*ip)++;
-  return
-    ((u32) hh << (3 * INSN_BITS)) |
-    ((u32) hl << (2 * INSN_BITS)) |
-    ((u32) lh << INSN_BITS) |
-    (u32) ll;
+  u32 value = gs_load_u32le(*ip);
+  *ip += sizeof(value);
+  return value;
 }
 
 #define U32_ALIGN 4
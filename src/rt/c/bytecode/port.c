@@ -0,0 +1,150 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "port.h"
+#include "../gc/gc.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define fd_read(FD, BUF, LEN) _read(FD, BUF, LEN)
+#define fd_write(FD, BUF, LEN) _write(FD, BUF, LEN)
+#define fd_close(FD) _close(FD)
+#define fd_isatty(FD) _isatty(FD)
+#define fd_open_input(PATH) _open(PATH, _O_RDONLY | _O_BINARY)
+#define fd_open_output(PATH) _open(PATH, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define fd_read(FD, BUF, LEN) read(FD, BUF, LEN)
+#define fd_write(FD, BUF, LEN) write(FD, BUF, LEN)
+#define fd_close(FD) close(FD)
+#define fd_isatty(FD) isatty(FD)
+#define fd_open_input(PATH) open(PATH, O_RDONLY)
+#define fd_open_output(PATH) open(PATH, O_WRONLY | O_CREAT | O_TRUNC, 0666)
+#endif
+
+Err *gs_port_from_fd(i32 fd, u32 flags, Port **out) {
+  Port *port;
+  gs_gc_force_next_large();
+  Err *err = gs_gc_alloc_array(PORT_TYPE, GS_PORT_BUFFER_SIZE, (anyptr *)&port);
+  if (err) {
+    if (!(flags & PORT_BORROWED)) fd_close(fd);
+    GS_TRY(err);
+  }
+  port->fd = fd;
+  port->flags = flags;
+  port->pos = 0;
+  port->end = 0;
+  *out = port;
+  GS_RET_OK;
+}
+
+Err *gs_port_std(i32 fd, Port **out) {
+  u32 flags = PORT_BORROWED;
+  switch (fd) {
+  case 0: flags |= PORT_INPUT; break;
+  case 1: flags |= PORT_OUTPUT | (fd_isatty(fd) ? PORT_LINE_BUFFERED : 0); break;
+  case 2: flags |= PORT_OUTPUT | PORT_UNBUFFERED; break;
+  default: GS_FAILWITH("Not a standard stream", NULL);
+  }
+  return gs_port_from_fd(fd, flags, out);
+}
+
+Err *gs_port_open(const char *path, bool output, Port **out) {
+  i32 fd = output ? fd_open_output(path) : fd_open_input(path);
+  GS_FAIL_IF(fd < 0, "Could not open file", NULL);
+  return gs_port_from_fd(fd, output ? PORT_OUTPUT : PORT_INPUT, out);
+}
+
+Err *gs_port_fill(Port *port) {
+  GS_FAIL_IF(!(port->flags & PORT_INPUT), "Not an input port", NULL);
+  GS_FAIL_IF(port->flags & PORT_CLOSED, "Port is closed", NULL);
+  if (port->pos != port->end || port->flags & PORT_EOF) GS_RET_OK;
+  while (true) {
+    int len = fd_read(port->fd, port->buf, port->cap);
+    if (len < 0 && errno == EINTR) continue;
+    GS_FAIL_IF(len < 0, "IO error occured", NULL);
+    port->pos = 0;
+    port->end = (u32) len;
+    if (!len) port->flags |= PORT_EOF;
+    GS_RET_OK;
+  }
+}
+
+static Err *write_fully(i32 fd, const u8 *bytes, u32 len) {
+  while (len) {
+    int written = fd_write(fd, bytes, len);
+    if (written < 0 && errno == EINTR) continue;
+    GS_FAIL_IF(written <= 0, "Error writing to file", NULL);
+    bytes += written;
+    len -= (u32) written;
+  }
+  GS_RET_OK;
+}
+
+Err *gs_port_flush(Port *port) {
+  GS_FAIL_IF(!(port->flags & PORT_OUTPUT), "Not an output port", NULL);
+  GS_FAIL_IF(port->flags & PORT_CLOSED, "Port is closed", NULL);
+  u32 len = port->end;
+  port->end = 0;
+  if (!len) GS_RET_OK;
+  // keep the order of anything printed through stdio, such as by dbg
+  if (port->flags & PORT_BORROWED) fflush(NULL);
+  return write_fully(port->fd, port->buf, len);
+}
+
+Err *gs_port_write(Port *port, Bytes bytes) {
+  GS_FAIL_IF(!(port->flags & PORT_OUTPUT), "Not an output port", NULL);
+  GS_FAIL_IF(port->flags & PORT_CLOSED, "Port is closed", NULL);
+  if (bytes.len > port->cap - port->end) {
+    GS_TRY(gs_port_flush(port));
+    // too large to be worth copying
+    if (bytes.len >= port->cap) {
+      if (port->flags & PORT_BORROWED) fflush(NULL);
+      return write_fully(port->fd, bytes.bytes, bytes.len);
+    }
+  }
+  if (bytes.len) memcpy(port->buf + port->end, bytes.bytes, bytes.len);
+  port->end += bytes.len;
+  if (port->flags & PORT_UNBUFFERED ||
+      (port->flags & PORT_LINE_BUFFERED && bytes.len && memchr(bytes.bytes, '\n', bytes.len))) {
+    GS_TRY(gs_port_flush(port));
+  }
+  GS_RET_OK;
+}
+
+Err *gs_port_close(Port *port) {
+  if (port->flags & PORT_CLOSED) GS_RET_OK;
+  Err *err = NULL;
+  if (port->flags & PORT_OUTPUT) err = gs_port_flush(port);
+  port->flags |= PORT_CLOSED;
+  if (!(port->flags & PORT_BORROWED)) {
+    GS_FAIL_IF(fd_close(port->fd) != 0 && !err, "Error closing file", NULL);
+  }
+  return err;
+}
+
+void gs_port_finalize(anyptr obj) {
+  // there is nowhere to report an error to
+  Err *err = gs_port_close(obj);
+  (void) err;
+}
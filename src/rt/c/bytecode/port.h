@@ -0,0 +1,75 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "primitives.h"
+
+/**
+ * Buffered ports over file descriptors.
+ *
+ * An input port's buffer holds the bytes from pos to end that have
+ * been read from its descriptor but not yet consumed; an output
+ * port's holds the bytes from 0 to end that have been written to the
+ * port but not yet to its descriptor.
+ */
+
+#define PORT_INPUT 1
+#define PORT_OUTPUT 2
+// the descriptor belongs to the process, such as stdout, and is not
+// closed with the port
+#define PORT_BORROWED 4
+// flush after every write, rather than only once the buffer is full
+#define PORT_UNBUFFERED 8
+// flush after every write containing a newline
+#define PORT_LINE_BUFFERED 16
+#define PORT_EOF 32
+#define PORT_CLOSED 64
+
+#define GS_PORT_BUFFER_SIZE 4096
+
+/**
+ * Allocate a port over fd, which it takes ownership of unless flags
+ * has PORT_BORROWED. fd is closed if allocation fails.
+ */
+Err *gs_port_from_fd(i32 fd, u32 flags, Port **out);
+
+/**
+ * Allocate a port over one of the standard streams: 0 for stdin, 1
+ * for stdout, which is line buffered if it is a terminal, or 2 for
+ * stderr, which is unbuffered.
+ */
+Err *gs_port_std(i32 fd, Port **out);
+
+/**
+ * Open the file at path for reading, or for writing if output is
+ * set, in which case it is created or truncated.
+ */
+Err *gs_port_open(const char *path, bool output, Port **out);
+
+/**
+ * Ensure an input port has at least one unconsumed byte buffered, or
+ * else set PORT_EOF.
+ */
+Err *gs_port_fill(Port *port);
+
+Err *gs_port_write(Port *port, Bytes bytes);
+Err *gs_port_flush(Port *port);
+// flush and close a port; closing a closed port does nothing
+Err *gs_port_close(Port *port);
+
+// the finalizer of PORT_TYPE
+void gs_port_finalize(anyptr obj);
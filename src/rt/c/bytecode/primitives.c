@@ -15,6 +15,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <stdarg.h>
 #include <string.h>
 
 #define DO_DECLARE_GC_METADATA 1
@@ -28,32 +29,63 @@
 #undef EMIT
 #undef IMPL
 
-void pr0(anyptr fp, Val val) {
+// where pr0 prints to, either a file or a string builder; the first
+// error printing into the builder is kept, and the rest ignored
+typedef struct Printer {
+  FILE *fp;
+  StringBuilder *sb;
+  Err *err;
+} Printer;
+
+static void pr_fmt(Printer *pr, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  if (!pr->sb) {
+    vfprintf(pr->fp, fmt, args);
+  } else if (!pr->err) {
+    va_list measure;
+    va_copy(measure, args);
+    int len = vsnprintf(NULL, 0, fmt, measure);
+    va_end(measure);
+    u8 *dst;
+    // with room for the terminator, which is then dropped
+    if (len >= 0 && !(pr->err = gs_string_builder_reserve(pr->sb, (u32) len + 1, &dst))) {
+      vsnprintf((char *) dst, (size_t) len + 1, fmt, args);
+      pr->sb->len--;
+    }
+  }
+  va_end(args);
+}
+
+static void pr1(Printer *pr, Val val) {
   if (VAL_IS_FIXNUM(val)) {
-    fprintf(fp, "%" PRIi64, VAL2SFIX(val));
+    pr_fmt(pr, "%" PRIi64, VAL2SFIX(val));
   } else if (VAL_IS_CONST(val)) {
     switch (val) {
     case VAL_NIL:
-      fprintf(fp, "nil");
+      pr_fmt(pr, "nil");
       break;
     case VAL_TRUE:
-      fprintf(fp, "true");
+      pr_fmt(pr, "true");
       break;
     case VAL_FALSE:
-      fprintf(fp, "false");
+      pr_fmt(pr, "false");
       break;
     default:
       if (VAL_IS_CHAR(val)) {
         u32 c = VAL2CHAR(val);
         switch (c) {
         case '\n':
-          fprintf(fp, "#\\newline");
+          pr_fmt(pr, "#\\newline");
           break;
         case ' ':
-          fprintf(fp, "#\\space");
+          pr_fmt(pr, "#\\space");
           break;
-        default:
-          fprintf(fp, "#\\%c", (char) c); // :)
+        default: {
+          u8 enc[4];
+          u32 n = gs_utf8_encode(c, enc);
+          pr_fmt(pr, "#\\%.*s", (int) n, enc);
+        }
         }
         break;
       } else {
@@ -65,59 +97,84 @@ void pr0(anyptr fp, Val val) {
     switch (ty = gs_gc_typeinfo(VAL2PTR(u8, val))) {
     case SYMBOL_TYPE: {
       Symbol *sym = VAL2PTR(Symbol, val);
-      fprintf(fp, "%.*s", sym->name->len, sym->name->bytes);
+      pr_fmt(pr, "%.*s", sym->name->len, sym->name->bytes);
       break;
     }
-    case STRING_TYPE: {
-      InlineUtf8Str *str = VAL2PTR(InlineUtf8Str, val);
-      fprintf(fp, "\"%.*s\"", str->len, str->bytes);
+    case STRING_TYPE:
+    case EXTERNAL_STRING_TYPE:
+    case STRING_SLICE_TYPE: {
+      Utf8Str str = string_bytes(val);
+      pr_fmt(pr, "\"%.*s\"", (int) str.len, str.bytes);
       break;
     }
-    case BYTESTRING_TYPE: {
-      InlineBytes *bstr = VAL2PTR(InlineBytes, val);
-      fprintf(fp, "#\"");
-      u8 *iter = bstr->bytes;
-      u8 *end = bstr->bytes + bstr->len;
+    case BYTESTRING_TYPE:
+    case MAPPED_BYTES_TYPE:
+    case BYTESTRING_SLICE_TYPE: {
+      Bytes bstr = bytestring_bytes(val);
+      pr_fmt(pr, "#\"");
+      u8 *iter = bstr.bytes;
+      u8 *end = bstr.bytes + bstr.len;
       for (; iter != end; ++iter) {
         if (isprint(*iter)) {
-          fprintf(fp, "%c", *iter);
+          pr_fmt(pr, "%c", *iter);
         } else {
-          fprintf(fp, "\\x%02" PRIx8, *iter);
+          pr_fmt(pr, "\\x%02" PRIx8, *iter);
         }
       }
-      fprintf(fp, "\"");
+      pr_fmt(pr, "\"");
       break;
     }
     case CONS_TYPE: {
       Cons *cons = VAL2PTR(Cons, val);
-      fprintf(fp, "(");
+      pr_fmt(pr, "(");
       while (true) {
-        pr0(fp, cons->car);
+        pr1(pr, cons->car);
         if (cons->cdr == VAL_NIL) break;
-        fprintf(fp, " ");
+        pr_fmt(pr, " ");
         cons = VAL2PTR(Cons, cons->cdr);
       }
-      fprintf(fp, ")");
+      pr_fmt(pr, ")");
+      break;
+    }
+    case ARRAY_TYPE: {
+      Array *vec = VAL2PTR(Array, val);
+      pr_fmt(pr, "#(");
+      for (u32 i = 0; i < vec->len; ++i) {
+        if (i) pr_fmt(pr, " ");
+        pr1(pr, vec->data[i]);
+      }
+      pr_fmt(pr, ")");
       break;
     }
     case BOX_TYPE: {
       Box *box = VAL2PTR(Box, val);
-      fprintf(fp, "(box ");
-      pr0(fp, box->value);
-      fprintf(fp, ")");
+      pr_fmt(pr, "(box ");
+      pr1(pr, box->value);
+      pr_fmt(pr, ")");
       break;
     }
     default: {
       TypeInfo *ti = &gs_global_gc->types[ty];
-      fprintf(fp, "<%.*s>", ti->name.len, ti->name.bytes);
+      pr_fmt(pr, "<%.*s>", ti->name.len, ti->name.bytes);
     }
     }
   } else {
   unprintable:
-    fprintf(fp, "<unprintable>");
+    pr_fmt(pr, "<unprintable>");
   }
 }
 
+void pr0(anyptr fp, Val val) {
+  Printer pr = { fp, NULL, NULL };
+  pr1(&pr, val);
+}
+
+Err *pr0_to_builder(StringBuilder *sb, Val val) {
+  Printer pr = { NULL, sb, NULL };
+  pr1(&pr, val);
+  return pr.err;
+}
+
 Err *gs_alloc_list(Val *arr, u16 len, Val *out) {
   Val *iter = arr + len - 1;
   Val *end = arr - 1;
@@ -133,6 +190,30 @@ Err *gs_alloc_list(Val *arr, u16 len, Val *out) {
   GS_RET_OK;
 }
 
+const ClosureFn gs_primitive_fns[] = {
+#define IMPL(NAME, C_NAME, ...) C_NAME##_impl,
+#define EMIT 0
+#include "primitives_impl.c"
+#undef EMIT
+#undef IMPL
+};
+const u32 gs_primitive_fnc = sizeof(gs_primitive_fns) / sizeof(ClosureFn);
+
+Err *gs_set_symbol_value(Symbol *sym, Val value) {
+  if (VAL_IS_GC_PTR(value)) {
+    GS_TRY(gs_gc_write_barrier(sym, &sym->value, VAL2PTR(u8, value), FieldGcTagged));
+    if (is_type(value, INTERP_CLOSURE_TYPE)) {
+      InterpClosure *cls = VAL2PTR(InterpClosure, value);
+      if (cls->assignedTo == NULL) {
+        GS_TRY(gs_gc_write_barrier(cls, &cls->assignedTo, sym, FieldGcRaw));
+        cls->assignedTo = sym;
+      }
+    }
+  }
+  sym->value = value;
+  GS_RET_OK;
+}
+
 Err *gs_add_primitives() {
   GS_FAIL_IF(!gs_global_gc, "No garbage collector", NULL);
 
@@ -160,11 +241,21 @@ Err *gs_add_primitives() {
 
   ADD0("eof",, VAL_EOF);
 
+  Port *port;
+  ADD0("stdin", GS_TRY(gs_port_std(0, &port)), PTR2VAL_GC(port));
+  ADD0("stdout", GS_TRY(gs_port_std(1, &port)), PTR2VAL_GC(port));
+  ADD0("stderr", GS_TRY(gs_port_std(2, &port)), PTR2VAL_GC(port));
+
 #undef ADD
 
   GS_RET_OK;
 }
 
+static void unmap_bytes(anyptr obj) {
+  MappedBytes *bs = obj;
+  if (bs->bytes) gs_unmap_file(bs->bytes, bs->len);
+}
+
 Err *gs_add_primitive_types() {
   GS_FAIL_IF(!gs_global_gc, "No garbage collector", NULL);
 
@@ -190,6 +281,19 @@ Err *gs_add_primitive_types() {
   ADD(SymTableBucket, SYM_TABLE_BUCKET);
   ADD(Image, IMAGE);
   ADD(Box, BOX);
+  ADD(ExternalUtf8Str, EXTERNAL_STRING);
+  MappedBytes_INFO.finalize = unmap_bytes;
+  ADD(MappedBytes, MAPPED_BYTES);
+  Port_INFO.finalize = gs_port_finalize;
+  ADD(Port, PORT);
+  ADD(ByteVector, BYTE_VECTOR);
+  ADD(HashMapNode, HASH_MAP_NODE);
+  ADD(HashMap, HASH_MAP);
+  ADD(HashTable, HASH_TABLE);
+  ADD(RecordType, RECORD_TYPE);
+  ADD(StringSlice, STRING_SLICE);
+  ADD(BytesSlice, BYTESTRING_SLICE);
+  ADD(StringBuilder, STRING_BUILDER);
 
 #undef ADD
 
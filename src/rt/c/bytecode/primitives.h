@@ -33,6 +33,112 @@ DEFINE_GC_TYPE(
   NOGC(FIX), u32, len,
   NOGC(RSZ(len)), ValArray, data
 );
+// a string whose bytes are borrowed from a buffer that never moves,
+// such as the buffer of an image, so it can be created without copying
+DEFINE_GC_TYPE(
+  ExternalUtf8Str,
+  GC(FIX, Raw), InlineBytes *, owner,
+  NOGC(FIX), u32, len,
+  NOGC(FIX), u32, cpLen,
+  NOGC(FIX), const u8 *, bytes,
+  GC(FIX, Raw), InlineBytes *, index
+);
+
+// a read-only bytestring whose bytes are mapped from a file; it is
+// always allocated large, and unmaps them when it is freed
+DEFINE_GC_TYPE(
+  MappedBytes,
+  NOGC(FIX), u32, len,
+  NOGC(FIX), const u8 *, bytes
+);
+
+// views of len bytes at offset into the contents of owner, which is
+// a string or bytestring that is not itself a slice; they share their
+// owner's bytes, keeping it alive, until they are compacted. String
+// slices also start cpOffset code points into their owner
+DEFINE_GC_TYPE(
+  StringSlice,
+  GC(FIX, Raw), anyptr, owner,
+  NOGC(FIX), u32, offset,
+  NOGC(FIX), u32, len,
+  NOGC(FIX), u32, cpOffset,
+  NOGC(FIX), u32, cpLen
+);
+DEFINE_GC_TYPE(
+  BytesSlice,
+  GC(FIX, Raw), anyptr, owner,
+  NOGC(FIX), u32, offset,
+  NOGC(FIX), u32, len
+);
+
+// a buffered port reading from or writing to a file descriptor; like
+// MappedBytes it is always allocated large, so its buffer never
+// moves, and it flushes and closes its descriptor when it is freed
+DEFINE_GC_TYPE(
+  Port,
+  NOGC(FIX), i32, fd,
+  NOGC(FIX), u32, flags,
+  NOGC(FIX), u32, pos,
+  NOGC(FIX), u32, end,
+  NOGC(FIX), u32, cap,
+  NOGC(RSZ(cap)), u8s, buf
+);
+
+// a growable bytestring; buf is replaced by one twice the size when
+// it runs out of space, and len bytes of it are in use
+DEFINE_GC_TYPE(
+  ByteVector,
+  NOGC(FIX), u32, len,
+  GC(FIX, Raw), InlineBytes *, buf
+);
+
+// a growable string, laid out like a ByteVector so they can share
+// code, but whose buffer is a string
+DEFINE_GC_TYPE(
+  StringBuilder,
+  NOGC(FIX), u32, len,
+  GC(FIX, Raw), InlineUtf8Str *, buf
+);
+
+// a node of a persistent hash array mapped trie; slots holds a key
+// and value for each bit of datamap, then a child node for each bit
+// of nodemap, both in bit order. Below the last level of the hash
+// both maps are empty, and slots holds keys and values that collide
+DEFINE_GC_TYPE(
+  HashMapNode,
+  NOGC(FIX), u32, datamap,
+  NOGC(FIX), u32, nodemap,
+  NOGC(FIX), u32, len,
+  GC(RSZ(len), Tagged), ValArray, slots
+);
+// a persistent map keyed by eq?; nil is also an empty map
+DEFINE_GC_TYPE(
+  HashMap,
+  NOGC(FIX), u32, count,
+  GC(FIX, Raw), HashMapNode *, root
+);
+
+// a mutable hash table with open addressing; slots holds a key then
+// a value for each of its buckets. Tables that hash some key by its
+// address rehash when epoch falls behind gs_gc_epoch()
+DEFINE_GC_TYPE(
+  HashTable,
+  NOGC(FIX), u32, count,
+  NOGC(FIX), u32, used,
+  NOGC(FIX), u32, flags,
+  NOGC(FIX), u32, epoch,
+  GC(FIX, Raw), Array *, slots
+);
+
+// a record type defined at runtime; ty is the GC type of its records,
+// which hold a RecordType pointer and then fieldc tagged slots
+DEFINE_GC_TYPE(
+  RecordType,
+  NOGC(FIX), u32, ty,
+  NOGC(FIX), u32, fieldc,
+  GC(FIX, Tagged), Val, name,
+  GC(FIX, Tagged), Val, fields
+);
 
 #define SYMBOL_TYPE 0
 #define STRING_TYPE 1
@@ -48,9 +154,29 @@ DEFINE_GC_TYPE(
 #define SYM_TABLE_BUCKET_TYPE 11
 #define IMAGE_TYPE 12
 #define BOX_TYPE 13
+#define EXTERNAL_STRING_TYPE 14
+#define MAPPED_BYTES_TYPE 15
+#define PORT_TYPE 16
+#define BYTE_VECTOR_TYPE 17
+#define HASH_MAP_NODE_TYPE 18
+#define HASH_MAP_TYPE 19
+#define HASH_TABLE_TYPE 20
+#define RECORD_TYPE_TYPE 21
+#define STRING_SLICE_TYPE 22
+#define BYTESTRING_SLICE_TYPE 23
+#define STRING_BUILDER_TYPE 24
 
 void pr0(anyptr fp, Val val);
+// print a value into a string builder, as pr0 would into a file
+Err *pr0_to_builder(StringBuilder *sb, Val val);
 Err *gs_alloc_list(Val *arr, u16 len, Val *out);
+// set the value of a symbol, naming the value after it if it is an
+// unnamed interpreted closure
+Err *gs_set_symbol_value(Symbol *sym, Val value);
+
+// the native functions of every primitive, in registration order
+extern const ClosureFn gs_primitive_fns[];
+extern const u32 gs_primitive_fnc;
 
 Err *gs_add_primitive_types(void);
 Err *gs_add_primitives(void);
@@ -53,18 +53,7 @@ IMPL("symbol-set-value!", symbol_set_value)
   GS_FAIL_IF(!is_symbol0(args[0]), "Not a symbol", NULL);
   Symbol *sym = VAL2PTR(Symbol, args[0]);
   LOG_TRACE("Setting symbol: %.*s", sym->name->len, sym->name->bytes);
-  Val toWrite = args[1];
-  if (VAL_IS_GC_PTR(toWrite)) {
-    GS_TRY(gs_gc_write_barrier(sym, &sym->value, VAL2PTR(u8, toWrite), FieldGcTagged));
-    if (is_type(toWrite, INTERP_CLOSURE_TYPE)) {
-      InterpClosure *twCls = VAL2PTR(InterpClosure, toWrite);
-      if (twCls->assignedTo == NULL) {
-        GS_TRY(gs_gc_write_barrier(twCls, &twCls->assignedTo, sym, FieldGcRaw));
-        twCls->assignedTo = sym;
-      }
-    }
-  }
-  sym->value = toWrite;
+  GS_TRY(gs_set_symbol_value(sym, args[1]));
   rets[0] = args[0];
   GS_RET_OK;
 }
@@ -85,11 +74,11 @@ IMPL("string->bytestring", string_to_bytestring)
 #if EMIT
 {
   GS_CHECK_ARITY(1, 1);
-  GS_FAIL_IF(!is_type(args[0], STRING_TYPE), "Not a string", NULL);
-  InlineUtf8Str *str = VAL2PTR(InlineUtf8Str, args[0]);
+  GS_FAIL_IF(!is_string0(args[0]), "Not a string", NULL);
+  Utf8Str str = string_bytes(args[0]);
   InlineBytes *bs;
-  GS_TRY(gs_gc_alloc_array(BYTESTRING_TYPE, str->len, (anyptr *)&bs));
-  memcpy(bs->bytes, str->bytes, str->len);
+  GS_TRY(gs_gc_alloc_array(BYTESTRING_TYPE, str.len, (anyptr *)&bs));
+  memcpy(bs->bytes, str.bytes, str.len);
   rets[0] = PTR2VAL_GC(bs);
   GS_RET_OK;
 }
@@ -150,10 +139,8 @@ IMPL("program-args", program_args)
   const char **it = end + gs_argc - 1;
   Val ret = VAL_NIL;
   for (; it != end; --it) {
-    u32 len = strlen(*it);
     InlineUtf8Str *argStr;
-    GS_TRY(gs_gc_alloc_array(STRING_TYPE, len, (anyptr *)&argStr));
-    memcpy(argStr->bytes, *it, len);
+    GS_TRY(gs_string_new(GS_UTF8_CSTR_DYN(*it), &argStr));
     Val args[] = { PTR2VAL_GC(argStr), ret };
     GS_TRY(gs_call(&cons, 2, args, 1, &ret));
   }
@@ -182,7 +169,7 @@ IMPL("string?", is_string)
 #if EMIT
 {
   GS_CHECK_ARITY(1, 1);
-  rets[0] = BOOL2VAL(is_type(args[0], STRING_TYPE));
+  rets[0] = BOOL2VAL(is_string0(args[0]));
   GS_RET_OK;
 }
 #endif
@@ -190,7 +177,7 @@ IMPL("bytestring?", is_bytestring)
 #if EMIT
 {
   GS_CHECK_ARITY(1, 1);
-  rets[0] = BOOL2VAL(is_type(args[0], BYTESTRING_TYPE));
+  rets[0] = BOOL2VAL(is_bytestring0(args[0]));
   GS_RET_OK;
 }
 #endif
@@ -294,6 +281,445 @@ IMPL("box-set!", box_set)
 }
 #endif
 
+// lists, natively for the list functions in gstd.gs that are hot
+// enough to matter, without an interpreted frame per element
+
+#if EMIT
+// the length of a proper list
+static Err *list_length(Val list, u32 *out) {
+  u32 len = 0;
+  Val iter = list;
+  for (; is_type(iter, CONS_TYPE); iter = VAL2PTR(Cons, iter)->cdr) ++len;
+  FAIL_IF_LIST(iter != VAL_NIL, "Not a list", list);
+  *out = len;
+  GS_RET_OK;
+}
+
+static Err *alloc_cons(Val car, Val cdr, Cons **out) {
+  GS_TRY(gs_gc_alloc(CONS_TYPE, (anyptr *)out));
+  (*out)->car = car;
+  (*out)->cdr = cdr;
+  GS_RET_OK;
+}
+
+// builds a list front to back
+typedef struct ListBuilder {
+  Val head;
+  Cons *last;
+} ListBuilder;
+
+static Err *list_push(ListBuilder *lb, Val x) {
+  Cons *pair;
+  GS_TRY(alloc_cons(x, VAL_NIL, &pair));
+  if (lb->last) {
+    lb->last->cdr = PTR2VAL_GC(pair);
+  } else {
+    lb->head = PTR2VAL_GC(pair);
+  }
+  lb->last = pair;
+  GS_RET_OK;
+}
+
+static Err *call_fn(Val f, u16 argc, Val *args, Val *out) {
+  return gs_call(&PTR_REF(Closure, VAL2PTR(u8, f)), argc, args, 1, out);
+}
+#endif
+
+IMPL("count", count)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  u32 len;
+  GS_TRY(list_length(args[0], &len));
+  rets[0] = FIX2VAL(len);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("reverse", reverse)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  u32 len;
+  GS_TRY(list_length(args[0], &len));
+  Val ret = VAL_NIL;
+  for (Val iter = args[0]; iter != VAL_NIL; iter = VAL2PTR(Cons, iter)->cdr) {
+    Cons *pair;
+    GS_TRY(alloc_cons(VAL2PTR(Cons, iter)->car, ret, &pair));
+    ret = PTR2VAL_GC(pair);
+  }
+  rets[0] = ret;
+  GS_RET_OK;
+}
+#endif
+
+// the arguments consed onto the last one
+IMPL("list*", list_star)
+#if EMIT
+{
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  if (argc == 0) {
+    rets[0] = VAL_NIL;
+    GS_RET_OK;
+  }
+  Val ret = args[argc - 1];
+  for (u16 i = argc - 1; i > 0; --i) {
+    Cons *pair;
+    GS_TRY(alloc_cons(args[i - 1], ret, &pair));
+    ret = PTR2VAL_GC(pair);
+  }
+  rets[0] = ret;
+  GS_RET_OK;
+}
+#endif
+
+// (i x) for each x of a list, counting from 0
+IMPL("enumerate", enumerate)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  u32 len;
+  GS_TRY(list_length(args[0], &len));
+  ListBuilder lb = { VAL_NIL, NULL };
+  u32 i = 0;
+  for (Val iter = args[0]; iter != VAL_NIL; iter = VAL2PTR(Cons, iter)->cdr, ++i) {
+    Cons *tl, *entry;
+    GS_TRY(alloc_cons(VAL2PTR(Cons, iter)->car, VAL_NIL, &tl));
+    GS_TRY(alloc_cons(FIX2VAL(i), PTR2VAL_GC(tl), &entry));
+    GS_TRY(list_push(&lb, PTR2VAL_GC(entry)));
+  }
+  rets[0] = lb.head;
+  GS_RET_OK;
+}
+#endif
+
+// lists appended, sharing the last that isn't empty, as concat
+IMPL("list-concat", list_concat)
+#if EMIT
+{
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  u16 lastIdx = argc;
+  while (lastIdx > 0 && args[lastIdx - 1] == VAL_NIL) --lastIdx;
+  if (lastIdx == 0) {
+    rets[0] = VAL_NIL;
+    GS_RET_OK;
+  }
+  ListBuilder lb = { VAL_NIL, NULL };
+  for (u16 i = 0; i < lastIdx - 1; ++i) {
+    u32 len;
+    GS_TRY(list_length(args[i], &len));
+    for (Val iter = args[i]; iter != VAL_NIL; iter = VAL2PTR(Cons, iter)->cdr) {
+      GS_TRY(list_push(&lb, VAL2PTR(Cons, iter)->car));
+    }
+  }
+  if (lb.last) {
+    lb.last->cdr = args[lastIdx - 1];
+  } else {
+    lb.head = args[lastIdx - 1];
+  }
+  rets[0] = lb.head;
+  GS_RET_OK;
+}
+#endif
+
+// f of the first elements of each list, then the second, and so on
+// until the shortest runs out, as map
+IMPL("list-map", list_map)
+#if EMIT
+{
+  GS_FAIL_IF(argc < 2, "Not enough arguments", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  Val f = args[0];
+  FAIL_IF_LIST(!is_callable(f), "Not a function", f);
+  u16 listc = argc - 1;
+  for (u16 i = 0; i < listc; ++i) {
+    FAIL_IF_LIST(!is_list0(args[i + 1]), "Not a list", args[i + 1]);
+  }
+  ListBuilder lb = { VAL_NIL, NULL };
+  if (listc == 1) {
+    for (Val iter = args[1]; is_type(iter, CONS_TYPE); iter = VAL2PTR(Cons, iter)->cdr) {
+      Val elt = VAL2PTR(Cons, iter)->car, x;
+      GS_TRY(call_fn(f, 1, &elt, &x));
+      GS_TRY(list_push(&lb, x));
+    }
+    rets[0] = lb.head;
+    GS_RET_OK;
+  }
+
+  // the remaining lists, then the arguments to f
+  Val *buf = gs_alloc(GS_ALLOC_META(Val, 2 * listc));
+  GS_FAIL_IF(!buf, "Allocation failed", NULL);
+  Val *iters = buf, *fargs = buf + listc;
+  memcpy(iters, args + 1, listc * sizeof(Val));
+  Err *err = NULL;
+  while (true) {
+    for (u16 i = 0; i < listc; ++i) {
+      if (!is_type(iters[i], CONS_TYPE)) goto done;
+      fargs[i] = VAL2PTR(Cons, iters[i])->car;
+      iters[i] = VAL2PTR(Cons, iters[i])->cdr;
+    }
+    Val x;
+    if ((err = call_fn(f, listc, fargs, &x))) break;
+    if ((err = list_push(&lb, x))) break;
+  }
+ done:
+  gs_free(buf, GS_ALLOC_META(Val, 2 * listc));
+  rets[0] = lb.head;
+  return err;
+}
+#endif
+
+IMPL("list-foldl", list_foldl)
+#if EMIT
+{
+  GS_CHECK_ARITY(3, 1);
+  Val f = args[0];
+  FAIL_IF_LIST(!is_callable(f), "Not a function", f);
+  u32 len;
+  GS_TRY(list_length(args[2], &len));
+  Val acc = args[1];
+  for (Val iter = args[2]; iter != VAL_NIL; iter = VAL2PTR(Cons, iter)->cdr) {
+    Val fargs[] = { acc, VAL2PTR(Cons, iter)->car };
+    GS_TRY(call_fn(f, 2, fargs, &acc));
+  }
+  rets[0] = acc;
+  GS_RET_OK;
+}
+#endif
+
+IMPL("list-foldr", list_foldr)
+#if EMIT
+{
+  GS_CHECK_ARITY(3, 1);
+  Val f = args[0];
+  FAIL_IF_LIST(!is_callable(f), "Not a function", f);
+  u32 len;
+  GS_TRY(list_length(args[2], &len));
+  Val acc = args[1];
+  if (len == 0) {
+    rets[0] = acc;
+    GS_RET_OK;
+  }
+  Val *elts = gs_alloc(GS_ALLOC_META(Val, len));
+  GS_FAIL_IF(!elts, "Allocation failed", NULL);
+  Val iter = args[2];
+  for (u32 i = 0; i < len; ++i, iter = VAL2PTR(Cons, iter)->cdr) {
+    elts[i] = VAL2PTR(Cons, iter)->car;
+  }
+  Err *err = NULL;
+  for (u32 i = len; i > 0 && !err; --i) {
+    Val fargs[] = { elts[i - 1], acc };
+    err = call_fn(f, 2, fargs, &acc);
+  }
+  gs_free(elts, GS_ALLOC_META(Val, len));
+  rets[0] = acc;
+  return err;
+}
+#endif
+
+// the first truthy result of f on an element, or false
+IMPL("list-some", list_some)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  Val f = args[0];
+  FAIL_IF_LIST(!is_callable(f), "Not a function", f);
+  FAIL_IF_LIST(!is_list0(args[1]), "Not a list", args[1]);
+  for (Val iter = args[1]; is_type(iter, CONS_TYPE); iter = VAL2PTR(Cons, iter)->cdr) {
+    Val elt = VAL2PTR(Cons, iter)->car, v;
+    GS_TRY(call_fn(f, 1, &elt, &v));
+    if (VAL_TRUTHY(v)) {
+      rets[0] = v;
+      GS_RET_OK;
+    }
+  }
+  rets[0] = VAL_FALSE;
+  GS_RET_OK;
+}
+#endif
+
+// whether f is truthy on every element
+IMPL("list-all", list_all)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  Val f = args[0];
+  FAIL_IF_LIST(!is_callable(f), "Not a function", f);
+  FAIL_IF_LIST(!is_list0(args[1]), "Not a list", args[1]);
+  for (Val iter = args[1]; is_type(iter, CONS_TYPE); iter = VAL2PTR(Cons, iter)->cdr) {
+    Val elt = VAL2PTR(Cons, iter)->car, v;
+    GS_TRY(call_fn(f, 1, &elt, &v));
+    if (VAL_FALSY(v)) {
+      rets[0] = VAL_FALSE;
+      GS_RET_OK;
+    }
+  }
+  rets[0] = VAL_TRUE;
+  GS_RET_OK;
+}
+#endif
+
+// vectors, fixed-length arrays of values
+
+IMPL("make-vector", make_vector)
+#if EMIT
+{
+  GS_FAIL_IF(argc != 1 && argc != 2, "bad argument arity, expected: 1 or 2", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(args[0]), "Not a number", args[0]);
+  FAIL_IF_LIST(VAL2SFIX(args[0]) < 0 || VAL2UFIX(args[0]) > UINT32_MAX, "Length out of range", args[0]);
+  u32 len = (u32) VAL2UFIX(args[0]);
+  Val fill = argc == 2 ? args[1] : VAL_NIL;
+  Array *vec;
+  GS_TRY(gs_gc_alloc_array(ARRAY_TYPE, len, (anyptr *)&vec));
+  for (u32 i = 0; i < len; ++i) vec->data[i] = fill;
+  rets[0] = PTR2VAL_GC(vec);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("vector", vector)
+#if EMIT
+{
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  Array *vec;
+  GS_TRY(gs_gc_alloc_array(ARRAY_TYPE, argc, (anyptr *)&vec));
+  memcpy(vec->data, args, argc * sizeof(Val));
+  rets[0] = PTR2VAL_GC(vec);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("vector?", is_vector)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  rets[0] = BOOL2VAL(is_type(args[0], ARRAY_TYPE));
+  GS_RET_OK;
+}
+#endif
+
+IMPL("vector-length", vector_length)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], ARRAY_TYPE), "Not a vector", args[0]);
+  rets[0] = FIX2VAL(VAL2PTR(Array, args[0])->len);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("vector-ref", vector_ref)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  Val vec = args[0];
+  Val idx = args[1];
+  FAIL_IF_LIST(!is_type(vec, ARRAY_TYPE), "Not a vector", vec, idx);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(idx), "Not a number", vec, idx);
+  Array *vecP = VAL2PTR(Array, vec);
+  FAIL_IF_LIST(VAL2UFIX(idx) >= vecP->len, "Index out of bounds", vec, idx);
+  rets[0] = vecP->data[VAL2UFIX(idx)];
+  GS_RET_OK;
+}
+#endif
+
+IMPL("vector-set!", vector_set)
+#if EMIT
+{
+  GS_CHECK_ARITY(3, 1);
+  Val vec = args[0];
+  Val idx = args[1];
+  Val toWrite = args[2];
+  FAIL_IF_LIST(!is_type(vec, ARRAY_TYPE), "Not a vector", vec, idx);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(idx), "Not a number", vec, idx);
+  Array *vecP = VAL2PTR(Array, vec);
+  FAIL_IF_LIST(VAL2UFIX(idx) >= vecP->len, "Index out of bounds", vec, idx);
+  Val *target = &vecP->data[VAL2UFIX(idx)];
+  if (VAL_IS_GC_PTR(toWrite)) {
+    GS_TRY(gs_gc_write_barrier(vecP, target, VAL2PTR(u8, toWrite), FieldGcTagged));
+  }
+  rets[0] = *target = toWrite;
+  GS_RET_OK;
+}
+#endif
+
+IMPL("vector->list", vector_to_list)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], ARRAY_TYPE), "Not a vector", args[0]);
+  Array *vec = VAL2PTR(Array, args[0]);
+  Val ret = VAL_NIL;
+  for (u32 i = vec->len; i > 0; --i) {
+    Cons *pair;
+    GS_TRY(gs_gc_alloc(CONS_TYPE, (anyptr *)&pair));
+    pair->car = vec->data[i - 1];
+    pair->cdr = ret;
+    ret = PTR2VAL_GC(pair);
+  }
+  rets[0] = ret;
+  GS_RET_OK;
+}
+#endif
+
+IMPL("list->vector", list_to_vector)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  u32 len = 0;
+  Val iter = args[0];
+  for (; is_type(iter, CONS_TYPE); iter = VAL2PTR(Cons, iter)->cdr) ++len;
+  FAIL_IF_LIST(iter != VAL_NIL, "Not a list", args[0]);
+  Array *vec;
+  GS_TRY(gs_gc_alloc_array(ARRAY_TYPE, len, (anyptr *)&vec));
+  iter = args[0];
+  for (u32 i = 0; i < len; ++i, iter = VAL2PTR(Cons, iter)->cdr) {
+    vec->data[i] = VAL2PTR(Cons, iter)->car;
+  }
+  rets[0] = PTR2VAL_GC(vec);
+  GS_RET_OK;
+}
+#endif
+
+// copy src[src-start..src-end] to dst at dst-start, as in Racket
+IMPL("vector-copy!", vector_copy)
+#if EMIT
+{
+  GS_FAIL_IF(argc < 3 || argc > 5, "bad argument arity, expected: 3 to 5", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  Val dst = args[0];
+  Val src = args[2];
+  FAIL_IF_LIST(!is_type(dst, ARRAY_TYPE), "Not a vector", dst);
+  FAIL_IF_LIST(!is_type(src, ARRAY_TYPE), "Not a vector", src);
+  for (u32 i = 1; i < argc; ++i) {
+    FAIL_IF_LIST(i != 2 && !VAL_IS_FIXNUM(args[i]), "Not a number", args[i]);
+  }
+  Array *dstP = VAL2PTR(Array, dst);
+  Array *srcP = VAL2PTR(Array, src);
+  u64 dstStart = VAL2UFIX(args[1]);
+  u64 srcStart = argc > 3 ? VAL2UFIX(args[3]) : 0;
+  u64 srcEnd = argc > 4 ? VAL2UFIX(args[4]) : srcP->len;
+  FAIL_IF_LIST(srcStart > srcEnd || srcEnd > srcP->len, "Source region out of range", src, FIX2VAL(srcStart), FIX2VAL(srcEnd));
+  u64 len = srcEnd - srcStart;
+  FAIL_IF_LIST(dstStart + len > dstP->len, "Destination region out of range", dst, args[1], FIX2VAL(len));
+  memmove(dstP->data + dstStart, srcP->data + srcStart, len * sizeof(Val));
+  for (u64 i = dstStart; i < dstStart + len; ++i) {
+    if (VAL_IS_GC_PTR(dstP->data[i])) {
+      GS_TRY(gs_gc_write_barrier(dstP, &dstP->data[i], VAL2PTR(u8, dstP->data[i]), FieldGcTagged));
+    }
+  }
+  rets[0] = VAL_NIL;
+  GS_RET_OK;
+}
+#endif
+
 IMPL("new-bytestring", new_bytestring)
 #if EMIT
 {
@@ -309,32 +735,32 @@ IMPL("new-bytestring", new_bytestring)
 }
 #endif
 
-#define STRING_LENGTH_REF(LOWER_NAME, UPPER_NAME, TYPE_NAME, WRAP)  \
-  IMPL(#LOWER_NAME "-length", LOWER_NAME##_length)                  \
-  EMIT_STRING_LENGTH(LOWER_NAME, UPPER_NAME, TYPE_NAME)             \
-  IMPL(#LOWER_NAME "-ref", LOWER_NAME##_ref)                        \
-  EMIT_STRING_REF(LOWER_NAME, UPPER_NAME, TYPE_NAME, WRAP)
+#define STRING_LENGTH_REF(LOWER_NAME, CHECK, DECAY, WRAP)  \
+  IMPL(#LOWER_NAME "-length", LOWER_NAME##_length)        \
+  EMIT_STRING_LENGTH(LOWER_NAME, CHECK, DECAY)            \
+  IMPL(#LOWER_NAME "-ref", LOWER_NAME##_ref)              \
+  EMIT_STRING_REF(LOWER_NAME, CHECK, DECAY, WRAP)
 
 #if EMIT
-#  define EMIT_STRING_LENGTH(LOWER_NAME, UPPER_NAME, TYPE_NAME)         \
+#  define EMIT_STRING_LENGTH(LOWER_NAME, CHECK, DECAY)                  \
   {                                                                     \
     GS_CHECK_ARITY(1, 1);                                               \
     Val it = args[0];                                                   \
-    GS_FAIL_IF(!is_type(it, UPPER_NAME##_TYPE), "Not a " #LOWER_NAME, NULL); \
-    rets[0] = FIX2VAL(VAL2PTR(TYPE_NAME, it)->len);                     \
+    GS_FAIL_IF(!CHECK(it), "Not a " #LOWER_NAME, NULL);                 \
+    rets[0] = FIX2VAL(DECAY(it).len);                                   \
     GS_RET_OK;                                                          \
   }
-#  define EMIT_STRING_REF(LOWER_NAME, UPPER_NAME, TYPE_NAME, WRAP)      \
+#  define EMIT_STRING_REF(LOWER_NAME, CHECK, DECAY, WRAP)               \
   {                                                                     \
     GS_CHECK_ARITY(2, 1);                                               \
     Val it = args[0];                                                   \
     Val idx = args[1];                                                  \
-    GS_FAIL_IF(!is_type(it, UPPER_NAME##_TYPE), "Not a " #LOWER_NAME, NULL); \
+    GS_FAIL_IF(!CHECK(it), "Not a " #LOWER_NAME, NULL);                 \
     GS_FAIL_IF(!VAL_IS_FIXNUM(idx), "Not a number", NULL);              \
-    TYPE_NAME *itV = VAL2PTR(TYPE_NAME, it);                            \
+    Bytes itV = DECAY(it);                                              \
     u64 idxV = VAL2UFIX(idx);                                           \
-    GS_FAIL_IF(idxV >= itV->len, "Index out of bounds", NULL);          \
-    u8 byte = itV->bytes[idxV];                                         \
+    GS_FAIL_IF(idxV >= itV.len, "Index out of bounds", NULL);           \
+    u8 byte = itV.bytes[idxV];                                          \
     rets[0] = WRAP(byte);                                               \
     GS_RET_OK;                                                          \
   }
@@ -343,59 +769,828 @@ IMPL("new-bytestring", new_bytestring)
 #  define EMIT_STRING_REF(_1, _2, _3, _4)
 #endif
 
-STRING_LENGTH_REF(bytestring, BYTESTRING, InlineBytes, FIX2VAL);
-STRING_LENGTH_REF(string, STRING, InlineUtf8Str, CHAR2VAL);
-
-#undef STRING_LENGTH_REF
-#undef EMIT_STRING_LENGTH
-#undef EMIT_STRING_REF
+STRING_LENGTH_REF(bytestring, is_bytestring0, bytestring_bytes, FIX2VAL)
+
+#undef STRING_LENGTH_REF
+#undef EMIT_STRING_LENGTH
+#undef EMIT_STRING_REF
+
+// the length of a string in code points
+IMPL("string-length", string_length)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_string0(args[0]), "Not a string", args[0]);
+  rets[0] = FIX2VAL(gs_string_cp_length(args[0]));
+  GS_RET_OK;
+}
+#endif
+
+// the char at a code point index of a string
+IMPL("string-ref", string_ref)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  Val str = args[0], idx = args[1];
+  FAIL_IF_LIST(!is_string0(str), "Not a string", str);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(idx), "Not a number", idx);
+  u64 idxV = VAL2UFIX(idx);
+  FAIL_IF_LIST(idxV >= gs_string_cp_length(str), "Index out of bounds", str, idx);
+  u32 offset, c;
+  GS_TRY(gs_string_cp_offset(str, (u32) idxV, &offset));
+  gs_utf8_decode(string_bytes(str).bytes + offset, &c);
+  rets[0] = CHAR2VAL(c);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("bytestring-set!", bytestring_set)
+#if EMIT
+{
+  GS_CHECK_ARITY(3, 1);
+  Val bs = args[0];
+  Val idx = args[1];
+  Val value = args[2];
+  FAIL_IF_LIST(!is_mutable_bytestring0(bs), "Not a mutable bytestring", bs, idx, value);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(idx), "Not a number", bs, idx, value);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(value), "Not a number", bs, idx, value);
+  Bytes bsB = bytestring_bytes(bs);
+  u64 idxV = VAL2UFIX(idx);
+  u64 valueB = VAL2UFIX(value);
+  FAIL_IF_LIST(idxV >= bsB.len, "Index out of bounds", bs, idx, value);
+  bsB.bytes[idxV] = (u8) valueB;
+  rets[0] = VAL_NIL;
+  GS_RET_OK;
+}
+#endif
+
+IMPL("bytestring-copy!", bytestring_copy)
+#if EMIT
+{
+  GS_CHECK_ARITY(5, 1);
+
+  Val dst = args[0];
+  Val dstStart = args[1];
+  Val src = args[2];
+  Val srcStart = args[3];
+  Val len = args[4];
+  GS_FAIL_IF(!is_mutable_bytestring0(dst), "Not a mutable bytestring", NULL);
+  GS_FAIL_IF(!VAL_IS_FIXNUM(dstStart), "Not a number", NULL);
+  GS_FAIL_IF(!is_bytestring0(src), "Not a bytestring", NULL);
+  GS_FAIL_IF(!VAL_IS_FIXNUM(srcStart), "Not a number", NULL);
+  GS_FAIL_IF(!VAL_IS_FIXNUM(len), "Not a number", NULL);
+
+  Bytes dstB = bytestring_bytes(dst);
+  Bytes srcB = bytestring_bytes(src);
+  u64 dstStartV = VAL2UFIX(dstStart);
+  u64 srcStartV = VAL2UFIX(srcStart);
+  u64 lenV = VAL2UFIX(len);
+  FAIL_IF_LIST(dstStartV + lenV > dstB.len, "Destination region out of range", dst, dstStart, src, srcStart, len);
+  FAIL_IF_LIST(srcStartV + lenV > srcB.len, "Source region out of range", dst, dstStart, src, srcStart, len);
+  // slices may share bytes with each other
+  memmove(dstB.bytes + dstStartV, srcB.bytes + srcStartV, lenV);
+
+  rets[0] = VAL_NIL;
+  GS_RET_OK;
+}
+#endif
+
+// a slice of len bytes from pos, sharing the bytestring's contents
+IMPL("bytestring-slice", bytestring_slice)
+#if EMIT
+{
+  GS_CHECK_ARITY(3, 1);
+  Val bs = args[0], pos = args[1], len = args[2];
+  FAIL_IF_LIST(!is_bytestring0(bs), "Not a bytestring", bs);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(pos), "Not a number", pos);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(len), "Not a number", len);
+  u64 posV = VAL2UFIX(pos), lenV = VAL2UFIX(len);
+  FAIL_IF_LIST(posV + lenV > bytestring_bytes(bs).len, "Region out of range", bs, pos, len);
+  GS_TRY(gs_bytestring_slice(bs, (u32) posV, (u32) lenV, rets));
+  GS_RET_OK;
+}
+#endif
+
+// a copy of a slice that no longer shares its owner's contents
+IMPL("bytestring-compact", bytestring_compact)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_bytestring0(args[0]), "Not a bytestring", args[0]);
+  GS_TRY(gs_bytestring_compact(args[0], rets));
+  GS_RET_OK;
+}
+#endif
+
+#if EMIT
+// the bytes of the bytestring at args[0], or the part of it between
+// the optional start and end at args[2] and args[3]
+static Err *byte_region(Val *args, u16 argc, Bytes *out) {
+  FAIL_IF_LIST(!is_bytestring0(args[0]), "Not a bytestring", args[0]);
+  Bytes bytes = bytestring_bytes(args[0]);
+  if (argc == 4) {
+    FAIL_IF_LIST(!VAL_IS_FIXNUM(args[2]), "Not a number", args[2]);
+    FAIL_IF_LIST(!VAL_IS_FIXNUM(args[3]), "Not a number", args[3]);
+    u64 start = VAL2UFIX(args[2]);
+    u64 end = VAL2UFIX(args[3]);
+    FAIL_IF_LIST(start > end || end > bytes.len, "Region out of range", args[0], args[2], args[3]);
+    bytes.bytes += start;
+    bytes.len = (u32) (end - start);
+  }
+  *out = bytes;
+  GS_RET_OK;
+}
+#endif
+
+// the index of the first occurrence of a byte, optionally between
+// start and end, or false
+IMPL("bytestring-index", bytestring_index)
+#if EMIT
+{
+  GS_FAIL_IF(argc != 2 && argc != 4, "bad argument arity, expected: 2 or 4", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  Bytes bytes;
+  GS_TRY(byte_region(args, argc, &bytes));
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(args[1]), "Not a number", args[1]);
+  const u8 *found = bytes.len ? memchr(bytes.bytes, (u8) VAL2UFIX(args[1]), bytes.len) : NULL;
+  rets[0] = found ? FIX2VAL(found - bytestring_bytes(args[0]).bytes) : VAL_FALSE;
+  GS_RET_OK;
+}
+#endif
+
+// how many times a byte occurs, optionally between start and end
+IMPL("bytestring-count", bytestring_count)
+#if EMIT
+{
+  GS_FAIL_IF(argc != 2 && argc != 4, "bad argument arity, expected: 2 or 4", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  Bytes bytes;
+  GS_TRY(byte_region(args, argc, &bytes));
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(args[1]), "Not a number", args[1]);
+  rets[0] = FIX2VAL(gs_bytes_count(bytes, (u8) VAL2UFIX(args[1])));
+  GS_RET_OK;
+}
+#endif
+
+// set every byte, optionally between start and end
+IMPL("bytestring-fill!", bytestring_fill)
+#if EMIT
+{
+  GS_FAIL_IF(argc != 2 && argc != 4, "bad argument arity, expected: 2 or 4", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  FAIL_IF_LIST(!is_mutable_bytestring0(args[0]), "Not a mutable bytestring", args[0]);
+  Bytes bytes;
+  GS_TRY(byte_region(args, argc, &bytes));
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(args[1]), "Not a number", args[1]);
+  if (bytes.len) memset(bytes.bytes, (u8) VAL2UFIX(args[1]), bytes.len);
+  rets[0] = VAL_NIL;
+  GS_RET_OK;
+}
+#endif
+
+// the index of the first occurrence of needle at or after start, or false
+IMPL("bytestring-search", bytestring_search)
+#if EMIT
+{
+  GS_FAIL_IF(argc != 2 && argc != 3, "bad argument arity, expected: 2 or 3", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  FAIL_IF_LIST(!is_bytestring0(args[0]), "Not a bytestring", args[0]);
+  FAIL_IF_LIST(!is_bytestring0(args[1]), "Not a bytestring", args[1]);
+  Bytes hay = bytestring_bytes(args[0]);
+  u64 start = 0;
+  if (argc == 3) {
+    FAIL_IF_LIST(!VAL_IS_FIXNUM(args[2]), "Not a number", args[2]);
+    start = VAL2UFIX(args[2]);
+    FAIL_IF_LIST(start > hay.len, "Start out of range", args[0], args[2]);
+  }
+  hay.bytes += start;
+  hay.len -= (u32) start;
+  u32 found;
+  rets[0] = gs_bytes_search(hay, bytestring_bytes(args[1]), &found)
+    ? FIX2VAL(start + found)
+    : VAL_FALSE;
+  GS_RET_OK;
+}
+#endif
+
+// -1, 0 or 1 as lhs orders before, the same as or after rhs
+IMPL("bytestring-compare", bytestring_compare)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_bytestring0(args[0]), "Not a bytestring", args[0]);
+  FAIL_IF_LIST(!is_bytestring0(args[1]), "Not a bytestring", args[1]);
+  rets[0] = FIX2VAL(gs_bytes_compare(bytestring_bytes(args[0]), bytestring_bytes(args[1])));
+  GS_RET_OK;
+}
+#endif
+
+// little-endian integers at a byte offset of a bytestring, read
+// zero- or sign-extended and written truncated to their width
+#define BYTESTRING_LE(S, INT, BITS)                                     \
+  IMPL("bytestring-" #S #BITS "le-ref", bytestring_##S##BITS##le_ref)   \
+  EMIT_BYTESTRING_LE_REF(INT, BITS, S##fix_fits)                        \
+  IMPL("bytestring-" #S #BITS "le-set!", bytestring_##S##BITS##le_set)  \
+  EMIT_BYTESTRING_LE_SET(BITS)
+
+#if EMIT
+static Err *le_offset(Val bs, Val pos, u32 size, Bytes *out) {
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(pos), "Not a number", pos);
+  Bytes bytes = bytestring_bytes(bs);
+  u64 posV = VAL2UFIX(pos);
+  FAIL_IF_LIST(bytes.len < size || posV > bytes.len - size, "Index out of bounds", bs, pos);
+  *out = (Bytes) { bytes.bytes + posV, size };
+  GS_RET_OK;
+}
+
+static bool sfix_fits(i64 value) {
+  return VAL2SFIX(FIX2VAL(value)) == value;
+}
+
+static bool ufix_fits(u64 value) {
+  return (i64) value >= 0 && sfix_fits((i64) value);
+}
+
+#  define EMIT_BYTESTRING_LE_REF(INT, BITS, FITS)                       \
+  {                                                                     \
+    GS_CHECK_ARITY(2, 1);                                               \
+    FAIL_IF_LIST(!is_bytestring0(args[0]), "Not a bytestring", args[0]); \
+    Bytes at;                                                           \
+    GS_TRY(le_offset(args[0], args[1], BITS / 8, &at));                 \
+    INT value = (INT) gs_load_u##BITS##le(at.bytes);                    \
+    FAIL_IF_LIST(!FITS(value), "Integer does not fit in a fixnum", args[0], args[1]); \
+    rets[0] = FIX2VAL(value);                                           \
+    GS_RET_OK;                                                          \
+  }
+#  define EMIT_BYTESTRING_LE_SET(BITS)                                  \
+  {                                                                     \
+    GS_CHECK_ARITY(3, 1);                                               \
+    FAIL_IF_LIST(!is_mutable_bytestring0(args[0]), "Not a mutable bytestring", args[0]); \
+    FAIL_IF_LIST(!VAL_IS_FIXNUM(args[2]), "Not a number", args[2]);     \
+    Bytes at;                                                           \
+    GS_TRY(le_offset(args[0], args[1], BITS / 8, &at));                 \
+    gs_store_u##BITS##le(at.bytes, (u##BITS) VAL2SFIX(args[2]));        \
+    rets[0] = VAL_NIL;                                                  \
+    GS_RET_OK;                                                          \
+  }
+#else
+#  define EMIT_BYTESTRING_LE_REF(_1, _2, _3)
+#  define EMIT_BYTESTRING_LE_SET(_1)
+#endif
+
+BYTESTRING_LE(u, u16, 16)
+BYTESTRING_LE(s, i16, 16)
+BYTESTRING_LE(u, u32, 32)
+BYTESTRING_LE(s, i32, 32)
+BYTESTRING_LE(u, u64, 64)
+BYTESTRING_LE(s, i64, 64)
+
+#undef BYTESTRING_LE
+#undef EMIT_BYTESTRING_LE_REF
+#undef EMIT_BYTESTRING_LE_SET
+
+// bytevectors
+
+// a new empty bytevector, with room for cap bytes before it grows
+IMPL("new-bytevector", new_bytevector)
+#if EMIT
+{
+  GS_FAIL_IF(argc > 1, "bad argument arity, expected: 0 or 1", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  u32 cap = 0;
+  if (argc) {
+    FAIL_IF_LIST(!VAL_IS_FIXNUM(args[0]), "Not a number", args[0]);
+    cap = VAL2UFIX(args[0]);
+  }
+  ByteVector *bv;
+  GS_TRY(gs_bytevector_alloc(cap, &bv));
+  rets[0] = PTR2VAL_GC(bv);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("bytevector?", is_bytevector)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  rets[0] = BOOL2VAL(is_type(args[0], BYTE_VECTOR_TYPE));
+  GS_RET_OK;
+}
+#endif
+
+IMPL("bytevector-length", bytevector_length)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], BYTE_VECTOR_TYPE), "Not a bytevector", args[0]);
+  rets[0] = FIX2VAL(VAL2PTR(ByteVector, args[0])->len);
+  GS_RET_OK;
+}
+#endif
+
+// truncate a bytevector, or extend it with zeroes
+IMPL("bytevector-set-len!", bytevector_set_len)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], BYTE_VECTOR_TYPE), "Not a bytevector", args[0]);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(args[1]), "Not a number", args[1]);
+  ByteVector *bv = VAL2PTR(ByteVector, args[0]);
+  u64 len = VAL2UFIX(args[1]);
+  if (len > bv->len) {
+    GS_FAIL_IF(len > UINT32_MAX, "Bytevector too large", NULL);
+    u8 *dst;
+    u32 extra = (u32) len - bv->len;
+    GS_TRY(gs_bytevector_reserve(bv, extra, &dst));
+    memset(dst, 0, extra);
+  } else {
+    bv->len = (u32) len;
+  }
+  rets[0] = VAL_NIL;
+  GS_RET_OK;
+}
+#endif
+
+IMPL("bytevector-ref", bytevector_ref)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], BYTE_VECTOR_TYPE), "Not a bytevector", args[0]);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(args[1]), "Not a number", args[1]);
+  ByteVector *bv = VAL2PTR(ByteVector, args[0]);
+  u64 idx = VAL2UFIX(args[1]);
+  FAIL_IF_LIST(idx >= bv->len, "Index out of bounds", args[0], args[1]);
+  rets[0] = FIX2VAL(bv->buf->bytes[idx]);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("bytevector-push-byte!", bytevector_push_byte)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], BYTE_VECTOR_TYPE), "Not a bytevector", args[0]);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(args[1]), "Not a number", args[1]);
+  u8 *dst;
+  GS_TRY(gs_bytevector_reserve(VAL2PTR(ByteVector, args[0]), 1, &dst));
+  *dst = (u8) VAL2UFIX(args[1]);
+  rets[0] = args[0];
+  GS_RET_OK;
+}
+#endif
+
+// push each of the remaining arguments as a byte
+IMPL("bytevector-push!", bytevector_push)
+#if EMIT
+{
+  GS_FAIL_IF(argc < 1, "Not enough arguments", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  FAIL_IF_LIST(!is_type(args[0], BYTE_VECTOR_TYPE), "Not a bytevector", args[0]);
+  for (u16 i = 1; i < argc; ++i) {
+    FAIL_IF_LIST(!VAL_IS_FIXNUM(args[i]), "Not a number", args[i]);
+  }
+  u8 *dst;
+  GS_TRY(gs_bytevector_reserve(VAL2PTR(ByteVector, args[0]), argc - 1, &dst));
+  for (u16 i = 1; i < argc; ++i) {
+    *dst++ = (u8) VAL2UFIX(args[i]);
+  }
+  rets[0] = args[0];
+  GS_RET_OK;
+}
+#endif
+
+// push the low bytes of a number, least significant first
+#define BYTEVECTOR_PUSH_LE(BITS)                                        \
+  IMPL("bytevector-push-u" #BITS "le!", bytevector_push_u##BITS##le)    \
+  EMIT_BYTEVECTOR_PUSH_LE(BITS)
+
+#if EMIT
+#  define EMIT_BYTEVECTOR_PUSH_LE(BITS)                                 \
+  {                                                                     \
+    GS_CHECK_ARITY(2, 1);                                               \
+    FAIL_IF_LIST(!is_type(args[0], BYTE_VECTOR_TYPE), "Not a bytevector", args[0]); \
+    FAIL_IF_LIST(!VAL_IS_FIXNUM(args[1]), "Not a number", args[1]);     \
+    u8 *dst;                                                            \
+    GS_TRY(gs_bytevector_reserve(VAL2PTR(ByteVector, args[0]), BITS / 8, &dst)); \
+    gs_store_u##BITS##le(dst, (u##BITS) VAL2SFIX(args[1]));             \
+    rets[0] = args[0];                                                  \
+    GS_RET_OK;                                                          \
+  }
+#else
+#  define EMIT_BYTEVECTOR_PUSH_LE(BITS)
+#endif
+
+BYTEVECTOR_PUSH_LE(16)
+BYTEVECTOR_PUSH_LE(32)
+BYTEVECTOR_PUSH_LE(64)
+
+#undef EMIT_BYTEVECTOR_PUSH_LE
+#undef BYTEVECTOR_PUSH_LE
+
+// overwrite the four bytes at pos with a number, least significant first
+IMPL("bytevector-set-u32le-at!", bytevector_set_u32le_at)
+#if EMIT
+{
+  GS_CHECK_ARITY(3, 1);
+  FAIL_IF_LIST(!is_type(args[0], BYTE_VECTOR_TYPE), "Not a bytevector", args[0]);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(args[1]), "Not a number", args[1]);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(args[2]), "Not a number", args[2]);
+  ByteVector *bv = VAL2PTR(ByteVector, args[0]);
+  u64 pos = VAL2UFIX(args[1]);
+  FAIL_IF_LIST(pos + 4 > bv->len, "Index out of bounds", args[0], args[1]);
+  gs_store_u32le(bv->buf->bytes + pos, (u32) VAL2SFIX(args[2]));
+  rets[0] = VAL_NIL;
+  GS_RET_OK;
+}
+#endif
+
+// push the contents of a bytestring or string
+IMPL("bytevector-append!", bytevector_append)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], BYTE_VECTOR_TYPE), "Not a bytevector", args[0]);
+  FAIL_IF_LIST(!is_bytestring0(args[1]) && !is_string0(args[1]), "Not a string or bytestring", args[1]);
+  Bytes src = is_string0(args[1]) ? string_bytes(args[1]) : bytestring_bytes(args[1]);
+  u8 *dst;
+  GS_TRY(gs_bytevector_reserve(VAL2PTR(ByteVector, args[0]), src.len, &dst));
+  if (src.len) memcpy(dst, src.bytes, src.len);
+  rets[0] = args[0];
+  GS_RET_OK;
+}
+#endif
+
+// take the contents of a bytevector without copying them, leaving it empty
+IMPL("bytevector->bytestring", bytevector_to_bytestring)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], BYTE_VECTOR_TYPE), "Not a bytevector", args[0]);
+  InlineBytes *bs;
+  GS_TRY(gs_bytevector_take(VAL2PTR(ByteVector, args[0]), &bs));
+  rets[0] = PTR2VAL_GC(bs);
+  GS_RET_OK;
+}
+#endif
+
+// string builders
+
+// a new empty string builder, with room for cap bytes before it grows
+IMPL("make-string-builder", make_string_builder)
+#if EMIT
+{
+  GS_FAIL_IF(argc > 1, "bad argument arity, expected: 0 or 1", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  u32 cap = 0;
+  if (argc) {
+    FAIL_IF_LIST(!VAL_IS_FIXNUM(args[0]), "Not a number", args[0]);
+    cap = (u32) VAL2UFIX(args[0]);
+  }
+  StringBuilder *sb;
+  GS_TRY(gs_string_builder_alloc(cap, &sb));
+  rets[0] = PTR2VAL_GC(sb);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("string-builder?", is_string_builder)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  rets[0] = BOOL2VAL(is_type(args[0], STRING_BUILDER_TYPE));
+  GS_RET_OK;
+}
+#endif
+
+IMPL("sb-push-char!", sb_push_char)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], STRING_BUILDER_TYPE), "Not a string builder", args[0]);
+  FAIL_IF_LIST(!VAL_IS_CHAR(args[1]), "Not a char", args[1]);
+  GS_TRY(gs_string_builder_push_char(VAL2PTR(StringBuilder, args[0]), VAL2CHAR(args[1])));
+  rets[0] = args[0];
+  GS_RET_OK;
+}
+#endif
+
+IMPL("sb-append!", sb_append)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], STRING_BUILDER_TYPE), "Not a string builder", args[0]);
+  FAIL_IF_LIST(!is_string0(args[1]), "Not a string", args[1]);
+  Utf8Str src = string_bytes(args[1]);
+  u8 *dst;
+  GS_TRY(gs_string_builder_reserve(VAL2PTR(StringBuilder, args[0]), src.len, &dst));
+  if (src.len) memcpy(dst, src.bytes, src.len);
+  rets[0] = args[0];
+  GS_RET_OK;
+}
+#endif
+
+// push a value as dbg would print it
+IMPL("sb-print!", sb_print)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], STRING_BUILDER_TYPE), "Not a string builder", args[0]);
+  GS_TRY(pr0_to_builder(VAL2PTR(StringBuilder, args[0]), args[1]));
+  rets[0] = args[0];
+  GS_RET_OK;
+}
+#endif
+
+// take the contents of a string builder without copying them, leaving it empty
+IMPL("sb->string", sb_to_string)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], STRING_BUILDER_TYPE), "Not a string builder", args[0]);
+  InlineUtf8Str *str;
+  GS_TRY(gs_string_builder_take(VAL2PTR(StringBuilder, args[0]), &str));
+  rets[0] = PTR2VAL_GC(str);
+  GS_RET_OK;
+}
+#endif
+
+// hash maps, where nil is the empty map
+
+IMPL("hash-map?", is_hash_map)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  rets[0] = BOOL2VAL(args[0] == VAL_NIL || is_type(args[0], HASH_MAP_TYPE));
+  GS_RET_OK;
+}
+#endif
+
+IMPL("hash-map-count", hash_map_count)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  Val map = args[0];
+  FAIL_IF_LIST(map != VAL_NIL && !is_type(map, HASH_MAP_TYPE), "Not a hash map", map);
+  rets[0] = FIX2VAL(map == VAL_NIL ? 0 : VAL2PTR(HashMap, map)->count);
+  GS_RET_OK;
+}
+#endif
+
+// the value of key in a map, or else default, which is nil if not given
+IMPL("hash-map-get", hash_map_get)
+#if EMIT
+{
+  GS_FAIL_IF(argc != 2 && argc != 3, "bad argument arity, expected: 2 or 3", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  Val map = args[0];
+  FAIL_IF_LIST(map != VAL_NIL && !is_type(map, HASH_MAP_TYPE), "Not a hash map", map);
+  bool found;
+  gs_hash_map_get(map == VAL_NIL ? NULL : VAL2PTR(HashMap, map), args[1], &found, rets);
+  if (!found) rets[0] = argc == 3 ? args[2] : VAL_NIL;
+  GS_RET_OK;
+}
+#endif
+
+IMPL("hash-map-assoc", hash_map_assoc)
+#if EMIT
+{
+  GS_CHECK_ARITY(3, 1);
+  Val map = args[0];
+  FAIL_IF_LIST(map != VAL_NIL && !is_type(map, HASH_MAP_TYPE), "Not a hash map", map);
+  HashMap *out;
+  GS_TRY(gs_hash_map_assoc(map == VAL_NIL ? NULL : VAL2PTR(HashMap, map), args[1], args[2], &out));
+  rets[0] = PTR2VAL_GC(out);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("hash-map-dissoc", hash_map_dissoc)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  Val map = args[0];
+  FAIL_IF_LIST(map != VAL_NIL && !is_type(map, HASH_MAP_TYPE), "Not a hash map", map);
+  HashMap *out;
+  GS_TRY(gs_hash_map_dissoc(map == VAL_NIL ? NULL : VAL2PTR(HashMap, map), args[1], &out));
+  rets[0] = out ? PTR2VAL_GC(out) : VAL_NIL;
+  GS_RET_OK;
+}
+#endif
+
+// the entries of a map as (key value) lists, in no particular order
+IMPL("hash-map->list", hash_map_to_list)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  Val map = args[0];
+  FAIL_IF_LIST(map != VAL_NIL && !is_type(map, HASH_MAP_TYPE), "Not a hash map", map);
+  return gs_hash_map_entries(map == VAL_NIL ? NULL : VAL2PTR(HashMap, map), rets);
+}
+#endif
+
+// record types
+
+// a new record type with the given name and list of field names
+IMPL("new-record-type", new_record_type)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  RecordType *rt;
+  GS_TRY(gs_record_type_new(args[0], args[1], &rt));
+  rets[0] = PTR2VAL_GC(rt);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("record-type?", is_record_type)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  rets[0] = BOOL2VAL(is_type(args[0], RECORD_TYPE_TYPE));
+  GS_RET_OK;
+}
+#endif
+
+// a function taking the given fields, in order, and returning a new
+// record with the rest nil
+IMPL("record-constructor", record_constructor)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], RECORD_TYPE_TYPE), "Not a record type", args[0]);
+  return gs_record_constructor(VAL2PTR(RecordType, args[0]), args[1], rets);
+}
+#endif
+
+IMPL("record-predicate", record_predicate)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], RECORD_TYPE_TYPE), "Not a record type", args[0]);
+  return gs_record_predicate(VAL2PTR(RecordType, args[0]), rets);
+}
+#endif
+
+IMPL("record-accessor", record_accessor)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], RECORD_TYPE_TYPE), "Not a record type", args[0]);
+  RecordType *rt = VAL2PTR(RecordType, args[0]);
+  u32 idx;
+  GS_TRY(gs_record_field_index(rt, args[1], &idx));
+  return gs_record_accessor(rt, idx, rets);
+}
+#endif
+
+IMPL("record-modifier", record_modifier)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], RECORD_TYPE_TYPE), "Not a record type", args[0]);
+  RecordType *rt = VAL2PTR(RecordType, args[0]);
+  u32 idx;
+  GS_TRY(gs_record_field_index(rt, args[1], &idx));
+  return gs_record_modifier(rt, idx, rets);
+}
+#endif
+
+IMPL("equal?", is_equal)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  rets[0] = BOOL2VAL(gs_equal(args[0], args[1]));
+  GS_RET_OK;
+}
+#endif
+
+// a hash that agrees with equal?, and is the same from run to run
+IMPL("equal-hash", equal_hash)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  rets[0] = FIX2VAL(gs_equal_hash(args[0], NULL));
+  GS_RET_OK;
+}
+#endif
+
+IMPL("new-hash-table", new_hash_table)
+#if EMIT
+{
+  GS_CHECK_ARITY(0, 1);
+  HashTable *table;
+  GS_TRY(gs_hash_table_new(false, &table));
+  rets[0] = PTR2VAL_GC(table);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("new-equal-hash-table", new_equal_hash_table)
+#if EMIT
+{
+  GS_CHECK_ARITY(0, 1);
+  HashTable *table;
+  GS_TRY(gs_hash_table_new(true, &table));
+  rets[0] = PTR2VAL_GC(table);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("hash-table?", is_hash_table)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  rets[0] = BOOL2VAL(is_type(args[0], HASH_TABLE_TYPE));
+  GS_RET_OK;
+}
+#endif
+
+IMPL("hash-table-count", hash_table_count)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], HASH_TABLE_TYPE), "Not a hash table", args[0]);
+  rets[0] = FIX2VAL(VAL2PTR(HashTable, args[0])->count);
+  GS_RET_OK;
+}
+#endif
+
+// the value of key in a table, or else default, which is nil if not given
+IMPL("hash-table-ref", hash_table_ref)
+#if EMIT
+{
+  GS_FAIL_IF(argc != 2 && argc != 3, "bad argument arity, expected: 2 or 3", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  FAIL_IF_LIST(!is_type(args[0], HASH_TABLE_TYPE), "Not a hash table", args[0]);
+  bool found;
+  GS_TRY(gs_hash_table_get(VAL2PTR(HashTable, args[0]), args[1], &found, rets));
+  if (!found) rets[0] = argc == 3 ? args[2] : VAL_NIL;
+  GS_RET_OK;
+}
+#endif
 
-IMPL("bytestring-set!", bytestring_set)
+IMPL("hash-table-set!", hash_table_set)
 #if EMIT
 {
   GS_CHECK_ARITY(3, 1);
-  Val bs = args[0];
-  Val idx = args[1];
-  Val value = args[2];
-  FAIL_IF_LIST(!is_type(bs, BYTESTRING_TYPE), "Not a bytestring", bs, idx, value);
-  FAIL_IF_LIST(!VAL_IS_FIXNUM(idx), "Not a number", bs, idx, value);
-  FAIL_IF_LIST(!VAL_IS_FIXNUM(value), "Not a number", bs, idx, value);
-  InlineBytes *bsP = VAL2PTR(InlineBytes, bs);
-  u64 idxV = VAL2UFIX(idx);
-  u64 valueB = VAL2UFIX(value);
-  FAIL_IF_LIST(idxV >= bsP->len, "Index out of bounds", bs, idx, value);
-  bsP->bytes[idxV] = (u8) valueB;
-  rets[0] = VAL_NIL;
+  FAIL_IF_LIST(!is_type(args[0], HASH_TABLE_TYPE), "Not a hash table", args[0]);
+  GS_TRY(gs_hash_table_set(VAL2PTR(HashTable, args[0]), args[1], args[2]));
+  rets[0] = args[2];
   GS_RET_OK;
 }
 #endif
 
-IMPL("bytestring-copy!", bytestring_copy)
+// remove key from a table, returning whether it was there
+IMPL("hash-table-remove!", hash_table_remove)
 #if EMIT
 {
-  GS_CHECK_ARITY(5, 1);
-
-  Val dst = args[0];
-  Val dstStart = args[1];
-  Val src = args[2];
-  Val srcStart = args[3];
-  Val len = args[4];
-  GS_FAIL_IF(!is_type(dst, BYTESTRING_TYPE), "Not a bytestring", NULL);
-  GS_FAIL_IF(!VAL_IS_FIXNUM(dstStart), "Not a number", NULL);
-  GS_FAIL_IF(!is_type(src, BYTESTRING_TYPE), "Not a bytestring", NULL);
-  GS_FAIL_IF(!VAL_IS_FIXNUM(srcStart), "Not a number", NULL);
-  GS_FAIL_IF(!VAL_IS_FIXNUM(len), "Not a number", NULL);
+  GS_CHECK_ARITY(2, 1);
+  FAIL_IF_LIST(!is_type(args[0], HASH_TABLE_TYPE), "Not a hash table", args[0]);
+  bool removed;
+  GS_TRY(gs_hash_table_remove(VAL2PTR(HashTable, args[0]), args[1], &removed));
+  rets[0] = BOOL2VAL(removed);
+  GS_RET_OK;
+}
+#endif
 
-  InlineBytes *dstP = VAL2PTR(InlineBytes, dst);
-  InlineBytes *srcP = VAL2PTR(InlineBytes, src);
-  u64 dstStartV = VAL2UFIX(dstStart);
-  u64 srcStartV = VAL2UFIX(srcStart);
-  u64 lenV = VAL2UFIX(len);
-  FAIL_IF_LIST(dstStartV + lenV > dstP->len, "Destination region out of range", dst, dstStart, src, srcStart, len);
-  FAIL_IF_LIST(srcStartV + lenV > srcP->len, "Source region out of range", dst, dstStart, src, srcStart, len);
-  memcpy(dstP->bytes + dstStartV, srcP->bytes + srcStartV, lenV);
+// the entries of a table as (key value) lists, in no particular order
+IMPL("hash-table->list", hash_table_to_list)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], HASH_TABLE_TYPE), "Not a hash table", args[0]);
+  return gs_hash_table_entries(VAL2PTR(HashTable, args[0]), rets);
+}
+#endif
 
-  rets[0] = VAL_NIL;
+IMPL("string->list", string_to_list)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  Val strV = args[0];
+  FAIL_IF_LIST(!is_string0(strV), "Not a string", strV);
+  Utf8Str str = string_bytes(strV);
+  Val ret = VAL_NIL;
+  for (u32 i = str.len; i > 0; --i) {
+    // back up to the start of the code point
+    u32 start = i - 1;
+    while ((str.bytes[start] & 0xC0) == 0x80) --start;
+    u32 c;
+    gs_utf8_decode(str.bytes + start, &c);
+    i = start + 1;
+    Val pair[] = { CHAR2VAL(c), ret };
+    GS_TRY(gs_call(&cons, 2, pair, 1, &ret));
+  }
+  rets[0] = ret;
   GS_RET_OK;
 }
 #endif
@@ -406,26 +1601,30 @@ IMPL("list->string", list_to_string)
   GS_CHECK_ARITY(1, 1);
   Val list = args[0];
   FAIL_IF_LIST(!is_list0(list), "Not a list", list);
-  u32 len = 0;
+  u32 len = 0, cpLen = 0;
+  u8 enc[4];
   {
     Val counting = list;
     while (counting != VAL_NIL) {
       Cons *pair = VAL2PTR(Cons, counting);
       GS_FAIL_IF(!VAL_IS_CHAR(pair->car), "Not a char", NULL);
+      u32 n = gs_utf8_encode(VAL2CHAR(pair->car), enc);
+      FAIL_IF_LIST(!n, "Not a code point", pair->car);
       counting = pair->cdr;
-      ++len; // TODO utf-8
+      len += n;
+      ++cpLen;
     }
   }
   InlineUtf8Str *str;
-  GS_TRY(gs_gc_alloc_array(STRING_TYPE, len, (anyptr *)&str));
+  GS_TRY(gs_string_alloc(len, &str));
+  str->cpLen = cpLen;
   {
     Val copying = list;
-    u32 i = 0;
+    u8 *it = str->bytes;
     while (copying != VAL_NIL) {
       Cons *pair = VAL2PTR(Cons, copying);
-      str->bytes[i] = (u8) VAL2CHAR(pair->car);
+      it += gs_utf8_encode(VAL2CHAR(pair->car), it);
       copying = pair->cdr;
-      ++i;
     }
   }
   rets[0] = PTR2VAL_GC(str);
@@ -441,29 +1640,36 @@ IMPL("substring", substring)
   GS_FAIL_IF(argc < 2 || argc > 3, "Bad arity", NULL);
   Val str = args[0];
   Val start = args[1];
-  FAIL_IF_LIST(!is_type(str, STRING_TYPE), "Not a string", str);
+  FAIL_IF_LIST(!is_string0(str), "Not a string", str);
   FAIL_IF_LIST(!VAL_IS_FIXNUM(start), "Not a number", start);
 
-  InlineUtf8Str *strV = VAL2PTR(InlineUtf8Str, str);
+  u32 strLen = gs_string_cp_length(str);
   u64 startV = VAL2UFIX(start);
 
-  FAIL_IF_LIST(startV > strV->len, "Start index out of range", str, start);
+  FAIL_IF_LIST(startV > strLen, "Start index out of range", str, start);
 
   u64 lenV;
   if (argc == 3) {
     Val end = args[2];
     FAIL_IF_LIST(!VAL_IS_FIXNUM(end), "Not a number", end);
-    lenV = VAL2UFIX(end);
-    FAIL_IF_LIST(lenV > strV->len - (u32) startV, "End out of range", str, start, end);
+    u64 endV = VAL2UFIX(end);
+    FAIL_IF_LIST(endV < startV || endV > strLen, "End out of range", str, start, end);
+    lenV = endV - startV;
   } else {
-    lenV = strV->len - startV;
+    lenV = strLen - startV;
   }
 
-  InlineUtf8Str *subs;
-  GS_TRY(gs_gc_alloc_array(STRING_TYPE, (u32) lenV, (anyptr *)&subs));
-  memcpy(subs->bytes, strV->bytes + startV, lenV);
-  rets[0] = PTR2VAL_GC(subs);
+  GS_TRY(gs_string_slice(str, (u32) startV, (u32) lenV, rets));
+  GS_RET_OK;
+}
+#endif
 
+IMPL("string-compact", string_compact)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_string0(args[0]), "Not a string", args[0]);
+  GS_TRY(gs_string_compact(args[0], rets));
   GS_RET_OK;
 }
 #endif
@@ -473,9 +1679,9 @@ IMPL("string=?", string_eq)
 {
   GS_CHECK_ARITY(2, 1);
   Val lhs = args[0], rhs = args[1];
-  FAIL_IF_LIST(!is_type(lhs, STRING_TYPE) || !is_type(rhs, STRING_TYPE), "Not a string", lhs, rhs);
-  InlineUtf8Str *lhsS = VAL2PTR(InlineUtf8Str, lhs), *rhsS = VAL2PTR(InlineUtf8Str, rhs);
-  rets[0] = BOOL2VAL(lhsS->len == rhsS->len && memcmp(lhsS->bytes, rhsS->bytes, lhsS->len) == 0);
+  FAIL_IF_LIST(!is_string0(lhs) || !is_string0(rhs), "Not a string", lhs, rhs);
+  Utf8Str lhsS = string_bytes(lhs), rhsS = string_bytes(rhs);
+  rets[0] = BOOL2VAL(lhsS.len == rhsS.len && memcmp(lhsS.bytes, rhsS.bytes, lhsS.len) == 0);
   GS_RET_OK;
 }
 #endif
@@ -485,9 +1691,9 @@ IMPL("string-prefix?", string_prefix)
 {
   GS_CHECK_ARITY(2, 1);
   Val str = args[0], pref = args[1];
-  FAIL_IF_LIST(!is_type(str, STRING_TYPE) || !is_type(pref, STRING_TYPE), "Not a string", str, pref);
-  InlineUtf8Str *strS = VAL2PTR(InlineUtf8Str, str), *prefS = VAL2PTR(InlineUtf8Str, pref);
-  rets[0] = BOOL2VAL(prefS->len <= strS->len && memcmp(prefS->bytes, strS->bytes, prefS->len) == 0);
+  FAIL_IF_LIST(!is_string0(str) || !is_string0(pref), "Not a string", str, pref);
+  Utf8Str strS = string_bytes(str), prefS = string_bytes(pref);
+  rets[0] = BOOL2VAL(prefS.len <= strS.len && memcmp(prefS.bytes, strS.bytes, prefS.len) == 0);
   GS_RET_OK;
 }
 #endif
@@ -652,6 +1858,21 @@ CMP_IMPL(=, ==, cmp_eq)
 #undef CMP_IMPL
 #undef CMP_BODY
 
+IMPL("monotonic-nanos", monotonic_nanos)
+#if EMIT
+{
+  GS_CHECK_ARITY(0, 1);
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+  timespec_get(&ts, TIME_UTC);
+#endif
+  rets[0] = FIX2VAL((u64) ts.tv_sec * 1000000000 + (u64) ts.tv_nsec);
+  GS_RET_OK;
+}
+#endif
+
 IMPL("dbg", dbg_pr)
 #if EMIT
 {
@@ -698,49 +1919,99 @@ IMPL("intern", intern)
 {
   GS_CHECK_ARITY(1, 1);
   Val str = args[0];
-  GS_FAIL_IF(!is_type(str, STRING_TYPE), "Not a string", NULL);
-  InlineUtf8Str *strV = VAL2PTR(InlineUtf8Str, str);
+  GS_FAIL_IF(!is_string0(str), "Not a string", NULL);
   Symbol *ret;
-  GS_TRY(gs_intern(GS_DECAY_BYTES(strV), &ret));
+  GS_TRY(gs_intern(string_bytes(str), &ret));
   rets[0] = PTR2VAL_GC(ret);
   GS_RET_OK;
 }
 #endif
 
-IMPL("string->number", string_to_number)
+IMPL("symbol-hash", symbol_hash)
 #if EMIT
 {
   GS_CHECK_ARITY(1, 1);
-  Val strV = args[0];
-  GS_FAIL_IF(!is_type(strV, STRING_TYPE), "Not a string", NULL);
-  InlineUtf8Str *str = VAL2PTR(InlineUtf8Str, strV);
+  Val sym = args[0];
+  GS_FAIL_IF(!is_symbol0(sym), "Not a symbol", NULL);
+  // the hash of the name, which gensyms don't keep
+  rets[0] = FIX2VAL((u32) gs_hash_bytes(GS_DECAY_BYTES(VAL2PTR(Symbol, sym)->name)));
+  GS_RET_OK;
+}
+#endif
 
-  char *it = (char *) str->bytes;
-  char *end = it + str->len;
-  GS_FAIL_IF(it == end, "Empty string", NULL);
-  i8 sign = 1;
-  if (*it == '-' || *it == '+') {
-    sign = *it == '-' ? -1 : +1;
-    ++it;
+IMPL("string-hash", string_hash)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  Val strV = args[0];
+  Utf8Str bytes;
+  if (is_string0(strV)) {
+    bytes = string_bytes(strV);
+  } else {
+    FAIL_IF_LIST(!is_bytestring0(strV), "Not a string or bytestring", strV);
+    bytes = bytestring_bytes(strV);
   }
+  rets[0] = FIX2VAL((u32) gs_hash_bytes(bytes));
+  GS_RET_OK;
+}
+#endif
 
-  bool hasDigits = false;
-  u64 absVal = 0;
-  for (; it != end; ++it) {
-    if (*it == '_') continue;
-    GS_FAIL_IF(*it < '0' || *it > '9', "Invalid character for number", NULL);
-    hasDigits = true;
-    u64 newVal = absVal * 10 + (*it - '0');
-    GS_FAIL_IF(newVal < absVal, "Integer literal too large", NULL);
-    absVal = newVal;
-  }
+IMPL("string->number", string_to_number)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  Val strV = args[0];
+  GS_FAIL_IF(!is_string0(strV), "Not a string", NULL);
+  GS_TRY(gs_parse_number(string_bytes(strV), rets));
+  GS_RET_OK;
+}
+#endif
 
-  GS_FAIL_IF(!hasDigits, "No digits", NULL);
-  GS_FAIL_IF(absVal >> 63 == 1, "Integer literal too large", NULL);
+IMPL("read-from-bytes", read_from_bytes)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  Val srcV = args[0];
+  Val posV = args[1];
+  Utf8Str src;
+  if (is_string0(srcV)) {
+    src = string_bytes(srcV);
+  } else {
+    FAIL_IF_LIST(!is_bytestring0(srcV), "Not a string or bytestring", srcV);
+    src = bytestring_bytes(srcV);
+  }
+  FAIL_IF_LIST(!is_type(posV, BOX_TYPE), "Not a box", posV);
+  Box *posBox = VAL2PTR(Box, posV);
+  FAIL_IF_LIST(!VAL_IS_FIXNUM(posBox->value), "Not a number", posBox->value);
+  u64 pos = VAL2UFIX(posBox->value);
+  FAIL_IF_LIST(pos > src.len, "Position out of range", posBox->value);
+
+  u32 pos32 = (u32) pos;
+  GS_TRY(gs_read_datum(src, &pos32, rets));
+  posBox->value = FIX2VAL(pos32);
+  GS_RET_OK;
+}
+#endif
 
-  i64 retV = sign * (i64) absVal;
-  rets[0] = FIX2VAL(retV);
+// a bytestring that deserialize reads back as an equal value, with
+// the same sharing
+IMPL("serialize", serialize)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  InlineBytes *bs;
+  GS_TRY(gs_serialize(args[0], &bs));
+  rets[0] = PTR2VAL_GC(bs);
+  GS_RET_OK;
+}
+#endif
 
+IMPL("deserialize", deserialize)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_bytestring0(args[0]), "Not a bytestring", args[0]);
+  GS_TRY(gs_deserialize(bytestring_bytes(args[0]), rets));
   GS_RET_OK;
 }
 #endif
@@ -764,15 +2035,15 @@ IMPL("open-file", open_file)
 {
   GS_CHECK_ARITY(1, 1);
   Val file = args[0];
-  GS_FAIL_IF(!is_type(file, STRING_TYPE), "Not a string", NULL);
+  GS_FAIL_IF(!is_string0(file), "Not a string", NULL);
 
-  InlineUtf8Str *utfFile = VAL2PTR(InlineUtf8Str, file);
-  char *str = gs_alloc(GS_ALLOC_META(char, utfFile->len + 1));
+  Utf8Str utfFile = string_bytes(file);
+  char *str = gs_alloc(GS_ALLOC_META(char, utfFile.len + 1));
   GS_FAIL_IF(!str, "Failed allocation", NULL);
-  memcpy(str, utfFile->bytes, utfFile->len + 1);
-  str[utfFile->len] = 0;
+  memcpy(str, utfFile.bytes, utfFile.len);
+  str[utfFile.len] = 0;
   FILE *fp = fopen(str, "r");
-  gs_free(str, GS_ALLOC_META(char, utfFile->len + 1));
+  gs_free(str, GS_ALLOC_META(char, utfFile.len + 1));
   GS_FAIL_IF(!fp, "Could not open file", NULL);
 
   Val ret = VAL_NIL, retEnd = VAL_NIL;
@@ -816,29 +2087,297 @@ IMPL("open-file", open_file)
 }
 #endif
 
+// read a whole file into a bytestring
+IMPL("read-file-bytes", read_file_bytes)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  Val nameV = args[0];
+  FAIL_IF_LIST(!is_string0(nameV), "Not a string", nameV);
+
+  Utf8Str utfFile = string_bytes(nameV);
+  char *str = gs_alloc(GS_ALLOC_META(char, utfFile.len + 1));
+  GS_FAIL_IF(!str, "Failed allocation", NULL);
+  memcpy(str, utfFile.bytes, utfFile.len);
+  str[utfFile.len] = 0;
+  const u8 *bytes;
+  u32 len;
+  Err *err = gs_map_file(str, &bytes, &len);
+  gs_free(str, GS_ALLOC_META(char, utfFile.len + 1));
+  GS_TRY(err);
+
+  InlineBytes *bs;
+  err = gs_gc_alloc_array(BYTESTRING_TYPE, len, (anyptr *)&bs);
+  if (!err && len) memcpy(bs->bytes, bytes, len);
+  if (bytes) gs_unmap_file(bytes, len);
+  GS_TRY(err);
+  rets[0] = PTR2VAL_GC(bs);
+  GS_RET_OK;
+}
+#endif
+
+// map a whole file into a read-only bytestring that never moves, and
+// is only unmapped once it is unreachable
+IMPL("map-file-bytes", map_file_bytes)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  Val nameV = args[0];
+  FAIL_IF_LIST(!is_string0(nameV), "Not a string", nameV);
+
+  Utf8Str utfFile = string_bytes(nameV);
+  char *str = gs_alloc(GS_ALLOC_META(char, utfFile.len + 1));
+  GS_FAIL_IF(!str, "Failed allocation", NULL);
+  memcpy(str, utfFile.bytes, utfFile.len);
+  str[utfFile.len] = 0;
+  const u8 *bytes;
+  u32 len;
+  Err *err = gs_map_file(str, &bytes, &len);
+  gs_free(str, GS_ALLOC_META(char, utfFile.len + 1));
+  GS_TRY(err);
+
+  MappedBytes *bs;
+  gs_gc_force_next_large();
+  err = gs_gc_alloc(MAPPED_BYTES_TYPE, (anyptr *)&bs);
+  if (err) {
+    if (bytes) gs_unmap_file(bytes, len);
+    GS_TRY(err);
+  }
+  bs->len = len;
+  bs->bytes = bytes;
+  rets[0] = PTR2VAL_GC(bs);
+  GS_RET_OK;
+}
+#endif
+
 IMPL("write-file", write_file)
 #if EMIT
 {
   GS_CHECK_ARITY(2, 1);
   Val nameV = args[0];
   Val bytesV = args[1];
-  FAIL_IF_LIST(!is_type(nameV, STRING_TYPE), "Not a string", bytesV);
-  FAIL_IF_LIST(!is_type(bytesV, BYTESTRING_TYPE), "Not a bytestring", bytesV);
+  FAIL_IF_LIST(!is_string0(nameV), "Not a string", bytesV);
+  FAIL_IF_LIST(!is_bytestring0(bytesV), "Not a bytestring", bytesV);
 
-  InlineUtf8Str *utfFile = VAL2PTR(InlineUtf8Str, nameV);
-  char *str = gs_alloc(GS_ALLOC_META(char, utfFile->len + 1));
+  Utf8Str utfFile = string_bytes(nameV);
+  char *str = gs_alloc(GS_ALLOC_META(char, utfFile.len + 1));
   GS_FAIL_IF(!str, "Failed allocation", NULL);
-  memcpy(str, utfFile->bytes, utfFile->len + 1);
-  str[utfFile->len] = 0;
+  memcpy(str, utfFile.bytes, utfFile.len);
+  str[utfFile.len] = 0;
   FILE *fp = fopen(str, "w");
-  gs_free(str, GS_ALLOC_META(char, utfFile->len + 1));
+  gs_free(str, GS_ALLOC_META(char, utfFile.len + 1));
   GS_FAIL_IF(!fp, "Could not open file", NULL);
 
-  InlineBytes *bytes = VAL2PTR(InlineBytes, bytesV);
-  size_t written = fwrite(bytes->bytes, 1, bytes->len, fp);
+  Bytes bytes = bytestring_bytes(bytesV);
+  size_t written = fwrite(bytes.bytes, 1, bytes.len, fp);
   fclose(fp);
-  GS_FAIL_IF(written != bytes->len, "Error writing to file", NULL);
+  GS_FAIL_IF(written != bytes.len, "Error writing to file", NULL);
+
+  GS_RET_OK;
+}
+#endif
+
+// buffered ports
+
+IMPL("port?", is_port)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  rets[0] = BOOL2VAL(is_type(args[0], PORT_TYPE));
+  GS_RET_OK;
+}
+#endif
+
+IMPL("open-input-port", open_input_port)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  Val nameV = args[0];
+  FAIL_IF_LIST(!is_string0(nameV), "Not a string", nameV);
+
+  Utf8Str utfFile = string_bytes(nameV);
+  char *str = gs_alloc(GS_ALLOC_META(char, utfFile.len + 1));
+  GS_FAIL_IF(!str, "Failed allocation", NULL);
+  memcpy(str, utfFile.bytes, utfFile.len);
+  str[utfFile.len] = 0;
+  Port *port;
+  Err *err = gs_port_open(str, false, &port);
+  gs_free(str, GS_ALLOC_META(char, utfFile.len + 1));
+  GS_TRY(err);
+  rets[0] = PTR2VAL_GC(port);
+  GS_RET_OK;
+}
+#endif
+
+// open a file for writing, creating or truncating it
+IMPL("open-output-port", open_output_port)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  Val nameV = args[0];
+  FAIL_IF_LIST(!is_string0(nameV), "Not a string", nameV);
+
+  Utf8Str utfFile = string_bytes(nameV);
+  char *str = gs_alloc(GS_ALLOC_META(char, utfFile.len + 1));
+  GS_FAIL_IF(!str, "Failed allocation", NULL);
+  memcpy(str, utfFile.bytes, utfFile.len);
+  str[utfFile.len] = 0;
+  Port *port;
+  Err *err = gs_port_open(str, true, &port);
+  gs_free(str, GS_ALLOC_META(char, utfFile.len + 1));
+  GS_TRY(err);
+  rets[0] = PTR2VAL_GC(port);
+  GS_RET_OK;
+}
+#endif
+
+// the next byte of an input port, as a number, or eof
+IMPL("read-byte", read_byte)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], PORT_TYPE), "Not a port", args[0]);
+  Port *port = VAL2PTR(Port, args[0]);
+  GS_TRY(gs_port_fill(port));
+  rets[0] = port->pos == port->end ? VAL_EOF : FIX2VAL(port->buf[port->pos++]);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("peek-byte", peek_byte)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], PORT_TYPE), "Not a port", args[0]);
+  Port *port = VAL2PTR(Port, args[0]);
+  GS_TRY(gs_port_fill(port));
+  rets[0] = port->pos == port->end ? VAL_EOF : FIX2VAL(port->buf[port->pos]);
+  GS_RET_OK;
+}
+#endif
+
+// read up to the next newline, returning the line without it as a
+// string, or eof if the port is already exhausted
+IMPL("read-line", read_line)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], PORT_TYPE), "Not a port", args[0]);
+  Port *port = VAL2PTR(Port, args[0]);
+
+  // lines that span more than one buffer are gathered here
+  u8 *acc = NULL;
+  u32 accLen = 0, accCap = 0;
+  Err *err = NULL;
+  const u8 *line;
+  u32 lineLen;
+
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) err = (X); goto cleanup;
+
+  bool newline = false;
+  while (true) {
+    GS_TRY(gs_port_fill(port));
+    if (port->pos == port->end) break;
+    u8 *start = port->buf + port->pos;
+    u32 avail = port->end - port->pos;
+    u8 *nl = memchr(start, '\n', avail);
+    u32 len = nl ? (u32) (nl - start) : avail;
+    if (nl && !acc) {
+      // the common case, where the whole line is already buffered
+      line = start;
+      lineLen = len;
+      port->pos += len + 1;
+      newline = true;
+      goto alloc;
+    }
+    if (accLen + len > accCap) {
+      u32 newCap = accCap ? accCap : 64;
+      while (newCap < accLen + len) newCap *= 2;
+      u8 *newAcc = gs_alloc(GS_ALLOC_META(u8, newCap));
+      GS_FAIL_IF(!newAcc, "Failed allocation", NULL);
+      if (acc) {
+        memcpy(newAcc, acc, accLen);
+        gs_free(acc, GS_ALLOC_META(u8, accCap));
+      }
+      acc = newAcc;
+      accCap = newCap;
+    }
+    memcpy(acc + accLen, start, len);
+    accLen += len;
+    port->pos += len;
+    if (nl) {
+      port->pos++;
+      newline = true;
+      break;
+    }
+  }
+  if (!newline && !accLen) {
+    rets[0] = VAL_EOF;
+    goto cleanup;
+  }
+  line = acc;
+  lineLen = accLen;
+
+ alloc: {
+    InlineUtf8Str *str;
+    GS_TRY(gs_string_new((Utf8Str) { (u8 *) line, lineLen }, &str));
+    rets[0] = PTR2VAL_GC(str);
+  }
+
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) GS_FAIL_HERE_DEFAULT(X)
+ cleanup:
+  if (acc) gs_free(acc, GS_ALLOC_META(u8, accCap));
+  return err;
+}
+#endif
+
+// write a string or bytestring, or the part of it from start to end,
+// to an output port
+IMPL("write-bytes", write_bytes)
+#if EMIT
+{
+  GS_FAIL_IF(argc != 2 && argc != 4, "bad argument arity, expected: 2 or 4", NULL);
+  GS_CHECK_RET_ARITY(1);
+  (void) self;
+  FAIL_IF_LIST(!is_type(args[0], PORT_TYPE), "Not a port", args[0]);
+  FAIL_IF_LIST(!is_bytestring0(args[1]) && !is_string0(args[1]), "Not a string or bytestring", args[1]);
+  Bytes bytes = is_string0(args[1]) ? string_bytes(args[1]) : bytestring_bytes(args[1]);
+  if (argc == 4) {
+    GS_FAIL_IF(!VAL_IS_FIXNUM(args[2]), "Not a number", NULL);
+    GS_FAIL_IF(!VAL_IS_FIXNUM(args[3]), "Not a number", NULL);
+    u64 start = VAL2UFIX(args[2]);
+    u64 end = VAL2UFIX(args[3]);
+    FAIL_IF_LIST(start > end || end > bytes.len, "Region out of range", args[1], args[2], args[3]);
+    bytes.bytes += start;
+    bytes.len = (u32) (end - start);
+  }
+  GS_TRY(gs_port_write(VAL2PTR(Port, args[0]), bytes));
+  rets[0] = VAL_NIL;
+  GS_RET_OK;
+}
+#endif
+
+IMPL("flush", flush)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], PORT_TYPE), "Not a port", args[0]);
+  GS_TRY(gs_port_flush(VAL2PTR(Port, args[0])));
+  rets[0] = VAL_NIL;
+  GS_RET_OK;
+}
+#endif
 
+// flush and close a port, rather than waiting for it to be collected
+IMPL("close-port", close_port)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  FAIL_IF_LIST(!is_type(args[0], PORT_TYPE), "Not a port", args[0]);
+  GS_TRY(gs_port_close(VAL2PTR(Port, args[0])));
+  rets[0] = VAL_NIL;
   GS_RET_OK;
 }
 #endif
@@ -902,15 +2441,83 @@ IMPL("index-image", index_image)
 {
   GS_CHECK_ARITY(1, 1);
   Val bytesV = args[0];
-  FAIL_IF_LIST(!is_type(bytesV, BYTESTRING_TYPE), "Not a bytestring", bytesV);
-  InlineBytes *bs = VAL2PTR(InlineBytes, bytesV);
+  FAIL_IF_LIST(!is_bytestring0(bytesV), "Not a bytestring", bytesV);
+  Bytes bs = bytestring_bytes(bytesV);
   Image *img;
-  GS_TRY(gs_index_image(bs->len, bs->bytes, &img));
+  GS_TRY(gs_index_image(bs.len, bs.bytes, &img));
   rets[0] = PTR2VAL_GC(img);
   GS_RET_OK;
 }
 #endif
 
+IMPL("live-image", live_image)
+#if EMIT
+{
+  GS_CHECK_ARITY(2, 1);
+  Val codesV = args[0];
+  Val constsV = args[1];
+  FAIL_IF_LIST(!is_list0(codesV), "Not a list", codesV);
+  FAIL_IF_LIST(!is_list0(constsV), "Not a list", constsV);
+
+  u32 codec = 0, constc = 0;
+  for (Val it = codesV; it != VAL_NIL; it = VAL2PTR(Cons, it)->cdr) {
+    Val code = VAL2PTR(Cons, it)->car;
+    FAIL_IF_LIST(
+      !is_type(code, BYTESTRING_TYPE) && !is_type(code, BYTESTRING_SLICE_TYPE),
+      "Not a bytestring",
+      code
+    );
+    codec++;
+  }
+  for (Val it = constsV; it != VAL_NIL; it = VAL2PTR(Cons, it)->cdr) constc++;
+
+  InlineBytes *codes[codec];
+  Val consts[constc];
+  u32 i = 0;
+  for (Val it = codesV; it != VAL_NIL; it = VAL2PTR(Cons, it)->cdr) {
+    Val code;
+    GS_TRY(gs_bytestring_compact(VAL2PTR(Cons, it)->car, &code));
+    codes[i++] = VAL2PTR(InlineBytes, code);
+  }
+  i = 0;
+  for (Val it = constsV; it != VAL_NIL; it = VAL2PTR(Cons, it)->cdr) {
+    consts[i++] = VAL2PTR(Cons, it)->car;
+  }
+
+  Image *img;
+  GS_TRY(gs_live_image(codec, codes, constc, consts, &img));
+  rets[0] = PTR2VAL_GC(img);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("assemble-code", assemble_code)
+#if EMIT
+{
+  GS_CHECK_ARITY(3, 1);
+  Val insns = args[0];
+  FAIL_IF_LIST(!is_list0(insns), "Not a list", insns);
+  FAIL_IF_LIST(!is_callable(args[1]), "Not a function", args[1]);
+  FAIL_IF_LIST(!is_callable(args[2]), "Not a function", args[2]);
+  InlineBytes *code;
+  GS_TRY(gs_assemble_code(insns, VAL2PTR(Closure, args[1]), VAL2PTR(Closure, args[2]), &code));
+  rets[0] = PTR2VAL_GC(code);
+  GS_RET_OK;
+}
+#endif
+
+IMPL("vm-check", vm_check)
+#if EMIT
+{
+  GS_CHECK_ARITY(1, 1);
+  Val sym = args[0];
+  FAIL_IF_LIST(!is_symbol0(sym), "Not a symbol", sym);
+  Utf8Str name = GS_DECAY_BYTES(VAL2PTR(Symbol, sym)->name);
+  rets[0] = BOOL2VAL(gs_bytes_cmp(name, GS_UTF8_CSTR("gliss")) == 0);
+  GS_RET_OK;
+}
+#endif
+
 IMPL("new-image-closure", new_image_closure)
 #if EMIT
 {
@@ -931,18 +2538,30 @@ IMPL("new-image-closure", new_image_closure)
 }
 #endif
 
+#if EMIT
+static u32 gensym_count;
+#endif
+
 IMPL("gensym", gensym)
 #if EMIT
 {
   GS_CHECK_ARITY(1, 1);
   Val nameV = args[0];
-  GS_FAIL_IF(!is_type(nameV, STRING_TYPE), "Not a string", NULL);
+  GS_FAIL_IF(!is_string0(nameV), "Not a string", NULL);
+  if (!is_type(nameV, STRING_TYPE)) {
+    // symbol names are always inline
+    InlineUtf8Str *copy;
+    GS_TRY(gs_string_new(string_bytes(nameV), &copy));
+    nameV = PTR2VAL_GC(copy);
+  }
   Symbol *uninterned;
   GS_TRY(gs_gc_alloc(SYMBOL_TYPE, (anyptr *)&uninterned));
   uninterned->fn = symbol_invoke_closure;
   uninterned->value = PTR2VAL_GC(uninterned);
   uninterned->name = VAL2PTR(InlineUtf8Str, nameV);
   uninterned->isMacro = false;
+  // distinct from every other gensym's, until the count wraps
+  uninterned->hash = ++gensym_count * 0x9e3779b9U;
   rets[0] = PTR2VAL_GC(uninterned);
   GS_RET_OK;
 }
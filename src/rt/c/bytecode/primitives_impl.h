@@ -5,8 +5,21 @@
 #include "../gc/gc_macros.h"
 #include "../logging.h"
 #include "interp.h"
+#include "assemble.h"
+#include "reader.h"
+#include "serialize.h"
+#include "port.h"
+#include "bytes_ops.h"
+#include "le_unaligned.h"
+#include "bytevector.h"
+#include "hash_map.h"
+#include "hash_table.h"
+#include "record.h"
+#include "slice.h"
+#include "utf8.h"
 #include "tck.h"
 #include <ctype.h>
+#include <time.h>
 
 extern int gs_argc;
 extern const char **gs_argv;
@@ -0,0 +1,252 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "reader.h"
+#include "primitives.h"
+#include "utf8.h"
+#include "../gc/gc.h"
+
+#include <ctype.h>
+#include <string.h>
+
+typedef struct Reader {
+  const u8 *bytes;
+  u32 len;
+  u32 pos;
+} Reader;
+
+#define AT_END(RD) ((RD)->pos >= (RD)->len)
+#define PEEK(RD) ((RD)->bytes[(RD)->pos])
+
+static bool is_ws(u8 c) {
+  return isspace(c);
+}
+
+// skip whitespace and comments, false at the end of input
+static bool skip_ws(Reader *rd) {
+  while (!AT_END(rd)) {
+    u8 c = PEEK(rd);
+    if (is_ws(c)) {
+      rd->pos++;
+    } else if (c == ';') {
+      while (!AT_END(rd) && rd->bytes[rd->pos++] != '\n');
+    } else {
+      return true;
+    }
+  }
+  return false;
+}
+
+static Err *alloc_pair(Val car, Val cdr, Val *out) {
+  Val *pair;
+  GS_TRY(gs_gc_alloc(CONS_TYPE, (anyptr *)&pair));
+  pair[0] = car;
+  pair[1] = cdr;
+  *out = PTR2VAL_GC(pair);
+  GS_RET_OK;
+}
+
+static Err *alloc_symbol(const char *name, Val *out) {
+  Symbol *sym;
+  GS_TRY(gs_intern((Utf8Str) { (u8 *) name, strlen(name) }, &sym));
+  *out = PTR2VAL_GC(sym);
+  GS_RET_OK;
+}
+
+static Err *read_datum(Reader *rd, Val *out);
+
+// (head datum)
+static Err *read_wrapped(Reader *rd, const char *head, Val *out) {
+  Val datum, headV;
+  GS_TRY(read_datum(rd, &datum));
+  GS_TRY(alloc_symbol(head, &headV));
+  GS_TRY(alloc_pair(datum, VAL_NIL, &datum));
+  GS_TRY(alloc_pair(headV, datum, out));
+  GS_RET_OK;
+}
+
+static Err *read_list_tail(Reader *rd, Val *out) {
+  Val ret = VAL_NIL, last = VAL_NIL;
+  while (true) {
+    GS_FAIL_IF(!skip_ws(rd), "Unclosed list", NULL);
+    if (PEEK(rd) == ')') {
+      rd->pos++;
+      break;
+    }
+    Val elt, pair;
+    GS_TRY(read_datum(rd, &elt));
+    GS_TRY(alloc_pair(elt, VAL_NIL, &pair));
+    if (last == VAL_NIL) {
+      ret = pair;
+    } else {
+      VAL2PTR(Cons, last)->cdr = pair;
+    }
+    last = pair;
+  }
+  *out = ret;
+  GS_RET_OK;
+}
+
+static Err *read_string_tail(Reader *rd, Val *out) {
+  // measure first, escapes only drop their backslash
+  u32 len = 0;
+  u32 pos = rd->pos;
+  while (true) {
+    GS_FAIL_IF(pos >= rd->len, "Unclosed string", NULL);
+    u8 c = rd->bytes[pos++];
+    if (c == '"') break;
+    if (c == '\\') {
+      GS_FAIL_IF(pos >= rd->len, "Unclosed string", NULL);
+      pos++;
+    }
+    len++;
+  }
+
+  InlineUtf8Str *str;
+  GS_TRY(gs_string_alloc(len, &str));
+  u8 *it = str->bytes;
+  while (true) {
+    u8 c = rd->bytes[rd->pos++];
+    if (c == '"') break;
+    if (c == '\\') c = rd->bytes[rd->pos++];
+    *it++ = c;
+  }
+  GS_TRY(gs_string_seal(str));
+  *out = PTR2VAL_GC(str);
+  GS_RET_OK;
+}
+
+static bool token_eq(Utf8Str tok, const char *str) {
+  size_t len = strlen(str);
+  return tok.len == len && memcmp(tok.bytes, str, len) == 0;
+}
+
+static bool is_digit(u8 c) {
+  return c >= '0' && c <= '9';
+}
+
+static Err *read_token(Reader *rd, Val *out) {
+  u32 start = rd->pos;
+  while (!AT_END(rd)) {
+    u8 c = PEEK(rd);
+    if (is_ws(c) || c == ')' || c == '(' || c == '"') break;
+    rd->pos++;
+    if (c == '\\') {
+      GS_FAIL_IF(AT_END(rd), "Unexpected EOF reading token", NULL);
+      rd->pos++;
+    }
+  }
+  Utf8Str tok = { (u8 *) rd->bytes + start, rd->pos - start };
+  GS_FAIL_IF(tok.len == 0, "Unexpected )", NULL);
+
+  if (token_eq(tok, "true") || token_eq(tok, "#true")) {
+    *out = VAL_TRUE;
+  } else if (token_eq(tok, "false") || token_eq(tok, "#false")) {
+    *out = VAL_FALSE;
+  } else if (token_eq(tok, "nil")) {
+    *out = VAL_NIL;
+  } else if (tok.len >= 2 && tok.bytes[0] == '#' && tok.bytes[1] == '\\') {
+    Utf8Str charStr = { tok.bytes + 2, tok.len - 2 };
+    u32 cpLen, c;
+    if (gs_utf8_validate(charStr, &cpLen) && cpLen == 1) {
+      gs_utf8_decode(charStr.bytes, &c);
+      *out = CHAR2VAL(c);
+    } else if (token_eq(charStr, "newline")) {
+      *out = CHAR2VAL('\n');
+    } else if (token_eq(charStr, "space")) {
+      *out = CHAR2VAL(' ');
+    } else {
+      GS_FAILWITH("Unrecognised character", NULL);
+    }
+  } else if (is_digit(tok.bytes[0]) ||
+             (tok.len > 1 &&
+              (tok.bytes[0] == '-' || tok.bytes[0] == '+') &&
+              is_digit(tok.bytes[1]))) {
+    GS_TRY(gs_parse_number(tok, out));
+  } else {
+    Symbol *sym;
+    GS_TRY(gs_intern(tok, &sym));
+    *out = PTR2VAL_GC(sym);
+  }
+  GS_RET_OK;
+}
+
+static Err *read_datum(Reader *rd, Val *out) {
+  if (!skip_ws(rd)) {
+    *out = VAL_EOF;
+    GS_RET_OK;
+  }
+  switch (PEEK(rd)) {
+    case '(':
+      rd->pos++;
+      return read_list_tail(rd, out);
+    case '"':
+      rd->pos++;
+      return read_string_tail(rd, out);
+    case '\'':
+      rd->pos++;
+      return read_wrapped(rd, "quote", out);
+    case '`':
+      rd->pos++;
+      return read_wrapped(rd, "quasiquote", out);
+    case '~':
+      rd->pos++;
+      if (!AT_END(rd) && PEEK(rd) == '@') {
+        rd->pos++;
+        return read_wrapped(rd, "unquote-splicing", out);
+      }
+      return read_wrapped(rd, "unquote", out);
+    default:
+      return read_token(rd, out);
+  }
+}
+
+Err *gs_read_datum(Utf8Str src, u32 *pos, Val *out) {
+  Reader rd = { src.bytes, src.len, *pos };
+  GS_TRY(read_datum(&rd, out));
+  *pos = rd.pos;
+  GS_RET_OK;
+}
+
+Err *gs_parse_number(Utf8Str str, Val *out) {
+  char *it = (char *) str.bytes;
+  char *end = it + str.len;
+  GS_FAIL_IF(it == end, "Empty string", NULL);
+  i8 sign = 1;
+  if (*it == '-' || *it == '+') {
+    sign = *it == '-' ? -1 : +1;
+    ++it;
+  }
+
+  bool hasDigits = false;
+  u64 absVal = 0;
+  for (; it != end; ++it) {
+    if (*it == '_') continue;
+    GS_FAIL_IF(*it < '0' || *it > '9', "Invalid character for number", NULL);
+    hasDigits = true;
+    u64 newVal = absVal * 10 + (*it - '0');
+    GS_FAIL_IF(newVal < absVal, "Integer literal too large", NULL);
+    absVal = newVal;
+  }
+
+  GS_FAIL_IF(!hasDigits, "No digits", NULL);
+  GS_FAIL_IF(absVal >> 63 == 1, "Integer literal too large", NULL);
+
+  i64 retV = sign * (i64) absVal;
+  *out = FIX2VAL(retV);
+  GS_RET_OK;
+}
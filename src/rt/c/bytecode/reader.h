@@ -0,0 +1,35 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "../rt.h"
+
+/**
+ * Read one datum from src, starting at *pos, with the same rules as
+ * `read` in grt.gs, and advance *pos past it. out is set to VAL_EOF
+ * if there is nothing but whitespace and comments left.
+ *
+ * Symbols are interned, and strings are copied out of src, so src
+ * need not outlive the result.
+ */
+Err *gs_read_datum(Utf8Str src, u32 *pos, Val *out);
+
+/**
+ * Parse a number token, as read or `string->number` do: an optional
+ * sign, then decimal digits, which may be separated by underscores.
+ */
+Err *gs_parse_number(Utf8Str str, Val *out);
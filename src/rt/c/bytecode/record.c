@@ -0,0 +1,218 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "record.h"
+#include "../gc/gc.h"
+#include "tck.h"
+
+#include <string.h>
+
+u32 gs_record_typec = 0;
+
+// field offsets are u16
+#define MAX_FIELDS ((UINT16_MAX - sizeof(Record)) / sizeof(Val))
+
+Err *gs_record_type_register(RecordType *rt) {
+  GS_FAIL_IF(rt->fieldc > MAX_FIELDS, "Too many record fields", NULL);
+  u32 fieldc = rt->fieldc + 1;
+  Field *fields = gs_alloc(GS_ALLOC_META(Field, fieldc));
+  GS_FAIL_IF(!fields, "Allocation failed", NULL);
+  fields[0] = (Field) {
+    .offset = offsetof(Record, type),
+    .size = sizeof(RecordType *),
+    .name = GS_UTF8_CSTR("type"),
+    .gc = FieldGcRaw,
+  };
+  for (u32 i = 1; i < fieldc; ++i) {
+    fields[i] = (Field) {
+      .offset = offsetof(Record, slots) + (i - 1) * sizeof(Val),
+      .size = sizeof(Val),
+      .name = GS_UTF8_CSTR("slot"),
+      .gc = FieldGcTagged,
+    };
+  }
+  TypeInfo info = {
+    .layout = {
+      .align = alignof(Record),
+      .size = sizeof(Record) + rt->fieldc * sizeof(Val),
+      .resizable = { .field = 0, .offset = 0 },
+      .fieldc = fieldc,
+      .fields = fields,
+    },
+    .protos = {NULL, NULL, 0},
+    .name = GS_UTF8_CSTR("record"),
+  };
+  TypeIdx ty;
+  GS_TRY(gs_gc_push_type(info, &ty));
+  gs_record_typec++;
+  rt->ty = ty;
+  GS_RET_OK;
+}
+
+Err *gs_record_type_name(RecordType *rt) {
+  GS_FAIL_IF(!is_symbol0(rt->name), "Record type name is not a symbol", NULL);
+  InlineUtf8Str *name = VAL2PTR(Symbol, rt->name)->name;
+  u8 *bytes = gs_alloc(GS_ALLOC_META(u8, name->len));
+  GS_FAIL_IF(!bytes && name->len, "Allocation failed", NULL);
+  memcpy(bytes, name->bytes, name->len);
+  gs_global_gc->types[rt->ty].name = (Utf8Str) { bytes, name->len };
+  GS_RET_OK;
+}
+
+Err *gs_record_type_new(Val name, Val fields, RecordType **out) {
+  u32 fieldc = 0;
+  Val iter = fields;
+  for (; is_type(iter, CONS_TYPE); iter = VAL2PTR(Cons, iter)->cdr) {
+    GS_FAIL_IF(!is_symbol0(VAL2PTR(Cons, iter)->car), "Record field is not a symbol", NULL);
+    fieldc++;
+  }
+  GS_FAIL_IF(iter != VAL_NIL, "Record fields are not a list", NULL);
+  GS_FAIL_IF(!is_symbol0(name), "Record type name is not a symbol", NULL);
+  RecordType *rt;
+  GS_TRY(gs_gc_alloc(RECORD_TYPE_TYPE, (anyptr *)&rt));
+  rt->fieldc = fieldc;
+  rt->name = name;
+  rt->fields = fields;
+  GS_TRY(gs_record_type_register(rt));
+  GS_TRY(gs_record_type_name(rt));
+  *out = rt;
+  GS_RET_OK;
+}
+
+Err *gs_record_field_index(RecordType *rt, Val field, u32 *out) {
+  u32 idx = 0;
+  for (Val iter = rt->fields; iter != VAL_NIL; iter = VAL2PTR(Cons, iter)->cdr, ++idx) {
+    if (VAL2PTR(Cons, iter)->car == field) {
+      *out = idx;
+      GS_RET_OK;
+    }
+  }
+  GS_FAILWITH("No such record field", NULL);
+}
+
+// the record type a record closure was made for
+#define CLOSURE_TYPE(SELF) VAL2PTR(RecordType, ((NativeClosure *) (SELF))->captured[0])
+// the field index a record closure was made for, if any
+#define CLOSURE_FIELD(SELF, I) VAL2UFIX(((NativeClosure *) (SELF))->captured[I])
+
+static bool is_record_of(RecordType *rt, Val val) {
+  return VAL_IS_GC_PTR(val) && gs_gc_typeinfo(VAL2PTR(u8, val)) == rt->ty;
+}
+
+// captured: the record type, then the field index of each argument
+static Err *record_construct(GS_CLOSURE_ARGS) {
+  GS_CHECK_RET_ARITY(1);
+  NativeClosure *cls = (NativeClosure *) self;
+  RecordType *rt = CLOSURE_TYPE(self);
+  GS_FAIL_IF(argc != cls->len - 1, "bad argument arity for record constructor", NULL);
+  Record *rec;
+  GS_TRY(gs_gc_alloc(rt->ty, (anyptr *)&rec));
+  rec->type = rt;
+  for (u32 i = 0; i < rt->fieldc; ++i) rec->slots[i] = VAL_NIL;
+  for (u32 i = 0; i < argc; ++i) rec->slots[CLOSURE_FIELD(self, i + 1)] = args[i];
+  rets[0] = PTR2VAL_GC(rec);
+  GS_RET_OK;
+}
+
+// captured: the record type
+static Err *record_predicate(GS_CLOSURE_ARGS) {
+  GS_CHECK_ARITY(1, 1);
+  rets[0] = BOOL2VAL(is_record_of(CLOSURE_TYPE(self), args[0]));
+  GS_RET_OK;
+}
+
+// captured: the record type, then the field index
+static Err *record_access(GS_CLOSURE_ARGS) {
+  GS_CHECK_ARITY(1, 1);
+  RecordType *rt = CLOSURE_TYPE(self);
+  if (!is_record_of(rt, args[0])) {
+    GS_FAILWITH_VAL_MSG("Not a record of the right type", args[0]);
+  }
+  rets[0] = VAL2PTR(Record, args[0])->slots[CLOSURE_FIELD(self, 1)];
+  GS_RET_OK;
+}
+
+// captured: the record type, then the field index
+static Err *record_modify(GS_CLOSURE_ARGS) {
+  GS_CHECK_ARITY(2, 1);
+  RecordType *rt = CLOSURE_TYPE(self);
+  if (!is_record_of(rt, args[0])) {
+    GS_FAILWITH_VAL_MSG("Not a record of the right type", args[0]);
+  }
+  Record *rec = VAL2PTR(Record, args[0]);
+  Val *target = &rec->slots[CLOSURE_FIELD(self, 1)];
+  if (VAL_IS_GC_PTR(args[1])) {
+    GS_TRY(gs_gc_write_barrier(rec, target, VAL2PTR(u8, args[1]), FieldGcTagged));
+  }
+  rets[0] = *target = args[1];
+  GS_RET_OK;
+}
+
+const ClosureFn gs_record_fns[] = {
+  record_construct,
+  record_predicate,
+  record_access,
+  record_modify,
+};
+const u32 gs_record_fnc = sizeof(gs_record_fns) / sizeof(ClosureFn);
+
+static Err *alloc_closure(ClosureFn fn, RecordType *rt, u32 len, NativeClosure **out) {
+  GS_TRY(gs_gc_alloc_array(NATIVE_CLOSURE_TYPE, len, (anyptr *)out));
+  (*out)->parent.call = fn;
+  (*out)->captured[0] = PTR2VAL_GC(rt);
+  GS_RET_OK;
+}
+
+Err *gs_record_constructor(RecordType *rt, Val fields, Val *out) {
+  u32 argc = 0;
+  Val iter = fields;
+  for (; is_type(iter, CONS_TYPE); iter = VAL2PTR(Cons, iter)->cdr) argc++;
+  GS_FAIL_IF(iter != VAL_NIL, "Constructor fields are not a list", NULL);
+  NativeClosure *cls;
+  GS_TRY(alloc_closure(record_construct, rt, argc + 1, &cls));
+  iter = fields;
+  for (u32 i = 1; i <= argc; ++i, iter = VAL2PTR(Cons, iter)->cdr) {
+    u32 idx;
+    GS_TRY(gs_record_field_index(rt, VAL2PTR(Cons, iter)->car, &idx));
+    cls->captured[i] = FIX2VAL(idx);
+  }
+  *out = PTR2VAL_GC(cls);
+  GS_RET_OK;
+}
+
+Err *gs_record_predicate(RecordType *rt, Val *out) {
+  NativeClosure *cls;
+  GS_TRY(alloc_closure(record_predicate, rt, 1, &cls));
+  *out = PTR2VAL_GC(cls);
+  GS_RET_OK;
+}
+
+Err *gs_record_accessor(RecordType *rt, u32 idx, Val *out) {
+  NativeClosure *cls;
+  GS_TRY(alloc_closure(record_access, rt, 2, &cls));
+  cls->captured[1] = FIX2VAL(idx);
+  *out = PTR2VAL_GC(cls);
+  GS_RET_OK;
+}
+
+Err *gs_record_modifier(RecordType *rt, u32 idx, Val *out) {
+  NativeClosure *cls;
+  GS_TRY(alloc_closure(record_modify, rt, 2, &cls));
+  cls->captured[1] = FIX2VAL(idx);
+  *out = PTR2VAL_GC(cls);
+  GS_RET_OK;
+}
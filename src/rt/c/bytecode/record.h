@@ -0,0 +1,57 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "primitives.h"
+
+/**
+ * Record types, defined at runtime.
+ *
+ * Each record type registers its own GC type, whose objects hold a
+ * pointer to their RecordType followed by one tagged slot per field.
+ * Constructors, predicates, accessors and modifiers are native
+ * closures over the RecordType, so they survive snapshots, which
+ * register the types of the records they load afresh.
+ */
+
+// the layout of the GC type of every record type
+typedef struct Record {
+  RecordType *type;
+  Val slots[];
+} Record;
+
+// the number of GC types that belong to record types; these are
+// always the last to be registered
+extern u32 gs_record_typec;
+
+// the native functions of record closures, for snapshots
+extern const ClosureFn gs_record_fns[];
+extern const u32 gs_record_fnc;
+
+// register a GC type for records of rt, setting rt->ty; the name is
+// filled in by gs_record_type_name once rt->name can be read
+Err *gs_record_type_register(RecordType *rt);
+// copy the name of rt into the name of its GC type
+Err *gs_record_type_name(RecordType *rt);
+Err *gs_record_type_new(Val name, Val fields, RecordType **out);
+// the index of field in rt, failing if it has no such field
+Err *gs_record_field_index(RecordType *rt, Val field, u32 *out);
+
+Err *gs_record_constructor(RecordType *rt, Val fields, Val *out);
+Err *gs_record_predicate(RecordType *rt, Val *out);
+Err *gs_record_accessor(RecordType *rt, u32 idx, Val *out);
+Err *gs_record_modifier(RecordType *rt, u32 idx, Val *out);
@@ -0,0 +1,398 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "serialize.h"
+#include "bytevector.h"
+#include "utf8.h"
+#include "../gc/gc.h"
+#include "tck.h"
+
+#include <string.h>
+
+static const u8 SERIAL_MAGIC[4] = { 'g', 'l', 's', 'd' };
+
+enum SerialTag {
+  StFixnum,
+  StChar,
+  // nil or a boolean, as its raw word
+  StConst,
+  StString,
+  StBytestring,
+  StSymbol,
+  // car, then the cdr follows as the next value
+  StCons,
+  StVector,
+  // an object already written, by number
+  StRef,
+};
+
+typedef struct Writer {
+  ByteVector *bv;
+  u32 objc;
+
+  // open-addressed map from objects to their number
+  anyptr *keys;
+  u32 *idxs;
+  u32 mapCap;
+} Writer;
+
+static u32 hash_ptr(anyptr ptr, u32 cap) {
+  u64 h = (u64) (uptr) ptr;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (u32) h & (cap - 1);
+}
+
+static bool writer_find(Writer *wr, anyptr obj, u32 *slot) {
+  u32 i = hash_ptr(obj, wr->mapCap);
+  while (wr->keys[i]) {
+    if (wr->keys[i] == obj) {
+      *slot = i;
+      return true;
+    }
+    i = (i + 1) & (wr->mapCap - 1);
+  }
+  *slot = i;
+  return false;
+}
+
+static Err *writer_grow(Writer *wr) {
+  u32 oldMapCap = wr->mapCap;
+  anyptr *oldKeys = wr->keys;
+  u32 *oldIdxs = wr->idxs;
+  wr->mapCap = oldMapCap * 2;
+  wr->keys = gs_alloc(GS_ALLOC_META(anyptr, wr->mapCap));
+  wr->idxs = gs_alloc(GS_ALLOC_META(u32, wr->mapCap));
+  GS_FAIL_IF(!wr->keys || !wr->idxs, "Allocation failed", NULL);
+  memset(wr->keys, 0, wr->mapCap * sizeof(anyptr));
+  for (u32 i = 0; i < oldMapCap; ++i) {
+    if (!oldKeys[i]) continue;
+    u32 slot;
+    writer_find(wr, oldKeys[i], &slot);
+    wr->keys[slot] = oldKeys[i];
+    wr->idxs[slot] = oldIdxs[i];
+  }
+  gs_free(oldKeys, GS_ALLOC_META(anyptr, oldMapCap));
+  gs_free(oldIdxs, GS_ALLOC_META(u32, oldMapCap));
+  GS_RET_OK;
+}
+
+static Err *write_bytes(Writer *wr, const u8 *bytes, u32 len) {
+  u8 *dst;
+  GS_TRY(gs_bytevector_reserve(wr->bv, len, &dst));
+  memcpy(dst, bytes, len);
+  GS_RET_OK;
+}
+
+static Err *write_varint(Writer *wr, u64 value) {
+  u8 enc[10];
+  u32 len = 0;
+  do {
+    u8 byte = value & 0x7F;
+    value >>= 7;
+    enc[len++] = byte | (value ? 0x80 : 0);
+  } while (value);
+  return write_bytes(wr, enc, len);
+}
+
+static Err *write_tag(Writer *wr, enum SerialTag tag) {
+  u8 byte = tag;
+  return write_bytes(wr, &byte, 1);
+}
+
+static Err *write_counted(Writer *wr, enum SerialTag tag, Bytes bytes) {
+  GS_TRY(write_tag(wr, tag));
+  GS_TRY(write_varint(wr, bytes.len));
+  return write_bytes(wr, bytes.bytes, bytes.len);
+}
+
+// write a reference and set seen if obj was written before, else
+// number it
+static Err *write_seen(Writer *wr, anyptr obj, bool *seen) {
+  u32 slot;
+  if ((*seen = writer_find(wr, obj, &slot))) {
+    GS_TRY(write_tag(wr, StRef));
+    return write_varint(wr, wr->idxs[slot]);
+  }
+  if (wr->objc * 2 >= wr->mapCap) {
+    GS_TRY(writer_grow(wr));
+    writer_find(wr, obj, &slot);
+  }
+  wr->keys[slot] = obj;
+  wr->idxs[slot] = wr->objc++;
+  GS_RET_OK;
+}
+
+// the constants a program can see, eof being a fixnum; others, like
+// hash table slot markers, are never values and must not be made from
+// serialized data
+static bool is_value_const(Val val) {
+  return val == VAL_NIL || val == VAL_TRUE || val == VAL_FALSE;
+}
+
+static Err *write_value(Writer *wr, Val val) {
+  // loop along cdrs
+  while (true) {
+    if (VAL_IS_FIXNUM(val)) {
+      i64 fix = VAL2SFIX(val);
+      GS_TRY(write_tag(wr, StFixnum));
+      return write_varint(wr, ((u64) fix << 1) ^ (u64) (fix >> 63));
+    }
+    if (VAL_IS_CHAR(val)) {
+      GS_TRY(write_tag(wr, StChar));
+      return write_varint(wr, VAL2CHAR(val));
+    }
+    if (is_value_const(val)) {
+      GS_TRY(write_tag(wr, StConst));
+      return write_varint(wr, val);
+    }
+    if (!VAL_IS_GC_PTR(val)) break;
+
+    bool seen;
+    if (is_string0(val)) {
+      GS_TRY(write_seen(wr, VAL2PTR(u8, val), &seen));
+      if (seen) GS_RET_OK;
+      return write_counted(wr, StString, string_bytes(val));
+    }
+    if (is_bytestring0(val)) {
+      GS_TRY(write_seen(wr, VAL2PTR(u8, val), &seen));
+      if (seen) GS_RET_OK;
+      return write_counted(wr, StBytestring, bytestring_bytes(val));
+    }
+    switch (gs_gc_typeinfo(VAL2PTR(u8, val))) {
+    case SYMBOL_TYPE: {
+      Symbol *sym = VAL2PTR(Symbol, val);
+      GS_TRY(write_seen(wr, sym, &seen));
+      if (seen) GS_RET_OK;
+      return write_counted(wr, StSymbol, GS_DECAY_BYTES(sym->name));
+    }
+    case CONS_TYPE: {
+      Cons *pair = VAL2PTR(Cons, val);
+      GS_TRY(write_seen(wr, pair, &seen));
+      if (seen) GS_RET_OK;
+      GS_TRY(write_tag(wr, StCons));
+      GS_TRY(write_value(wr, pair->car));
+      val = pair->cdr;
+      continue;
+    }
+    case ARRAY_TYPE: {
+      Array *vec = VAL2PTR(Array, val);
+      GS_TRY(write_seen(wr, vec, &seen));
+      if (seen) GS_RET_OK;
+      GS_TRY(write_tag(wr, StVector));
+      GS_TRY(write_varint(wr, vec->len));
+      for (u32 i = 0; i < vec->len; ++i) {
+        GS_TRY(write_value(wr, vec->data[i]));
+      }
+      GS_RET_OK;
+    }
+    }
+    break;
+  }
+  GS_FAILWITH_VAL_MSG("Cannot serialize value", val);
+}
+
+Err *gs_serialize(Val val, InlineBytes **out) {
+  Writer wr;
+  wr.objc = 0;
+  wr.mapCap = 64;
+  wr.keys = gs_alloc(GS_ALLOC_META(anyptr, wr.mapCap));
+  wr.idxs = gs_alloc(GS_ALLOC_META(u32, wr.mapCap));
+  GS_FAIL_IF(!wr.keys || !wr.idxs, "Allocation failed", NULL);
+  memset(wr.keys, 0, wr.mapCap * sizeof(anyptr));
+
+  Err *err = NULL;
+
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) err = (X); goto cleanup;
+
+  GS_TRY(gs_bytevector_alloc(64, &wr.bv));
+  GS_TRY(write_bytes(&wr, SERIAL_MAGIC, sizeof(SERIAL_MAGIC)));
+  GS_TRY(write_varint(&wr, GS_SERIAL_VERSION));
+  GS_TRY(write_value(&wr, val));
+  GS_TRY(gs_bytevector_take(wr.bv, out));
+
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) GS_FAIL_HERE_DEFAULT(X)
+ cleanup:
+  gs_free(wr.keys, GS_ALLOC_META(anyptr, wr.mapCap));
+  gs_free(wr.idxs, GS_ALLOC_META(u32, wr.mapCap));
+  return err;
+}
+
+typedef struct Reader {
+  Bytes bytes;
+  u32 pos;
+
+  // objects in the order they were numbered
+  Val *objs;
+  u32 objc;
+  u32 objCap;
+} Reader;
+
+static Err *read_bytes(Reader *rd, u32 len, const u8 **out) {
+  GS_FAIL_IF(rd->bytes.len - rd->pos < len, "Truncated serialized data", NULL);
+  *out = rd->bytes.bytes + rd->pos;
+  rd->pos += len;
+  GS_RET_OK;
+}
+
+static Err *read_varint(Reader *rd, u64 *out) {
+  u64 value = 0;
+  for (u32 shift = 0; shift < 64; shift += 7) {
+    const u8 *byte;
+    GS_TRY(read_bytes(rd, 1, &byte));
+    value |= (u64) (*byte & 0x7F) << shift;
+    if (!(*byte & 0x80)) {
+      *out = value;
+      GS_RET_OK;
+    }
+  }
+  GS_FAILWITH("Malformed varint in serialized data", NULL);
+}
+
+// a length, which can be no more than the bytes left, since every
+// byte or element takes at least one
+static Err *read_len(Reader *rd, u32 *out) {
+  u64 len;
+  GS_TRY(read_varint(rd, &len));
+  GS_FAIL_IF(len > rd->bytes.len - rd->pos, "Truncated serialized data", NULL);
+  *out = (u32) len;
+  GS_RET_OK;
+}
+
+static Err *reader_push(Reader *rd, Val obj) {
+  if (rd->objc == rd->objCap) {
+    u32 newCap = rd->objCap * 2;
+    rd->objs = gs_realloc(rd->objs, GS_ALLOC_META(Val, rd->objCap), GS_ALLOC_META(Val, newCap));
+    GS_FAIL_IF(!rd->objs, "Allocation failed", NULL);
+    rd->objCap = newCap;
+  }
+  rd->objs[rd->objc++] = obj;
+  GS_RET_OK;
+}
+
+static Err *read_value(Reader *rd, Val *out) {
+  // loop along cdrs, with out the slot to fill next
+  while (true) {
+    const u8 *tag;
+    GS_TRY(read_bytes(rd, 1, &tag));
+    u64 word;
+    u32 len;
+    const u8 *bytes;
+    switch (*tag) {
+    case StFixnum:
+      GS_TRY(read_varint(rd, &word));
+      *out = FIX2VAL((i64) (word >> 1) ^ -(i64) (word & 1));
+      GS_RET_OK;
+    case StChar:
+      GS_TRY(read_varint(rd, &word));
+      GS_FAIL_IF(word > 0x10FFFF, "Bad char in serialized data", NULL);
+      *out = CHAR2VAL(word);
+      GS_RET_OK;
+    case StConst:
+      GS_TRY(read_varint(rd, &word));
+      GS_FAIL_IF(!is_value_const(word), "Bad constant in serialized data", NULL);
+      *out = word;
+      GS_RET_OK;
+    case StString: {
+      GS_TRY(read_len(rd, &len));
+      GS_TRY(read_bytes(rd, len, &bytes));
+      InlineUtf8Str *str;
+      GS_TRY(gs_string_new((Utf8Str) { (u8 *) bytes, len }, &str));
+      *out = PTR2VAL_GC(str);
+      return reader_push(rd, *out);
+    }
+    case StBytestring: {
+      GS_TRY(read_len(rd, &len));
+      GS_TRY(read_bytes(rd, len, &bytes));
+      InlineBytes *bs;
+      GS_TRY(gs_gc_alloc_array(BYTESTRING_TYPE, len, (anyptr *)&bs));
+      memcpy(bs->bytes, bytes, len);
+      *out = PTR2VAL_GC(bs);
+      return reader_push(rd, *out);
+    }
+    case StSymbol: {
+      GS_TRY(read_len(rd, &len));
+      GS_TRY(read_bytes(rd, len, &bytes));
+      Symbol *sym;
+      GS_TRY(gs_intern((Utf8Str) { (u8 *) bytes, len }, &sym));
+      *out = PTR2VAL_GC(sym);
+      return reader_push(rd, *out);
+    }
+    case StCons: {
+      Cons *pair;
+      GS_TRY(gs_gc_alloc(CONS_TYPE, (anyptr *)&pair));
+      pair->car = pair->cdr = VAL_NIL;
+      *out = PTR2VAL_GC(pair);
+      GS_TRY(reader_push(rd, *out));
+      GS_TRY(read_value(rd, &pair->car));
+      out = &pair->cdr;
+      continue;
+    }
+    case StVector: {
+      GS_TRY(read_len(rd, &len));
+      Array *vec;
+      GS_TRY(gs_gc_alloc_array(ARRAY_TYPE, len, (anyptr *)&vec));
+      for (u32 i = 0; i < len; ++i) vec->data[i] = VAL_NIL;
+      *out = PTR2VAL_GC(vec);
+      GS_TRY(reader_push(rd, *out));
+      for (u32 i = 0; i < len; ++i) {
+        GS_TRY(read_value(rd, &vec->data[i]));
+      }
+      GS_RET_OK;
+    }
+    case StRef:
+      GS_TRY(read_varint(rd, &word));
+      GS_FAIL_IF(word >= rd->objc, "Bad reference in serialized data", NULL);
+      *out = rd->objs[word];
+      GS_RET_OK;
+    default:
+      GS_FAILWITH("Bad tag in serialized data", NULL);
+    }
+  }
+}
+
+Err *gs_deserialize(Bytes bytes, Val *out) {
+  GS_FAIL_IF(bytes.len < sizeof(SERIAL_MAGIC) ||
+             memcmp(bytes.bytes, SERIAL_MAGIC, sizeof(SERIAL_MAGIC)) != 0,
+             "Not serialized data", NULL);
+  Reader rd;
+  rd.bytes = bytes;
+  rd.pos = sizeof(SERIAL_MAGIC);
+  rd.objc = 0;
+  rd.objCap = 64;
+  rd.objs = gs_alloc(GS_ALLOC_META(Val, rd.objCap));
+  GS_FAIL_IF(!rd.objs, "Allocation failed", NULL);
+
+  Err *err = NULL;
+
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) err = (X); goto cleanup;
+
+  u64 version;
+  GS_TRY(read_varint(&rd, &version));
+  GS_FAIL_IF(version != GS_SERIAL_VERSION, "Unsupported serialized data version", NULL);
+  GS_TRY(read_value(&rd, out));
+  GS_FAIL_IF(rd.pos != bytes.len, "Trailing bytes after serialized data", NULL);
+
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) GS_FAIL_HERE_DEFAULT(X)
+ cleanup:
+  gs_free(rd.objs, GS_ALLOC_META(Val, rd.objCap));
+  return err;
+}
@@ -0,0 +1,49 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "primitives.h"
+
+/**
+ * Binary serialisation of plain data.
+ *
+ * A serialised value is a magic number and version, followed by the
+ * value in prefix order: a tag byte, then its contents. Numbers and
+ * lengths are LEB128 varints, with fixnums zigzagged so that small
+ * negative ones stay short.
+ *
+ * Fixnums, chars, constants (nil, booleans, eof), strings,
+ * bytestrings, symbols, conses and vectors can be serialised; symbols
+ * are written by name and interned when read. Every string,
+ * bytestring, symbol, cons and vector is numbered in the order it is
+ * first written, and written again only as a reference to that
+ * number, so shared structure stays shared and cycles through conses
+ * or vectors can be read back.
+ *
+ * Lists are written along their cdrs without recursing, so only
+ * nesting, not length, is limited by the C stack.
+ */
+
+#define GS_SERIAL_VERSION 1
+
+Err *gs_serialize(Val val, InlineBytes **out);
+
+/**
+ * Read back a value written by gs_serialize, failing if the bytes are
+ * malformed or have anything after the value.
+ */
+Err *gs_deserialize(Bytes bytes, Val *out);
@@ -0,0 +1,91 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "slice.h"
+#include "utf8.h"
+#include "../gc/gc.h"
+#include "tck.h"
+
+#include <string.h>
+
+Err *gs_string_slice(Val str, u32 cpStart, u32 cpLen, Val *out) {
+  u32 start, end;
+  GS_TRY(gs_string_cp_offset(str, cpStart, &start));
+  GS_TRY(gs_string_cp_offset(str, cpStart + cpLen, &end));
+  anyptr owner = VAL2PTR(u8, str);
+  u32 offset = 0, cpOffset = 0;
+  if (is_type(str, STRING_SLICE_TYPE)) {
+    StringSlice *of = owner;
+    owner = of->owner;
+    offset = of->offset;
+    cpOffset = of->cpOffset;
+  }
+  StringSlice *sl;
+  GS_TRY(gs_gc_alloc(STRING_SLICE_TYPE, (anyptr *)&sl));
+  GS_TRY(gs_gc_write_barrier(sl, &sl->owner, owner, FieldGcRaw));
+  sl->owner = owner;
+  sl->offset = offset + start;
+  sl->len = end - start;
+  sl->cpOffset = cpOffset + cpStart;
+  sl->cpLen = cpLen;
+  *out = PTR2VAL_GC(sl);
+  GS_RET_OK;
+}
+
+Err *gs_bytestring_slice(Val bs, u32 start, u32 len, Val *out) {
+  anyptr owner = VAL2PTR(u8, bs);
+  u32 offset = 0;
+  if (is_type(bs, BYTESTRING_SLICE_TYPE)) {
+    BytesSlice *of = owner;
+    owner = of->owner;
+    offset = of->offset;
+  }
+  BytesSlice *sl;
+  GS_TRY(gs_gc_alloc(BYTESTRING_SLICE_TYPE, (anyptr *)&sl));
+  GS_TRY(gs_gc_write_barrier(sl, &sl->owner, owner, FieldGcRaw));
+  sl->owner = owner;
+  sl->offset = offset + start;
+  sl->len = len;
+  *out = PTR2VAL_GC(sl);
+  GS_RET_OK;
+}
+
+Err *gs_string_compact(Val str, Val *out) {
+  if (!is_type(str, STRING_SLICE_TYPE)) {
+    *out = str;
+    GS_RET_OK;
+  }
+  InlineUtf8Str *copy;
+  GS_TRY(gs_string_alloc(VAL2PTR(StringSlice, str)->len, &copy));
+  Utf8Str bytes = string_bytes(str);
+  memcpy(copy->bytes, bytes.bytes, bytes.len);
+  copy->cpLen = VAL2PTR(StringSlice, str)->cpLen;
+  *out = PTR2VAL_GC(copy);
+  GS_RET_OK;
+}
+
+Err *gs_bytestring_compact(Val bs, Val *out) {
+  if (!is_type(bs, BYTESTRING_SLICE_TYPE)) {
+    *out = bs;
+    GS_RET_OK;
+  }
+  InlineBytes *copy;
+  GS_TRY(gs_gc_alloc_array(BYTESTRING_TYPE, VAL2PTR(BytesSlice, bs)->len, (anyptr *)&copy));
+  Bytes bytes = bytestring_bytes(bs);
+  memcpy(copy->bytes, bytes.bytes, bytes.len);
+  *out = PTR2VAL_GC(copy);
+  GS_RET_OK;
+}
@@ -0,0 +1,39 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "primitives.h"
+
+/**
+ * Slice a string or bytestring, which must satisfy is_string0 or
+ * is_bytestring0 respectively, without copying its contents. Strings
+ * are sliced by code point and bytestrings by byte. Slicing a slice
+ * makes a slice of its owner, so a slice only ever keeps one object
+ * alive.
+ *
+ * The range must be in bounds.
+ */
+Err *gs_string_slice(Val str, u32 cpStart, u32 cpLen, Val *out);
+Err *gs_bytestring_slice(Val bs, u32 start, u32 len, Val *out);
+
+/**
+ * Copy the contents of a slice into a fresh string or bytestring, so
+ * that it no longer keeps its owner alive. Anything other than a
+ * slice is returned as is.
+ */
+Err *gs_string_compact(Val str, Val *out);
+Err *gs_bytestring_compact(Val bs, Val *out);
@@ -0,0 +1,641 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "snapshot.h"
+#include "image.h"
+#include "interp.h"
+#include "primitives.h"
+#include "port.h"
+#include "hash_table.h"
+#include "record.h"
+#include "../gc/gc.h"
+#include "../gc/gc_macros.h"
+#include "../logging.h"
+
+#include <string.h>
+
+typedef struct SnapshotHeader {
+  u8 magic[8];
+  u32 version;
+  u32 typec;
+  u32 fnc;
+  u32 objc;
+  u64 imageHash;
+  // object index of the symbol table
+  u64 symTable;
+} SnapshotHeader;
+
+enum SnapshotFlags {
+  // allocate as a large object, so it does not move
+  SfLarge = 1,
+};
+
+// followed by the object's fields, padded to 8 bytes
+typedef struct SnapshotObject {
+  u32 ty;
+  // length of the resizable field, if any
+  u32 len;
+  // size of the object, excluding padding
+  u32 size;
+  u32 flags;
+  // 1 + index of the bytestring that opaque pointers are offsets into
+  u32 base;
+  u32 reserved;
+} SnapshotObject;
+
+static const u8 SNAPSHOT_MAGIC[8] = "glsnap\0";
+
+#define PAD8(X) (((X) + 7) & ~(u64) 7)
+
+// native functions that closures may call
+static u32 known_fnc(void) {
+  return 2 + gs_primitive_fnc + gs_record_fnc;
+}
+
+static ClosureFn known_fn(u32 idx) {
+  switch (idx) {
+  case 0: return symbol_invoke_closure.call;
+  case 1: return gs_interp_closure_call;
+  default:
+    idx -= 2;
+    if (idx < gs_primitive_fnc) return gs_primitive_fns[idx];
+    return gs_record_fns[idx - gs_primitive_fnc];
+  }
+}
+
+// the number of GC types other than those of record types, which are
+// registered afresh when a snapshot is loaded
+static u32 native_typec(void) {
+  return gs_global_gc->typec - gs_record_typec;
+}
+
+static Err *known_fn_idx(ClosureFn fn, u32 *out) {
+  u32 fnc = known_fnc();
+  for (u32 i = 0; i < fnc; ++i) {
+    if (known_fn(i) == fn) {
+      *out = i;
+      GS_RET_OK;
+    }
+  }
+  GS_FAILWITH("Cannot snapshot unknown native function", NULL);
+}
+
+static u32 object_len(TypeInfo *ti, u8 *obj) {
+  if (!ti->layout.resizable.field) return 1;
+  return PTR_REF(u32, obj + ti->layout.resizable.offset);
+}
+
+static u32 object_size(TypeInfo *ti, u32 len) {
+  u32 size = ti->layout.size;
+  if (ti->layout.resizable.field) {
+    size += len * ti->layout.fields[ti->layout.resizable.field - 1].size;
+  }
+  return size;
+}
+
+// whether the first field of the type is a Closure
+static bool has_closure_head(TypeIdx ty) {
+  return ty == SYMBOL_TYPE || ty == NATIVE_CLOSURE_TYPE || ty == INTERP_CLOSURE_TYPE;
+}
+
+typedef Err *(*SlotFn)(u8 *obj, u32 offset, unsigned tag, anyptr closed);
+
+// call fn with the offset of every GC-managed slot of obj
+static Err *visit_slots(u8 *obj, TypeInfo *ti, SlotFn fn, anyptr closed) {
+  bool resizable = ti->layout.resizable.field != 0;
+  u32 count = object_len(ti, obj);
+  for (u32 field = 0; field < ti->layout.fieldc; ++field) {
+    Field *fieldP = ti->layout.fields + field;
+    if (!fieldP->gc) continue;
+    if (resizable && field == ti->layout.resizable.field - 1u) {
+      u32 stride = fieldP->gc == FieldGcTagged ? sizeof(Val) : sizeof(u8 *);
+      for (u32 i = 0; i < count; ++i) {
+        GS_TRY(fn(obj, fieldP->offset + i * stride, fieldP->gc, closed));
+      }
+    } else {
+      GS_TRY(fn(obj, fieldP->offset, fieldP->gc, closed));
+    }
+  }
+  GS_RET_OK;
+}
+
+typedef struct Saver {
+  // objects in discovery order
+  anyptr *objs;
+  u32 *bases;
+  u32 objc;
+  u32 objCap;
+
+  // open-addressed map from objects to their index
+  anyptr *keys;
+  u32 *idxs;
+  u32 mapCap;
+
+  // where the object being written is copied to
+  u8 *copy;
+} Saver;
+
+static u32 hash_ptr(anyptr ptr, u32 cap) {
+  u64 h = (u64) (uptr) ptr;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (u32) h & (cap - 1);
+}
+
+static bool saver_find(Saver *sv, anyptr obj, u32 *slot) {
+  u32 i = hash_ptr(obj, sv->mapCap);
+  while (sv->keys[i]) {
+    if (sv->keys[i] == obj) {
+      *slot = i;
+      return true;
+    }
+    i = (i + 1) & (sv->mapCap - 1);
+  }
+  *slot = i;
+  return false;
+}
+
+static Err *saver_grow(Saver *sv) {
+  u32 newCap = sv->objCap * 2;
+  sv->objs = gs_realloc(sv->objs, GS_ALLOC_META(anyptr, sv->objCap), GS_ALLOC_META(anyptr, newCap));
+  sv->bases = gs_realloc(sv->bases, GS_ALLOC_META(u32, sv->objCap), GS_ALLOC_META(u32, newCap));
+  GS_FAIL_IF(!sv->objs || !sv->bases, "Allocation failed", NULL);
+  memset(sv->bases + sv->objCap, 0, (newCap - sv->objCap) * sizeof(u32));
+  sv->objCap = newCap;
+
+  u32 oldMapCap = sv->mapCap;
+  anyptr *oldKeys = sv->keys;
+  u32 *oldIdxs = sv->idxs;
+  sv->mapCap = newCap * 2;
+  sv->keys = gs_alloc(GS_ALLOC_META(anyptr, sv->mapCap));
+  sv->idxs = gs_alloc(GS_ALLOC_META(u32, sv->mapCap));
+  GS_FAIL_IF(!sv->keys || !sv->idxs, "Allocation failed", NULL);
+  memset(sv->keys, 0, sv->mapCap * sizeof(anyptr));
+  for (u32 i = 0; i < oldMapCap; ++i) {
+    if (!oldKeys[i]) continue;
+    u32 slot;
+    saver_find(sv, oldKeys[i], &slot);
+    sv->keys[slot] = oldKeys[i];
+    sv->idxs[slot] = oldIdxs[i];
+  }
+  gs_free(oldKeys, GS_ALLOC_META(anyptr, oldMapCap));
+  gs_free(oldIdxs, GS_ALLOC_META(u32, oldMapCap));
+  GS_RET_OK;
+}
+
+static Err *saver_intern(Saver *sv, anyptr obj, u32 *out) {
+  u32 slot;
+  if (saver_find(sv, obj, &slot)) {
+    *out = sv->idxs[slot];
+    GS_RET_OK;
+  }
+  if (sv->objc == sv->objCap) {
+    GS_TRY(saver_grow(sv));
+    saver_find(sv, obj, &slot);
+  }
+  u32 idx = sv->objc++;
+  sv->objs[idx] = obj;
+  sv->keys[slot] = obj;
+  sv->idxs[slot] = idx;
+  *out = idx;
+  GS_RET_OK;
+}
+
+static u32 saver_index(Saver *sv, anyptr obj) {
+  u32 slot;
+  saver_find(sv, obj, &slot);
+  return sv->idxs[slot];
+}
+
+static Err *discover_slot(u8 *obj, u32 offset, unsigned tag, anyptr closed) {
+  Saver *sv = closed;
+  u32 idx;
+  if (tag == FieldGcTagged) {
+    Val val = PTR_REF(Val, obj + offset);
+    if (VAL_IS_GC_PTR(val)) {
+      GS_TRY(saver_intern(sv, VAL2PTR(u8, val), &idx));
+    } else {
+      GS_FAIL_IF(
+        VAL_IS_NOGC_PTR(val) && VAL2PTR(u8, val) != NULL,
+        "Cannot snapshot native pointer",
+        NULL
+      );
+    }
+  } else {
+    anyptr ptr = PTR_REF(anyptr, obj + offset);
+    if (ptr) GS_TRY(saver_intern(sv, ptr, &idx));
+  }
+  GS_RET_OK;
+}
+
+static Err *encode_slot(u8 *obj, u32 offset, unsigned tag, anyptr closed) {
+  Saver *sv = closed;
+  u64 encoded;
+  if (tag == FieldGcTagged) {
+    Val val = PTR_REF(Val, obj + offset);
+    if (!VAL_IS_GC_PTR(val)) GS_RET_OK;
+    encoded = ((Val) saver_index(sv, VAL2PTR(u8, val)) << 2) | 1;
+  } else {
+    anyptr ptr = PTR_REF(anyptr, obj + offset);
+    encoded = ptr ? (u64) saver_index(sv, ptr) + 1 : 0;
+  }
+  memcpy(sv->copy + offset, &encoded, sizeof(u64));
+  GS_RET_OK;
+}
+
+static void put_word(u8 *at, u64 word) {
+  memcpy(at, &word, sizeof(u64));
+}
+
+static u64 get_word(const u8 *at) {
+  u64 word;
+  memcpy(&word, at, sizeof(u64));
+  return word;
+}
+
+static Err *offset_into(InlineBytes *base, anyptr ptr, u64 *out) {
+  GS_FAIL_IF(
+    (u8 *) ptr < base->bytes || (u8 *) ptr > base->bytes + base->len,
+    "Opaque pointer outside of its buffer",
+    NULL
+  );
+  *out = (u8 *) ptr - base->bytes;
+  GS_RET_OK;
+}
+
+static Err *encode_object(Saver *sv, u32 idx, TypeIdx ty, u8 *obj) {
+  if (has_closure_head(ty)) {
+    u32 fnIdx;
+    GS_TRY(known_fn_idx(PTR_REF(Closure, obj).call, &fnIdx));
+    put_word(sv->copy, fnIdx);
+  }
+  switch (ty) {
+  case OPAQUE_ARRAY_TYPE: {
+    GS_FAIL_IF(!sv->bases[idx], "Cannot snapshot opaque array outside an image", NULL);
+    InlineBytes *base = sv->objs[sv->bases[idx] - 1];
+    OpaqueArray *arr = (anyptr) obj;
+    for (u32 i = 0; i < arr->len; ++i) {
+      u64 offset;
+      GS_TRY(offset_into(base, arr->data[i], &offset));
+      put_word(sv->copy + offsetof(OpaqueArray, data) + i * sizeof(anyptr), offset);
+    }
+    break;
+  }
+  case IMAGE_TYPE: {
+    Image *img = (anyptr) obj;
+    u64 offset = 0;
+    if (img->bindings.pairs) {
+      GS_TRY(offset_into(img->buf, img->bindings.pairs, &offset));
+      offset++;
+    }
+    put_word(sv->copy + offsetof(Image, bindings.pairs), offset);
+    offset = 0;
+    if (img->symbols.entries) {
+      GS_TRY(offset_into(img->buf, img->symbols.entries, &offset));
+      offset++;
+    }
+    put_word(sv->copy + offsetof(Image, symbols.entries), offset);
+    break;
+  }
+  case MAPPED_BYTES_TYPE:
+    GS_FAILWITH("Cannot snapshot a mapped file", NULL);
+  case PORT_TYPE: {
+    // only the standard streams outlive the process that opened them
+    Port *port = (anyptr) obj;
+    GS_FAIL_IF(!(port->flags & PORT_BORROWED), "Cannot snapshot a port", NULL);
+    u32 flags = port->flags & ~PORT_EOF;
+    u32 empty = 0;
+    memcpy(sv->copy + offsetof(Port, flags), &flags, sizeof(u32));
+    memcpy(sv->copy + offsetof(Port, pos), &empty, sizeof(u32));
+    memcpy(sv->copy + offsetof(Port, end), &empty, sizeof(u32));
+    break;
+  }
+  case EXTERNAL_STRING_TYPE: {
+    ExternalUtf8Str *str = (anyptr) obj;
+    GS_FAIL_IF(!str->owner, "Cannot snapshot external string without an owner", NULL);
+    u64 offset;
+    GS_TRY(offset_into(str->owner, (anyptr) str->bytes, &offset));
+    put_word(sv->copy + offsetof(ExternalUtf8Str, bytes), offset);
+    break;
+  }
+  }
+  GS_RET_OK;
+}
+
+Err *gs_snapshot_save(u64 imageHash, AllocMeta *meta, u8 **out) {
+  Saver sv;
+  sv.objc = 0;
+  sv.objCap = 256;
+  sv.mapCap = sv.objCap * 2;
+  sv.objs = gs_alloc(GS_ALLOC_META(anyptr, sv.objCap));
+  sv.bases = gs_alloc(GS_ALLOC_META(u32, sv.objCap));
+  sv.keys = gs_alloc(GS_ALLOC_META(anyptr, sv.mapCap));
+  sv.idxs = gs_alloc(GS_ALLOC_META(u32, sv.mapCap));
+  GS_FAIL_IF(!sv.objs || !sv.bases || !sv.keys || !sv.idxs, "Allocation failed", NULL);
+  memset(sv.bases, 0, sv.objCap * sizeof(u32));
+  memset(sv.keys, 0, sv.mapCap * sizeof(anyptr));
+
+  Err *err = NULL;
+  AllocMeta bufMeta;
+  u8 *buf = NULL;
+
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) err = (X); goto cleanup;
+
+  u32 symTable;
+  GS_TRY(saver_intern(&sv, gs_global_syms, &symTable));
+  u64 total = sizeof(SnapshotHeader);
+  for (u32 i = 0; i < sv.objc; ++i) {
+    u8 *obj = sv.objs[i];
+    TypeIdx ty = gs_gc_typeinfo(obj);
+    TypeInfo *ti = &gs_global_gc->types[ty];
+    GS_TRY(visit_slots(obj, ti, discover_slot, &sv));
+    if (ty == IMAGE_TYPE) {
+      Image *img = (anyptr) obj;
+      u32 bufIdx, arrIdx;
+      GS_TRY(saver_intern(&sv, img->buf, &bufIdx));
+      if (img->constants) {
+        GS_TRY(saver_intern(&sv, img->constants, &arrIdx));
+        sv.bases[arrIdx] = bufIdx + 1;
+      }
+      if (img->codes) {
+        GS_TRY(saver_intern(&sv, img->codes, &arrIdx));
+        sv.bases[arrIdx] = bufIdx + 1;
+      }
+    }
+    total += sizeof(SnapshotObject) + PAD8(object_size(ti, object_len(ti, obj)));
+  }
+
+  GS_FAIL_IF(total > UINT32_MAX, "Snapshot too large", NULL);
+  bufMeta = GS_ALLOC_META(u8, (u32) total);
+  bufMeta.align = alignof(u64);
+  buf = gs_alloc(bufMeta);
+  GS_FAIL_IF(!buf, "Allocation failed", NULL);
+  memset(buf, 0, total);
+
+  SnapshotHeader *hd = (anyptr) buf;
+  memcpy(hd->magic, SNAPSHOT_MAGIC, sizeof(hd->magic));
+  hd->version = GS_SNAPSHOT_VERSION;
+  hd->typec = native_typec();
+  hd->fnc = known_fnc();
+  hd->objc = sv.objc;
+  hd->imageHash = imageHash;
+  hd->symTable = symTable;
+
+  u8 *pos = buf + sizeof(SnapshotHeader);
+  for (u32 i = 0; i < sv.objc; ++i) {
+    u8 *obj = sv.objs[i];
+    TypeIdx ty = gs_gc_typeinfo(obj);
+    TypeInfo *ti = &gs_global_gc->types[ty];
+    u32 len = object_len(ti, obj);
+    u32 size = object_size(ti, len);
+    SnapshotObject *rec = (anyptr) pos;
+    rec->ty = ty;
+    rec->len = len;
+    rec->size = size;
+    rec->flags = *GC_PTR_HEADER_REF(obj) == HtLarge ? SfLarge : 0;
+    rec->base = sv.bases[i];
+    sv.copy = pos + sizeof(SnapshotObject);
+    memcpy(sv.copy, obj, size);
+    GS_TRY(visit_slots(obj, ti, encode_slot, &sv));
+    GS_TRY(encode_object(&sv, i, ty, obj));
+    pos += sizeof(SnapshotObject) + PAD8(size);
+  }
+
+  LOG_INFO("Snapshot of %" PRIu32 " objects, %" PRIu64 " bytes", sv.objc, total);
+  *meta = bufMeta;
+  *out = buf;
+  buf = NULL;
+
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) GS_FAIL_HERE_DEFAULT(X)
+ cleanup:
+  if (buf) gs_free(buf, bufMeta);
+  gs_free(sv.objs, GS_ALLOC_META(anyptr, sv.objCap));
+  gs_free(sv.bases, GS_ALLOC_META(u32, sv.objCap));
+  gs_free(sv.keys, GS_ALLOC_META(anyptr, sv.mapCap));
+  gs_free(sv.idxs, GS_ALLOC_META(u32, sv.mapCap));
+  return err;
+}
+
+typedef struct Loader {
+  anyptr *objs;
+  u32 objc;
+  // the snapshot copy of the object being relocated
+  const u8 *copy;
+  // the GC types of record types in the snapshot, and what they are
+  // registered as now
+  u32 *oldTys, *newTys;
+  u32 recordTypec;
+} Loader;
+
+static Err *map_type(Loader *ld, u32 typec, u32 ty, u32 *out) {
+  if (ty < typec) {
+    *out = ty;
+    GS_RET_OK;
+  }
+  for (u32 i = 0; i < ld->recordTypec; ++i) {
+    if (ld->oldTys[i] == ty) {
+      *out = ld->newTys[i];
+      GS_RET_OK;
+    }
+  }
+  GS_FAILWITH("Type out of bounds", NULL);
+}
+
+static Err *decode_slot(u8 *obj, u32 offset, unsigned tag, anyptr closed) {
+  Loader *ld = closed;
+  if (tag == FieldGcTagged) {
+    Val val = PTR_REF(Val, obj + offset);
+    if (!VAL_IS_GC_PTR(val)) GS_RET_OK;
+    u64 idx = val >> 2;
+    GS_FAIL_IF(idx >= ld->objc, "Object index out of bounds", NULL);
+    PTR_REF(Val, obj + offset) = PTR2VAL_GC(ld->objs[idx]);
+  } else {
+    u64 idx = get_word(obj + offset);
+    if (!idx) GS_RET_OK;
+    GS_FAIL_IF(idx > ld->objc, "Object index out of bounds", NULL);
+    PTR_REF(anyptr, obj + offset) = ld->objs[idx - 1];
+  }
+  GS_RET_OK;
+}
+
+static Err *relocate_object(Loader *ld, const SnapshotObject *rec, u8 *obj) {
+  TypeIdx ty = rec->ty;
+  if (has_closure_head(ty)) {
+    u64 fnIdx = get_word(ld->copy);
+    GS_FAIL_IF(fnIdx >= known_fnc(), "Function index out of bounds", NULL);
+    PTR_REF(Closure, obj).call = known_fn((u32) fnIdx);
+  }
+  switch (ty) {
+  case OPAQUE_ARRAY_TYPE: {
+    GS_FAIL_IF(!rec->base || rec->base > ld->objc, "Bad opaque array base", NULL);
+    InlineBytes *base = ld->objs[rec->base - 1];
+    GS_FAIL_IF(gs_gc_typeinfo(base) != BYTESTRING_TYPE, "Bad opaque array base", NULL);
+    OpaqueArray *arr = (anyptr) obj;
+    for (u32 i = 0; i < arr->len; ++i) {
+      u64 offset = get_word(ld->copy + offsetof(OpaqueArray, data) + i * sizeof(anyptr));
+      GS_FAIL_IF(offset > base->len, "Opaque pointer out of bounds", NULL);
+      arr->data[i] = base->bytes + offset;
+    }
+    break;
+  }
+  case IMAGE_TYPE: {
+    Image *img = (anyptr) obj;
+    u64 offset = get_word(ld->copy + offsetof(Image, bindings.pairs));
+    if (offset) {
+      GS_FAIL_IF(!img->buf || offset - 1 > img->buf->len, "Bindings out of bounds", NULL);
+      img->bindings.pairs = (BindingInfo *) (img->buf->bytes + offset - 1);
+    } else {
+      img->bindings.pairs = NULL;
+    }
+    offset = get_word(ld->copy + offsetof(Image, symbols.entries));
+    if (offset) {
+      GS_FAIL_IF(!img->buf || offset - 1 > img->buf->len, "Symbols out of bounds", NULL);
+      img->symbols.entries = (SymbolInfo *) (img->buf->bytes + offset - 1);
+    } else {
+      img->symbols.entries = NULL;
+    }
+    break;
+  }
+  case RECORD_TYPE_TYPE: {
+    RecordType *rt = (anyptr) obj;
+    GS_TRY(map_type(ld, 0, rt->ty, &rt->ty));
+    break;
+  }
+  case HASH_TABLE_TYPE: {
+    // keys hashed by address are elsewhere now
+    HashTable *table = (anyptr) obj;
+    if (table->flags & HASH_TABLE_BY_ADDRESS) table->flags |= HASH_TABLE_STALE;
+    break;
+  }
+  case EXTERNAL_STRING_TYPE: {
+    ExternalUtf8Str *str = (anyptr) obj;
+    u64 offset = get_word(ld->copy + offsetof(ExternalUtf8Str, bytes));
+    GS_FAIL_IF(
+      !str->owner || offset > str->owner->len || str->len > str->owner->len - offset,
+      "External string out of bounds",
+      NULL
+    );
+    str->bytes = str->owner->bytes + offset;
+    break;
+  }
+  }
+  GS_RET_OK;
+}
+
+Err *gs_snapshot_load(u64 imageHash, u32 len, const u8 *buf, bool *loaded) {
+  *loaded = false;
+  GS_FAIL_IF((uptr) buf % alignof(u64) != 0, "bad alignment of snapshot", NULL);
+  GS_FAIL_IF(len < sizeof(SnapshotHeader), "Snapshot too short", NULL);
+  const SnapshotHeader *hd = (const anyptr) buf;
+  GS_FAIL_IF(memcmp(hd->magic, SNAPSHOT_MAGIC, sizeof(hd->magic)) != 0, "missing magic header", NULL);
+  if (hd->version != GS_SNAPSHOT_VERSION ||
+      hd->typec != native_typec() ||
+      hd->fnc != known_fnc() ||
+      hd->imageHash != imageHash) {
+    LOG_INFO("%s", "Snapshot is stale, ignoring");
+    GS_RET_OK;
+  }
+  GS_FAIL_IF(hd->symTable >= hd->objc, "Symbol table out of bounds", NULL);
+
+  Loader ld;
+  ld.objc = hd->objc;
+  ld.objs = gs_alloc(GS_ALLOC_META(anyptr, ld.objc));
+  GS_FAIL_IF(!ld.objs, "Allocation failed", NULL);
+  ld.oldTys = ld.newTys = NULL;
+  ld.recordTypec = 0;
+
+  Err *err = NULL;
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) err = (X); goto cleanup;
+
+  // register record types first, so their records can be allocated
+  const u8 *pos = buf + sizeof(SnapshotHeader);
+  const u8 *end = buf + len;
+  for (u32 i = 0; i < ld.objc; ++i) {
+    GS_FAIL_IF((u64) (end - pos) < sizeof(SnapshotObject), "Snapshot truncated", NULL);
+    const SnapshotObject *rec = (const anyptr) pos;
+    GS_FAIL_IF((u64) (end - pos) - sizeof(SnapshotObject) < PAD8(rec->size), "Snapshot truncated", NULL);
+    if (rec->ty == RECORD_TYPE_TYPE) ld.recordTypec++;
+    pos += sizeof(SnapshotObject) + PAD8(rec->size);
+  }
+  if (ld.recordTypec) {
+    ld.oldTys = gs_alloc(GS_ALLOC_META(u32, ld.recordTypec));
+    ld.newTys = gs_alloc(GS_ALLOC_META(u32, ld.recordTypec));
+    GS_FAIL_IF(!ld.oldTys || !ld.newTys, "Allocation failed", NULL);
+    pos = buf + sizeof(SnapshotHeader);
+    for (u32 i = 0, j = 0; i < ld.objc; ++i) {
+      const SnapshotObject *rec = (const anyptr) pos;
+      if (rec->ty == RECORD_TYPE_TYPE) {
+        GS_FAIL_IF(rec->size != sizeof(RecordType), "Object size mismatch", NULL);
+        RecordType rt;
+        memcpy(&rt, pos + sizeof(SnapshotObject), sizeof(RecordType));
+        ld.oldTys[j] = rt.ty;
+        GS_TRY(gs_record_type_register(&rt));
+        ld.newTys[j++] = rt.ty;
+      }
+      pos += sizeof(SnapshotObject) + PAD8(rec->size);
+    }
+  }
+
+  // allocate everything next, so references can be resolved
+  pos = buf + sizeof(SnapshotHeader);
+  for (u32 i = 0; i < ld.objc; ++i) {
+    const SnapshotObject *rec = (const anyptr) pos;
+    u32 ty;
+    GS_TRY(map_type(&ld, hd->typec, rec->ty, &ty));
+    TypeInfo *ti = &gs_global_gc->types[ty];
+    GS_FAIL_IF(object_size(ti, rec->len) != rec->size, "Object size mismatch", NULL);
+    if (rec->flags & SfLarge) gs_gc_force_next_large();
+    GS_TRY(gs_gc_alloc_array(ty, rec->len, &ld.objs[i]));
+    pos += sizeof(SnapshotObject) + PAD8(rec->size);
+  }
+
+  pos = buf + sizeof(SnapshotHeader);
+  for (u32 i = 0; i < ld.objc; ++i) {
+    const SnapshotObject *rec = (const anyptr) pos;
+    u8 *obj = ld.objs[i];
+    TypeInfo *ti = &gs_global_gc->types[gs_gc_typeinfo(obj)];
+    ld.copy = pos + sizeof(SnapshotObject);
+    memcpy(obj, ld.copy, rec->size);
+    GS_TRY(visit_slots(obj, ti, decode_slot, &ld));
+    GS_TRY(relocate_object(&ld, rec, obj));
+    pos += sizeof(SnapshotObject) + PAD8(rec->size);
+  }
+
+  // names can only be read once every object is in place
+  for (u32 i = 0; i < ld.objc; ++i) {
+    if (gs_gc_typeinfo(ld.objs[i]) == RECORD_TYPE_TYPE) {
+      GS_TRY(gs_record_type_name(ld.objs[i]));
+    }
+  }
+
+  GS_FAIL_IF(gs_gc_typeinfo(ld.objs[hd->symTable]) != SYM_TABLE_TYPE, "Not a symbol table", NULL);
+  gs_global_syms = ld.objs[hd->symTable];
+  LOG_INFO("Loaded snapshot of %" PRIu32 " objects", ld.objc);
+  *loaded = true;
+
+#undef GS_FAIL_HERE
+#define GS_FAIL_HERE(X) GS_FAIL_HERE_DEFAULT(X)
+ cleanup:
+  gs_free(ld.objs, GS_ALLOC_META(anyptr, ld.objc));
+  if (ld.oldTys) gs_free(ld.oldTys, GS_ALLOC_META(u32, ld.recordTypec));
+  if (ld.newTys) gs_free(ld.newTys, GS_ALLOC_META(u32, ld.recordTypec));
+  return err;
+}
@@ -0,0 +1,54 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "../rt.h"
+
+/**
+ * Heap snapshots.
+ *
+ * A snapshot is a copy of every object reachable from the global
+ * symbol table, taken once an image's start function has run, so
+ * that later runs of the same image can skip initialisation.
+ *
+ * Objects are stored in discovery order, with references between
+ * them replaced by object indices, native functions replaced by
+ * their index in a table of known functions, and pointers into image
+ * buffers replaced by offsets. Loading allocates each object afresh
+ * in the current generation and relocates these references.
+ *
+ * Snapshots are only valid for the same runtime build: they are
+ * rejected if the number of native GC types or known functions
+ * differs, or if they were taken of a different image. Record types
+ * are registered afresh on load, and their instances retagged.
+ */
+
+#define GS_SNAPSHOT_VERSION 6
+
+/**
+ * Snapshot the heap reachable from the symbol table, allocating the
+ * result with gs_alloc.
+ */
+Err *gs_snapshot_save(u64 imageHash, AllocMeta *meta, u8 **out);
+
+/**
+ * Load a snapshot, replacing the global symbol table.
+ *
+ * loaded is set to false, and the heap left untouched, if the
+ * snapshot is for a different image or runtime.
+ */
+Err *gs_snapshot_load(u64 imageHash, u32 len, const u8 *buf, bool *loaded);
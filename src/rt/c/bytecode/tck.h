@@ -12,6 +12,67 @@ static inline bool is_symbol0(Val val) {
   return is_type(val, SYMBOL_TYPE);
 }
 
+static inline bool is_string0(Val val) {
+  TypeIdx ti;
+  return VAL_IS_GC_PTR(val) &&
+        (ti = gs_gc_typeinfo(VAL2PTR(u8, val)),
+         ti == STRING_TYPE ||
+         ti == EXTERNAL_STRING_TYPE ||
+         ti == STRING_SLICE_TYPE);
+}
+
+// the contents of a string, which must satisfy is_string0
+static inline Utf8Str string_bytes(Val val) {
+  switch (gs_gc_typeinfo(VAL2PTR(u8, val))) {
+  case EXTERNAL_STRING_TYPE: {
+    ExternalUtf8Str *str = VAL2PTR(ExternalUtf8Str, val);
+    return (Utf8Str) { (u8 *) str->bytes, str->len };
+  }
+  case STRING_SLICE_TYPE: {
+    StringSlice *sl = VAL2PTR(StringSlice, val);
+    Utf8Str owner = string_bytes(PTR2VAL_GC(sl->owner));
+    return (Utf8Str) { owner.bytes + sl->offset, sl->len };
+  }
+  default:
+    return GS_DECAY_BYTES(VAL2PTR(InlineUtf8Str, val));
+  }
+}
+
+static inline bool is_bytestring0(Val val) {
+  TypeIdx ti;
+  return VAL_IS_GC_PTR(val) &&
+        (ti = gs_gc_typeinfo(VAL2PTR(u8, val)),
+         ti == BYTESTRING_TYPE ||
+         ti == MAPPED_BYTES_TYPE ||
+         ti == BYTESTRING_SLICE_TYPE);
+}
+
+// the contents of a bytestring, which must satisfy is_bytestring0
+static inline Bytes bytestring_bytes(Val val) {
+  switch (gs_gc_typeinfo(VAL2PTR(u8, val))) {
+  case MAPPED_BYTES_TYPE: {
+    MappedBytes *bs = VAL2PTR(MappedBytes, val);
+    return (Bytes) { (u8 *) bs->bytes, bs->len };
+  }
+  case BYTESTRING_SLICE_TYPE: {
+    BytesSlice *sl = VAL2PTR(BytesSlice, val);
+    Bytes owner = bytestring_bytes(PTR2VAL_GC(sl->owner));
+    return (Bytes) { owner.bytes + sl->offset, sl->len };
+  }
+  default:
+    return GS_DECAY_BYTES(VAL2PTR(InlineBytes, val));
+  }
+}
+
+// whether a bytestring can be written to, which it can unless it is,
+// or is a slice of, a mapped file
+static inline bool is_mutable_bytestring0(Val val) {
+  if (is_type(val, BYTESTRING_SLICE_TYPE)) {
+    return gs_gc_typeinfo(VAL2PTR(BytesSlice, val)->owner) == BYTESTRING_TYPE;
+  }
+  return is_type(val, BYTESTRING_TYPE);
+}
+
 static inline bool is_callable(Val val) {
   TypeIdx ti;
   return VAL_IS_GC_PTR(val) &&
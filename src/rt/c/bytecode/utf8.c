@@ -0,0 +1,266 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "utf8.h"
+#include "../gc/gc.h"
+#include "tck.h"
+
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#  define X86_DISPATCH 1
+#  include <immintrin.h>
+#endif
+
+// whether the 8 bytes at p are all ASCII
+static bool ascii_word(const u8 *p) {
+  u64 word;
+  memcpy(&word, p, sizeof(word));
+  return (word & 0x8080808080808080ULL) == 0;
+}
+
+#ifdef X86_DISPATCH
+static bool ascii_sse2(const u8 *p) {
+  return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) p)) == 0;
+}
+
+__attribute__((target("avx2"))) static bool ascii_avx2(const u8 *p) {
+  return _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) p)) == 0;
+}
+#endif
+
+static bool is_cont(u8 b) {
+  return (b & 0xC0) == 0x80;
+}
+
+// decode one code point from at most n bytes, returning its length, or
+// 0 if it is not valid
+static u32 decode_checked(const u8 *p, u64 n, u32 *c) {
+  u8 b = p[0];
+  if (b < 0x80) {
+    *c = b;
+    return 1;
+  }
+  u32 len, min;
+  if ((b & 0xE0) == 0xC0) {
+    len = 2;
+    min = 0x80;
+    *c = b & 0x1F;
+  } else if ((b & 0xF0) == 0xE0) {
+    len = 3;
+    min = 0x800;
+    *c = b & 0x0F;
+  } else if ((b & 0xF8) == 0xF0) {
+    len = 4;
+    min = 0x10000;
+    *c = b & 0x07;
+  } else {
+    return 0;
+  }
+  if (n < len) return 0;
+  for (u32 i = 1; i < len; ++i) {
+    if (!is_cont(p[i])) return 0;
+    *c = (*c << 6) | (p[i] & 0x3F);
+  }
+  if (*c < min || *c > 0x10FFFF || (*c >= 0xD800 && *c <= 0xDFFF)) return 0;
+  return len;
+}
+
+// validators for a block width, which check W bytes at a time for any
+// outside ASCII, and only decode the blocks that have some
+#define DEFINE_VALIDATE(SUFFIX, TARGET, W, ASCII_BLOCK)                 \
+  TARGET static bool validate_##SUFFIX(const u8 *p, const u8 *end, u32 *cpLen) { \
+    u32 count = 0;                                                      \
+    while (p != end) {                                                  \
+      if (end - p >= W && ASCII_BLOCK(p)) {                             \
+        p += W;                                                         \
+        count += W;                                                     \
+        continue;                                                       \
+      }                                                                 \
+      /* decode the rest of the block, and any code point crossing its end */ \
+      const u8 *blockEnd = end - p >= W ? p + W : end;                  \
+      while (p < blockEnd) {                                            \
+        u32 c;                                                          \
+        u32 n = decode_checked(p, (u64) (end - p), &c);                 \
+        if (!n) return false;                                           \
+        p += n;                                                         \
+        count++;                                                        \
+      }                                                                 \
+    }                                                                   \
+    *cpLen = count;                                                     \
+    return true;                                                        \
+  }
+
+DEFINE_VALIDATE(word, , 8, ascii_word)
+#ifdef X86_DISPATCH
+DEFINE_VALIDATE(sse2, , 16, ascii_sse2)
+DEFINE_VALIDATE(avx2, __attribute__((target("avx2"))), 32, ascii_avx2)
+#endif
+
+#undef DEFINE_VALIDATE
+
+static bool (*validate)(const u8 *p, const u8 *end, u32 *cpLen);
+
+static void pick_validate(void) {
+  validate = validate_word;
+#ifdef X86_DISPATCH
+  // SSE2 is part of x86-64
+  validate = validate_sse2;
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    validate = validate_avx2;
+  }
+#endif
+}
+
+bool gs_utf8_validate(Bytes bytes, u32 *cpLen) {
+  if (!validate) pick_validate();
+  return validate(bytes.bytes, bytes.bytes + bytes.len, cpLen);
+}
+
+u32 gs_utf8_decode(const u8 *bytes, u32 *c) {
+  return decode_checked(bytes, 4, c);
+}
+
+u32 gs_utf8_encode(u32 c, u8 out[4]) {
+  if (c < 0x80) {
+    out[0] = (u8) c;
+    return 1;
+  } else if (c < 0x800) {
+    out[0] = (u8) (0xC0 | (c >> 6));
+    out[1] = (u8) (0x80 | (c & 0x3F));
+    return 2;
+  } else if (c < 0x10000) {
+    if (c >= 0xD800 && c <= 0xDFFF) return 0;
+    out[0] = (u8) (0xE0 | (c >> 12));
+    out[1] = (u8) (0x80 | ((c >> 6) & 0x3F));
+    out[2] = (u8) (0x80 | (c & 0x3F));
+    return 3;
+  } else if (c <= 0x10FFFF) {
+    out[0] = (u8) (0xF0 | (c >> 18));
+    out[1] = (u8) (0x80 | ((c >> 12) & 0x3F));
+    out[2] = (u8) (0x80 | ((c >> 6) & 0x3F));
+    out[3] = (u8) (0x80 | (c & 0x3F));
+    return 4;
+  }
+  return 0;
+}
+
+Err *gs_string_alloc(u32 len, InlineUtf8Str **out) {
+  InlineUtf8Str *str;
+  GS_TRY(gs_gc_alloc_array(STRING_TYPE, len, (anyptr *)&str));
+  str->cpLen = len;
+  str->index = NULL;
+  *out = str;
+  GS_RET_OK;
+}
+
+Err *gs_string_seal(InlineUtf8Str *str) {
+  GS_FAIL_IF(!gs_utf8_validate(GS_DECAY_BYTES(str), &str->cpLen), "Invalid UTF-8", NULL);
+  GS_RET_OK;
+}
+
+Err *gs_string_new(Utf8Str bytes, InlineUtf8Str **out) {
+  InlineUtf8Str *str;
+  GS_TRY(gs_string_alloc(bytes.len, &str));
+  memcpy(str->bytes, bytes.bytes, bytes.len);
+  GS_TRY(gs_string_seal(str));
+  *out = str;
+  GS_RET_OK;
+}
+
+u32 gs_string_cp_length(Val str) {
+  switch (gs_gc_typeinfo(VAL2PTR(u8, str))) {
+  case EXTERNAL_STRING_TYPE: return VAL2PTR(ExternalUtf8Str, str)->cpLen;
+  case STRING_SLICE_TYPE: return VAL2PTR(StringSlice, str)->cpLen;
+  default: return VAL2PTR(InlineUtf8Str, str)->cpLen;
+  }
+}
+
+// skip n code points of valid UTF-8
+static const u8 *skip(const u8 *p, u32 n) {
+  for (; n; --n) {
+    u8 b = *p;
+    p += b < 0x80 ? 1 : b < 0xE0 ? 2 : b < 0xF0 ? 3 : 4;
+  }
+  return p;
+}
+
+// the offset of code point idx in a string that is not a slice, where
+// holder is the string and index its index field
+static Err *cp_offset(
+  Utf8Str bytes,
+  u32 cpLen,
+  anyptr holder,
+  InlineBytes **index,
+  u32 idx,
+  u32 *out
+) {
+  if (cpLen == bytes.len) {
+    *out = idx;
+    GS_RET_OK;
+  }
+  if (idx == cpLen) {
+    // the index has no entry past the last stride
+    *out = bytes.len;
+    GS_RET_OK;
+  }
+  if (cpLen <= GS_UTF8_INDEX_STRIDE) {
+    *out = (u32) (skip(bytes.bytes, idx) - bytes.bytes);
+    GS_RET_OK;
+  }
+  if (!*index) {
+    u32 entries = (cpLen + GS_UTF8_INDEX_STRIDE - 1) / GS_UTF8_INDEX_STRIDE;
+    InlineBytes *built;
+    GS_TRY(gs_gc_alloc_array(BYTESTRING_TYPE, entries * sizeof(u32), (anyptr *)&built));
+    const u8 *p = bytes.bytes;
+    for (u32 i = 0; i < entries; ++i) {
+      u32 offset = (u32) (p - bytes.bytes);
+      memcpy(built->bytes + i * sizeof(u32), &offset, sizeof(u32));
+      if (i + 1 < entries) p = skip(p, GS_UTF8_INDEX_STRIDE);
+    }
+    GS_TRY(gs_gc_write_barrier(holder, index, built, FieldGcRaw));
+    *index = built;
+  }
+  u32 base;
+  memcpy(&base, (*index)->bytes + (idx / GS_UTF8_INDEX_STRIDE) * sizeof(u32), sizeof(u32));
+  *out = (u32) (skip(bytes.bytes + base, idx % GS_UTF8_INDEX_STRIDE) - bytes.bytes);
+  GS_RET_OK;
+}
+
+Err *gs_string_cp_offset(Val str, u32 idx, u32 *out) {
+  switch (gs_gc_typeinfo(VAL2PTR(u8, str))) {
+  case EXTERNAL_STRING_TYPE: {
+    ExternalUtf8Str *ext = VAL2PTR(ExternalUtf8Str, str);
+    return cp_offset(string_bytes(str), ext->cpLen, ext, &ext->index, idx, out);
+  }
+  case STRING_SLICE_TYPE: {
+    StringSlice *sl = VAL2PTR(StringSlice, str);
+    if (sl->cpLen == sl->len) {
+      *out = idx;
+      GS_RET_OK;
+    }
+    u32 ownerOffset;
+    GS_TRY(gs_string_cp_offset(PTR2VAL_GC(sl->owner), sl->cpOffset + idx, &ownerOffset));
+    *out = ownerOffset - sl->offset;
+    GS_RET_OK;
+  }
+  default: {
+    InlineUtf8Str *inl = VAL2PTR(InlineUtf8Str, str);
+    return cp_offset(GS_DECAY_BYTES(inl), inl->cpLen, inl, &inl->index, idx, out);
+  }
+  }
+}
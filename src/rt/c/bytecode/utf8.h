@@ -0,0 +1,78 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "primitives.h"
+
+/**
+ * UTF-8 strings.
+ *
+ * Strings are checked to be valid UTF-8 when they are created, and
+ * remember how many code points they have. Indexing them by code
+ * point is direct if they are ASCII. Otherwise, the first time a long
+ * string is indexed it builds a sparse index of the byte offset of
+ * every GS_UTF8_INDEX_STRIDE-th code point, and scans from the
+ * nearest one.
+ *
+ * Validation checks 32 or 16 bytes at a time for bytes outside ASCII
+ * with AVX2 or SSE2, picked by what the CPU supports at runtime, or 8
+ * at a time elsewhere, only decoding the blocks that are not ASCII.
+ */
+
+#define GS_UTF8_INDEX_STRIDE 32
+
+/**
+ * Check that bytes are valid UTF-8, without overlong encodings or
+ * surrogates, and count its code points.
+ */
+bool gs_utf8_validate(Bytes bytes, u32 *cpLen);
+
+/**
+ * Decode the code point at the start of valid UTF-8, returning the
+ * number of bytes it takes up.
+ */
+u32 gs_utf8_decode(const u8 *bytes, u32 *c);
+
+/**
+ * Encode a code point into out, returning the number of bytes it
+ * takes up, or 0 if it is not a code point or is a surrogate.
+ */
+u32 gs_utf8_encode(u32 c, u8 out[4]);
+
+/**
+ * Allocate a string of len bytes, whose contents must be filled in
+ * and then checked with gs_string_seal before it is used.
+ */
+Err *gs_string_alloc(u32 len, InlineUtf8Str **out);
+Err *gs_string_seal(InlineUtf8Str *str);
+
+/**
+ * Copy bytes into a new string, failing if they are not valid UTF-8.
+ */
+Err *gs_string_new(Utf8Str bytes, InlineUtf8Str **out);
+
+/**
+ * The number of code points in a string, which must satisfy
+ * is_string0.
+ */
+u32 gs_string_cp_length(Val str);
+
+/**
+ * Find the byte offset of code point idx in a string, which must
+ * satisfy is_string0; idx may be at most its length in code points.
+ */
+Err *gs_string_cp_offset(Val str, u32 idx, u32 *out);
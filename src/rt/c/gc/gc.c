@@ -108,12 +108,18 @@ static Err *gs_alloc_in_generation(u16 gen, u32 len, TypeIdx tyIdx, anyptr *out,
 
   LOG_GC_TRACE("Allocating; gen: %" PRIu16 ", len: %" PRIu32 ", ty: %.*s", gen, len, ty->name.len, ty->name.bytes);
 
-  u32 size = ty->layout.size;
+  u64 size = ty->layout.size;
 
   if (ty->layout.resizable.field) {
-    size += len * ty->layout.fields[ty->layout.resizable.field - 1].size;
+    size += (u64) len * ty->layout.fields[ty->layout.resizable.field - 1].size;
   }
-  if (outSize) *outSize = size;
+  // sizes are u32s, including that of the large object it may go in
+  GS_FAIL_IF(
+    size > UINT32_MAX - offsetof(LargeObject, data) - sizeof(u64) - alignof(u64),
+    "Object too large",
+    NULL
+  );
+  if (outSize) *outSize = (u32) size;
 
   u32 align = ty->layout.align;
 
@@ -147,17 +153,13 @@ static Err *gs_alloc_in_generation(u16 gen, u32 len, TypeIdx tyIdx, anyptr *out,
     alloc_next_large = false;
 
     GS_FAIL_IF(align > alignof(u64), "Unsupported large object alignment", NULL);
-    LargeObject *lo = gs_alloc(
-      GS_ALLOC_ALIGN_SIZE(
-        align,
-        offsetof(LargeObject, data) + sizeof(u64) + size,
-        1
-      )
-    );
+    u32 loSize = offsetof(LargeObject, data) + sizeof(u64) + (u32) size;
+    LargeObject *lo = gs_alloc(GS_ALLOC_ALIGN_SIZE(align, loSize, 1));
     if (lo == NULL) {
       // TODO major gc, retry
       GS_FAILWITH("OOM, couldn't allocate large object", NULL);
     }
+    lo->size = loSize;
 
     if ((lo->next = scope->largeObjects)) lo->next->prev = lo;
     lo->prev = NULL;
@@ -204,6 +206,26 @@ Err *gs_gc_alloc_array(TypeIdx tyIdx, u32 len, anyptr *out) {
   return gs_alloc_in_generation(gs_global_gc->topScope, len, tyIdx, out, NULL);
 }
 
+void gs_gc_shrink_array(anyptr obj, u32 len) {
+  u8 *header = GC_PTR_HEADER_REF(obj);
+  TypeInfo *ti = &gs_global_gc->types[GC_HEADER_TY(header)];
+  u32 *lenP = &PTR_REF(u32, (u8 *) obj + ti->layout.resizable.offset);
+  if (len >= *lenP) return;
+  u32 elementSize = ti->layout.fields[ti->layout.resizable.field - 1].size;
+  u8 *oldEnd = (u8 *) obj + ti->layout.size + *lenP * elementSize;
+  u8 *newEnd = (u8 *) obj + ti->layout.size + len * elementSize;
+  *lenP = len;
+  // large objects keep their allocation, the length just covers less of it
+  if (*header != HtNormal) return;
+  MiniPage *mp = find_mini_page(header);
+  if (oldEnd == mp->data + mp->size) {
+    mp->size = newEnd - mp->data;
+  } else {
+    // pages are walked object by object, so the gap must be skippable
+    memset(newEnd, -1, oldEnd - newEnd);
+  }
+}
+
 static void gs_move_large_object(LargeObject *lo, u16 targetGen) {
   if (lo->next) lo->next->prev = lo->prev;
   if (lo->prev) lo->prev->next = lo->next;
@@ -244,7 +266,7 @@ static Err *mark_ptr0(u8 **pointer, u16 dstGen, u16 minMoveGen) {
   case HtLarge: {
     LargeObject *lo = GC_LARGE_OBJECT(header);
     u16 itsGeneration = lo->gen;
-    if (itsGeneration > minMoveGen) {
+    if (itsGeneration >= minMoveGen) {
       if (GC_HEADER_MARK(header) == CtUnmarked) {
         LOG_GC_TRACE("%s", "Moving to target generation (large object)");
         gs_move_large_object(lo, dstGen);
@@ -419,20 +441,22 @@ static Err *gs_scan_grays(u16 gen, bool inPlace) {
   bool moved;
   do {
     moved = false;
-    if (scope->firstNonGrayLo) {
-      LargeObject *iter = scope->firstNonGrayLo->prev;
-      if (iter) {
-        moved = true;
-        for (; iter; iter = iter->prev) {
-          u8 *header = iter->data;
-          GS_TRY(gs_visit_gray(header + sizeof(u64), gen, inPlace, NULL));
-          scope->firstNonGrayLo = iter;
-        }
+    // moved large objects are pushed to the front of the list, so the
+    // gray ones are those before firstNonGrayLo
+    while (scope->largeObjects != scope->firstNonGrayLo) {
+      moved = true;
+      LargeObject *stop = scope->firstNonGrayLo;
+      scope->firstNonGrayLo = scope->largeObjects;
+      for (LargeObject *iter = scope->largeObjects; iter != stop; iter = iter->next) {
+        u8 *header = iter->data;
+        GS_TRY(gs_visit_gray(header + sizeof(u64), gen, inPlace, NULL));
       }
     }
     {
       u8 *iter = (u8 *) scope->firstGray;
-      MiniPage *mp = find_mini_page(iter);
+      // the first gray may be just past the end of a full page, which
+      // is the start of whatever page is next in memory
+      MiniPage *mp = find_mini_page(iter - 1);
       if (
         mp->prev != NULL ||
         iter < mp->data + mp->size
@@ -609,6 +633,7 @@ Err *gs_gc_init(GcConfig cfg, GcAllocator *gc) {
   gc->typec = 0;
 
   gc->roots = NULL;
+  gc->epoch = 0;
 
   if(
     !gc->scopes ||
@@ -649,13 +674,8 @@ void free_all_larges(Generation *scope) {
     u8 *header = lo->data;
     TypeIdx ty = GC_HEADER_TY(header);
     TypeInfo *ti = &gs_global_gc->types[ty];
-    u32 size = ti->layout.size;
-    if (ti->layout.resizable.field) {
-      size +=
-        ti->layout.fields[ti->layout.resizable.field - 1].size *
-        PTR_REF(u32, header + sizeof(u64) + ti->layout.resizable.offset);
-    }
-    gs_free(lo, GS_ALLOC_ALIGN_SIZE(ti->layout.align, size, 1));
+    if (ti->finalize) ti->finalize(header + sizeof(u64));
+    gs_free(lo, GS_ALLOC_ALIGN_SIZE(ti->layout.align, lo->size, 1));
     lo = nxt;
   }
 }
@@ -681,8 +701,8 @@ Err *gs_gc_push_type(TypeInfo info, TypeIdx *outIdx) {
   if (pos >= gs_global_gc->typeCap) {
     gs_global_gc->types = gs_realloc(
       gs_global_gc->types,
-      GS_ALLOC_META(TypeInfo, gs_global_gc->typec),
-      GS_ALLOC_META(TypeInfo, gs_global_gc->typec *= 2)
+      GS_ALLOC_META(TypeInfo, gs_global_gc->typeCap),
+      GS_ALLOC_META(TypeInfo, gs_global_gc->typeCap *= 2)
     );
     GS_FAIL_IF(gs_global_gc->types == NULL, "Could not resize", NULL);
   }
@@ -736,12 +756,17 @@ Err *gs_gc_pop_scope() {
   gs_global_gc->freeMiniPagec += scope->miniPagec;
 
   free_all_larges(scope);
+  gs_global_gc->epoch++;
 
   LOG_GC_DEBUG("Popped -> (free mini-pages: %" PRIu32 ")", gs_global_gc->freeMiniPagec);
 
   GS_RET_OK;
 }
 
+u32 gs_gc_epoch() {
+  return gs_global_gc->epoch;
+}
+
 static Err *find_trail(Generation *scope, u16 dstGen, TrailNode **out) {
   Trail *younger, *older, *trail = scope->trail;
   younger = older = NULL;
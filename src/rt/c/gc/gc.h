@@ -165,6 +165,8 @@ typedef struct MiniPage {
 /** Just a linked list of objects considered too large to be put into a mini-page directly. */
 typedef struct LargeObject {
   struct LargeObject *prev, *next;
+  /** The size it was allocated with, which shrinking does not change */
+  u32 size;
   /** The generation this LO belongs to */
   u16 gen;
   alignas(u64) u8 data[1];
@@ -362,6 +364,12 @@ struct GcAllocator {
 
   /** Linked list of registered GC roots. */
   GcRoots *roots;
+
+  /**
+   * Number of scopes that have been popped, and so the number of
+   * times objects may have moved.
+   */
+  u32 epoch;
 };
 
 /**
@@ -408,6 +416,13 @@ Err *gs_gc_alloc(TypeIdx ty, anyptr *out);
  */
 Err *gs_gc_alloc_array(TypeIdx arrayTy, u32 len, anyptr *out);
 
+/**
+ * Shrink an array allocated with gs_gc_alloc_array to len elements in
+ * place, giving the space after it back to its page where it can.
+ * Does nothing if the array is not longer than len.
+ */
+void gs_gc_shrink_array(anyptr obj, u32 len);
+
 /**
  * Register a write with the garbage collector.
  */
@@ -428,6 +443,12 @@ Err *gs_gc_push_scope(void);
  */
 Err *gs_gc_pop_scope(void);
 
+/**
+ * A counter that changes whenever objects may have moved, so that
+ * tables keyed by address know when to rehash.
+ */
+u32 gs_gc_epoch(void);
+
 /**
  * Dump debug information about the state of the garbage collector to stderr.
  */
@@ -111,6 +111,13 @@ typedef struct TypeLayout {
 typedef struct TypeInfo {
   /* needed for GC */
   TypeLayout layout;
+  /**
+   * Called with each large object of this type just before it is
+   * freed, to release what it owns outside the heap. Only large
+   * objects are finalized, so objects of types with a finalizer must
+   * be allocated after gs_gc_force_next_large.
+   */
+  void (*finalize)(anyptr obj);
   /* needed for runtime */
   ProtoTable protos;
   /* for reflection */
@@ -119,11 +126,12 @@ typedef struct TypeInfo {
 
 #define BAD_ARITY "this should not be called"
 #define GC_TYPE_EXPAND(X) X
-#define GC_TYPE_GET_MACRO(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, _33, NAME, ...) NAME
+#define GC_TYPE_GET_MACRO(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, _33, _34, _35, _36, NAME, ...) NAME
 #define GC_TYPE_PASTE(Fst, ...)                 \
   GC_TYPE_EXPAND(                               \
     GC_TYPE_GET_MACRO(                          \
       __VA_ARGS__,                              \
+      BAD_ARITY, BAD_ARITY, GC_TYPE_PASTE33,    \
       BAD_ARITY, BAD_ARITY, GC_TYPE_PASTE30,    \
       BAD_ARITY, BAD_ARITY, GC_TYPE_PASTE27,    \
       BAD_ARITY, BAD_ARITY, GC_TYPE_PASTE24,    \
@@ -145,6 +153,7 @@ typedef struct TypeInfo {
 #define GC_TYPE_PASTE24(Fst, f, gc1, ty1, nm1, ...) f(Fst, gc1, ty1, nm1) GC_TYPE_PASTE21(Fst, f, __VA_ARGS__)
 #define GC_TYPE_PASTE27(Fst, f, gc1, ty1, nm1, ...) f(Fst, gc1, ty1, nm1) GC_TYPE_PASTE24(Fst, f, __VA_ARGS__)
 #define GC_TYPE_PASTE30(Fst, f, gc1, ty1, nm1, ...) f(Fst, gc1, ty1, nm1) GC_TYPE_PASTE27(Fst, f, __VA_ARGS__)
+#define GC_TYPE_PASTE33(Fst, f, gc1, ty1, nm1, ...) f(Fst, gc1, ty1, nm1) GC_TYPE_PASTE30(Fst, f, __VA_ARGS__)
 
 // for struct fields
 #define GC_TYPE_STRUCT_FIELD(_i, _gc, ty, nm) ty nm;
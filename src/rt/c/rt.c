@@ -23,10 +23,21 @@
 #include "bytecode/primitives.h"
 
 #include "./bytecode/tck.h"
+#include "./bytecode/utf8.h"
 
 // for memcmp
 #include <string.h>
 
+#ifdef _WIN32
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 Err gs_current_err;
 
 Err *gs_call(GS_CLOSURE_ARGS) {
@@ -96,6 +107,64 @@ int gs_bytes_cmp(Bytes lhs, Bytes rhs) {
   return memcmp(lhs.bytes, rhs.bytes, (size_t) lhs.len);
 }
 
+#ifdef _WIN32
+Err *gs_map_file(const char *path, const u8 **bytes, u32 *len) {
+  FILE *fp = fopen(path, "rb");
+  GS_FAIL_IF(!fp, "Could not open file", NULL);
+  long size = -1;
+  if (fseek(fp, 0, SEEK_END) == 0) size = ftell(fp);
+  if (size < 0 || (unsigned long) size > UINT32_MAX || fseek(fp, 0, SEEK_SET) != 0) {
+    fclose(fp);
+    GS_FAILWITH("Could not size file", NULL);
+  }
+  u8 *buf = NULL;
+  if (size) {
+    buf = malloc(size);
+    if (!buf || fread(buf, 1, size, fp) != (size_t) size) {
+      free(buf);
+      fclose(fp);
+      GS_FAILWITH("IO error occured", NULL);
+    }
+  }
+  fclose(fp);
+  *bytes = buf;
+  *len = (u32) size;
+  GS_RET_OK;
+}
+
+void gs_unmap_file(const u8 *bytes, u32 len) {
+  (void) len;
+  free((u8 *) bytes);
+}
+#else
+Err *gs_map_file(const char *path, const u8 **bytes, u32 *len) {
+  int fd = open(path, O_RDONLY);
+  GS_FAIL_IF(fd < 0, "Could not open file", NULL);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 0 || (u64) st.st_size > UINT32_MAX) {
+    close(fd);
+    GS_FAILWITH("Could not size file", NULL);
+  }
+  const u8 *buf = NULL;
+  if (st.st_size) {
+    void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      close(fd);
+      GS_FAILWITH("Could not map file", NULL);
+    }
+    buf = mapped;
+  }
+  close(fd);
+  *bytes = buf;
+  *len = (u32) st.st_size;
+  GS_RET_OK;
+}
+
+void gs_unmap_file(const u8 *bytes, u32 len) {
+  munmap((void *) bytes, len);
+}
+#endif
+
 SymTable *gs_global_syms;
 
 Err *gs_alloc_sym_table(void) {
@@ -123,11 +192,11 @@ GS_TOP_CLOSURE(PUBLIC, symbol_invoke_closure) {
   }
 }
 
-Err *gs_intern(Utf8Str name, Symbol **out) {
+// intern with a known hash, checking it only if a new symbol is made
+static Err *intern(Utf8Str name, u32 hash, bool checkHash, Symbol **out) {
   SymTable *table = gs_global_syms;
 
-  u64 hash = gs_hash_bytes(name);
-  SymTableBucket **bucketP = &table->buckets[(u32) hash % table->bucketc];
+  SymTableBucket **bucketP = &table->buckets[hash % table->bucketc];
   SymTableBucket *bucket = *bucketP;
 
   Symbol **it, **end;
@@ -141,17 +210,18 @@ Err *gs_intern(Utf8Str name, Symbol **out) {
     }
   }
 
-  // not found, intern new
+  // not found, intern new; a bad hash would have sent us to the wrong bucket
+  GS_FAIL_IF(checkHash && (u32) gs_hash_bytes(name) != hash, "Wrong symbol hash", NULL);
+  InlineUtf8Str *iName;
+  GS_TRY(gs_string_new(name, &iName));
   Symbol *val;
   GS_TRY(gs_gc_alloc(SYMBOL_TYPE, (anyptr *)&val));
-  InlineUtf8Str *iName;
-  GS_TRY(gs_gc_alloc_array(STRING_TYPE, name.len, (anyptr *)&iName));
-  memcpy(iName->bytes, name.bytes, name.len);
   *val = (Symbol) {
     .fn = symbol_invoke_closure,
     .value = PTR2VAL_GC(val),
     .name = iName,
     .isMacro = false,
+    .hash = hash,
   };
   if (!bucket || bucket->len >= bucket->cap) {
     // realloc bucket
@@ -175,6 +245,18 @@ Err *gs_intern(Utf8Str name, Symbol **out) {
   GS_RET_OK;
 }
 
+Err *gs_intern(Utf8Str name, Symbol **out) {
+  return intern(name, (u32) gs_hash_bytes(name), false, out);
+}
+
+Err *gs_intern_hashed(Utf8Str name, u32 hash, Symbol **out) {
+  return intern(name, hash, true, out);
+}
+
+Err *gs_intern_verified(Utf8Str name, u32 hash, Symbol **out) {
+  return intern(name, hash, false, out);
+}
+
 Symbol *gs_reverse_lookup(Val value) {
   SymTable *table = gs_global_syms;
   for (u32 i = 0; i < table->bucketc; ++i) {
@@ -214,9 +214,13 @@ DEFINE_GC_TYPE(
   NOGC(FIX), u32, len,
   NOGC(RSZ(len)), u8s, bytes
 );
+// a UTF-8 string of len bytes and cpLen code points; index is built
+// the first time it is indexed if it is not ASCII (see utf8.h)
 DEFINE_GC_TYPE(
   InlineUtf8Str,
   NOGC(FIX), u32, len,
+  NOGC(FIX), u32, cpLen,
+  GC(FIX, Raw), InlineBytes *, index,
   NOGC(RSZ(len)), u8s, bytes
 );
 #define GS_DECAY_BYTES(VAL) ((Bytes) { (VAL)->bytes, (VAL)->len })
@@ -226,7 +230,11 @@ DEFINE_GC_TYPE(
   NOGC(FIX), Closure, fn,
   GC(FIX, Tagged), Val, value,
   GC(FIX, Raw), InlineUtf8Str *, name,
-  NOGC(FIX), bool, isMacro
+  NOGC(FIX), bool, isMacro,
+  // the low 32 bits of gs_hash_bytes of its name if interned, or a
+  // hash of its own if a gensym, so that gensyms sharing a name don't
+  // collide as map keys
+  NOGC(FIX), u32, hash
 );
 
 typedef Symbol *SymbolArray[1];
@@ -250,6 +258,22 @@ extern Closure symbol_invoke_closure;
 u64 gs_hash_bytes(Bytes bytes);
 int gs_bytes_cmp(Bytes lhs, Bytes rhs);
 
+// map the contents of a file read-only, or read them into memory where
+// mapping is not supported; bytes is NULL if the file is empty
+Err *gs_map_file(const char *path, const u8 **bytes, u32 *len);
+void gs_unmap_file(const u8 *bytes, u32 len);
+
 Err *gs_alloc_sym_table(void);
 Err *gs_intern(Utf8Str name, Symbol **out);
+// intern a symbol whose hash, the low 32 bits of gs_hash_bytes, is already known;
+// the hash is only checked if a new symbol has to be created
+Err *gs_intern_hashed(Utf8Str name, u32 hash, Symbol **out);
+// as gs_intern_hashed, for a hash that has already been checked
+Err *gs_intern_verified(Utf8Str name, u32 hash, Symbol **out);
+// prefetch the bucket a symbol with the given hash would be interned into
+static inline void gs_prefetch_symbol_bucket(u32 hash) {
+  SymTable *table = gs_global_syms;
+  SymTableBucket *bucket = table->buckets[hash % table->bucketc];
+  if (bucket) __builtin_prefetch(bucket->syms);
+}
 Symbol *gs_reverse_lookup(Val value);
@@ -0,0 +1,121 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "sha256.h"
+
+#include <string.h>
+
+static const u32 K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static u32 rotr(u32 x, u32 n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+static void compress(u32 state[8], const u8 block[64]) {
+  u32 w[64];
+  for (u32 i = 0; i < 16; ++i) {
+    w[i] = (u32) block[4 * i] << 24 | (u32) block[4 * i + 1] << 16
+      | (u32) block[4 * i + 2] << 8 | block[4 * i + 3];
+  }
+  for (u32 i = 16; i < 64; ++i) {
+    u32 s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    u32 s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  u32 a = state[0], b = state[1], c = state[2], d = state[3];
+  u32 e = state[4], f = state[5], g = state[6], h = state[7];
+  for (u32 i = 0; i < 64; ++i) {
+    u32 t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+    u32 t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+void gs_sha256_init(Sha256 *ctx) {
+  static const u32 init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+  };
+  memcpy(ctx->state, init, sizeof(init));
+  ctx->len = 0;
+  ctx->blockLen = 0;
+}
+
+void gs_sha256_update(Sha256 *ctx, const u8 *bytes, u64 len) {
+  ctx->len += len;
+  if (ctx->blockLen) {
+    u64 fill = 64 - ctx->blockLen;
+    if (fill > len) fill = len;
+    memcpy(ctx->block + ctx->blockLen, bytes, fill);
+    ctx->blockLen += fill;
+    bytes += fill;
+    len -= fill;
+    if (ctx->blockLen < 64) return;
+    compress(ctx->state, ctx->block);
+    ctx->blockLen = 0;
+  }
+  for (; len >= 64; bytes += 64, len -= 64) {
+    compress(ctx->state, bytes);
+  }
+  memcpy(ctx->block, bytes, len);
+  ctx->blockLen = len;
+}
+
+void gs_sha256_final(Sha256 *ctx, u8 out[GS_SHA256_LEN]) {
+  u64 bits = ctx->len * 8;
+  ctx->block[ctx->blockLen++] = 0x80;
+  if (ctx->blockLen > 56) {
+    memset(ctx->block + ctx->blockLen, 0, 64 - ctx->blockLen);
+    compress(ctx->state, ctx->block);
+    ctx->blockLen = 0;
+  }
+  memset(ctx->block + ctx->blockLen, 0, 56 - ctx->blockLen);
+  for (u32 i = 0; i < 8; ++i) {
+    ctx->block[56 + i] = (u8) (bits >> (56 - 8 * i));
+  }
+  compress(ctx->state, ctx->block);
+  for (u32 i = 0; i < 8; ++i) {
+    out[4 * i] = (u8) (ctx->state[i] >> 24);
+    out[4 * i + 1] = (u8) (ctx->state[i] >> 16);
+    out[4 * i + 2] = (u8) (ctx->state[i] >> 8);
+    out[4 * i + 3] = (u8) ctx->state[i];
+  }
+}
@@ -0,0 +1,37 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "../rt.h"
+
+/**
+ * SHA-256, for identifying images when a collision could be used to
+ * get around verification.
+ */
+
+#define GS_SHA256_LEN 32
+
+typedef struct Sha256 {
+  u32 state[8];
+  u64 len; // in bytes
+  u8 block[64];
+  u32 blockLen;
+} Sha256;
+
+void gs_sha256_init(Sha256 *ctx);
+void gs_sha256_update(Sha256 *ctx, const u8 *bytes, u64 len);
+void gs_sha256_final(Sha256 *ctx, u8 out[GS_SHA256_LEN]);
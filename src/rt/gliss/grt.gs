@@ -24,8 +24,25 @@
 ;; passes:
 ;; read -> expand -> (eval) -> compile -> bytecomp
 
-;; read a datum from a stream
+;; a stream over the bytes of a string or bytestring, which `read'
+;; parses natively
+(define (open-bytes bs)
+  (list bs (box 0)))
+
+;; a stream over the contents of a source file
+(define (open-source-file path)
+  (static-cond
+   (gliss (open-bytes (map-file-bytes path)))
+   (racket (open-file path))))
+
+;; read a datum from a stream, either one from `open-bytes' or a box
+;; of a char list
 (define (read s)
+  (if (list? s)
+      (read-from-bytes (car s) (cadr s))
+      (read-chars s)))
+
+(define (read-chars s)
   (case (skip-ws! s)
     ((#false) eof)
     ((#\() (iter-next! s) (read-list-tail s))
@@ -64,8 +81,8 @@
       (line-comment s))))
 
 (define (read-token s)
-  (let ((tok-chars (read-token-0 s))
-        (tok (list->string tok-chars)))
+  (let ((sb (make-string-builder))
+        (tok (begin (read-token-0 s sb) (sb->string sb))))
     (cond
       ((or (string=? tok "true")
            (string=? tok "#true")) true)
@@ -90,23 +107,21 @@
        (string->number tok))
       (else (intern tok)))))
 
-(define (read-token-0 s)
+(define (read-token-0 s sb)
   (let ((c (iter-peek s)))
-    (if (or (not c)
-            (char-whitespace? c)
-            (eq? c #\))
-            (eq? c #\()
-            (eq? c #\"))
-        nil
-        (cons
-         (iter-next! s)
-         (if (eq? c #\\)
-             (cons
-              (or
-               (iter-next! s)
-               (raise "Unexpected EOF reading token"))
-              (read-token-0 s))
-             (read-token-0 s))))))
+    (when (not (or (not c)
+                   (char-whitespace? c)
+                   (eq? c #\))
+                   (eq? c #\()
+                   (eq? c #\")))
+      (sb-push-char! sb (iter-next! s))
+      (when (eq? c #\\)
+        (sb-push-char!
+         sb
+         (or
+          (iter-next! s)
+          (raise "Unexpected EOF reading token"))))
+      (read-token-0 s sb))))
 
 (define (read-list-tail s)
   (case (skip-ws! s)
@@ -115,18 +130,21 @@
     (else (cons (read s) (read-list-tail s)))))
 
 (define (read-string-tail s)
-  (let ((string-chars (read-string-tail-0 s)))
-    (list->string string-chars)))
+  (let ((sb (make-string-builder)))
+    (read-string-tail-0 s sb)
+    (sb->string sb)))
 
-(define (read-string-tail-0 s)
+(define (read-string-tail-0 s sb)
   (let ((c (iter-next! s)))
     (case c
       ((#false) (raise "Unclosed string"))
       ((#\") nil)
       ((#\\)
-       (let ((e (iter-next! s)))
-         (cons e (read-string-tail-0 s))))
-      (else (cons c (read-string-tail-0 s))))))
+       (sb-push-char! sb (or (iter-next! s) (raise "Unclosed string")))
+       (read-string-tail-0 s sb))
+      (else
+       (sb-push-char! sb c)
+       (read-string-tail-0 s sb)))))
 
 ;; expand a datum
 (define (expand form)
@@ -322,7 +340,7 @@
           (cddr name+spec+body)
           nil))
         (captures (unbox captures))
-        (capture-count (count captures)))
+        (capture-count (map-count captures)))
     (foldr
      (lambda (capture &tail)
        (load-var
@@ -331,8 +349,10 @@
      (cons
       `(lambda ~capture-count ~lambda-insns)
       &tail)
-     ;; these were collected in reverse
-     (reverse captures))))
+     ;; in the order of their (closed i) indices
+     (sort
+      (lambda (l r) (< (cadr (caadr l)) (cadr (caadr r))))
+      (map->list captures)))))
 
 (define (compile-let &env form &tail)
   (compile-let* &env (cadr form) (cddr form) &tail))
@@ -381,7 +401,7 @@
                   (-> parent-env (get 'vars) (get sym))
                   (find-captured-var parent-env sym))))
             (when var-in-parent
-              (let ((var-here `(closed ~(count existing-captures))))
+              (let ((var-here `(closed ~(map-count existing-captures))))
                 (box-set!
                  captures-box
                  (assoc
@@ -394,195 +414,255 @@
    (list 'load var)
    &tail))
 
-(define (eval-0 expr)
-  (let (;; compile code
-        (code (compile (empty-env) expr nil))
-        (iw (new-image-writer))
-        (start (bytecomp! iw code))
-        (bv (new-bytevector 0))
-        (_ (image-writer->bytes iw bv))
-        (image-bytes (bytevector->bytestring bv))
-
-        ;; load code
-        (image (index-image image-bytes))
-        (start-fn (new-image-closure image start)))
-    (start-fn)))
-
 ;; eval:
 ;;   native on Racket
 ;;   calls eval-0 in self-hosted runtime
 
+(define (expand-program & top-exprs)
+  (map
+   (lambda (expr)
+     (let ((expanded-expr (expand expr)))
+       (eval expanded-expr)
+       expanded-expr))
+   top-exprs))
+
+(define (compile-expanded expanded)
+  (foldr
+   (lambda (expanded-expr &tail)
+     (compile
+      (empty-env)
+      expanded-expr
+      (cons '(drop) &tail)))
+   nil
+   expanded))
+
 (define (compile-program & top-exprs)
-  (let ((expanded
-         (map
-          (lambda (expr)
-            (let ((expanded-expr (expand expr)))
-              (eval expanded-expr)
-              expanded-expr))
-          top-exprs)))
-    (foldr
-     (lambda (expanded-expr &tail)
-       (compile
-        (empty-env)
-        expanded-expr
-        (cons '(drop) &tail)))
-     nil
-     expanded)))
+  (compile-expanded (apply expand-program top-exprs)))
 
 ;; bytecode writing
 
 (define (write-padding-off! bv off)
   (let ((dist-to-four (- (modulo (+ off (bytevector-length bv)) -4))))
-    (bytevector-ensure! bv dist-to-four)
     (bytevector-set-len! bv (+ (bytevector-length bv) dist-to-four))))
 (define (write-padding! bv)
   (write-padding-off! bv 0))
 
-(define (write-u16le! bv int)
-  (bytevector-push!
-   bv
-   (bitwise-and 255 int)
-   (bitwise-and 255 (arithmetic-shift int -8))))
-(define (write-u32le! bv int)
-  (bytevector-push!
-   bv
-   (bitwise-and 255 int)
-   (bitwise-and 255 (arithmetic-shift int -8))
-   (bitwise-and 255 (arithmetic-shift int -16))
-   (bitwise-and 255 (arithmetic-shift int -24))))
-(define (write-u32le-at! bv pos int)
-  (let ((buf (bytevector-buf bv)))
-    (bytestring-set! buf pos
-                     (bitwise-and 255 int))
-    (bytestring-set! buf (+ pos 1)
-                     (bitwise-and 255 (arithmetic-shift int -8)))
-    (bytestring-set! buf (+ pos 2)
-                     (bitwise-and 255 (arithmetic-shift int -16)))
-    (bytestring-set! buf (+ pos 3)
-                     (bitwise-and 255 (arithmetic-shift int -24)))))
-(define (write-u64le! bv int)
-  (bytevector-push!
-   bv
-   (bitwise-and 255 int)
-   (bitwise-and 255 (arithmetic-shift int -8))
-   (bitwise-and 255 (arithmetic-shift int -16))
-   (bitwise-and 255 (arithmetic-shift int -24))
-   (bitwise-and 255 (arithmetic-shift int -32))
-   (bitwise-and 255 (arithmetic-shift int -40))
-   (bitwise-and 255 (arithmetic-shift int -48))
-   (bitwise-and 255 (arithmetic-shift int -56))))
-
-(define (new-constant-writer)
-  (list
-   (box nil) ;; constants reverse list
-   (box 0) ;; length
-   ))
+(define-record-type constant-writer
+  (make-constant-writer constants length symbols live? dedupe)
+  constant-writer?
+  ;; constants reverse list
+  (constants constant-writer-constants set-constant-writer-constants!)
+  (length constant-writer-length set-constant-writer-length!)
+  ;; symbol constants and their hashes, reverse list
+  (symbols constant-writer-symbols set-constant-writer-symbols!)
+  (live? constant-writer-live?)
+  ;; dedupe tree, or false to not dedupe
+  (dedupe constant-writer-dedupe))
+
+(define (new-constant-writer dedupe?)
+  (make-constant-writer nil 0 nil false (and dedupe? (box nil))))
+;; a constant writer that keeps constants as values instead of
+;; encoding them, for images that are loaded with `live-image'
+(define (new-live-constant-writer)
+  ;; constants are values, and there are no symbol constants
+  (make-constant-writer nil 0 nil true (box nil)))
+
+;; constants that are equal by value share one entry; strings, symbols
+;; and directs are looked up in an unbalanced binary tree of
+;; (hash entries left right) nodes, which stays shallow since the
+;; hashes are well mixed
+(define (mix-hash n)
+  (bitwise-and 4294967295 (* 2654435761 (bitwise-and 268435455 n))))
+(define (constant-dedupe-hash cnst)
+  (cond
+    ((symbol? cnst) (symbol-hash cnst))
+    ((string? cnst) (string-hash cnst))
+    ((number? cnst) (mix-hash cnst))
+    ((char? cnst) (mix-hash (+ 1 (char->integer cnst))))
+    ((nil? cnst) 1)
+    ((eq? cnst true) 2)
+    ((eq? cnst false) 3)
+    (else false)))
+(define (constant-dedupe=? l r)
+  (if (string? l)
+      (and (string? r) (string=? l r))
+      (eq? l r)))
+;; the box holding the node for hash in the tree rooted at node-box,
+;; which holds nil if there is no such node
+(define (dedupe-node-box node-box hash)
+  (if-let (node (unbox node-box))
+    (cond
+      ((= hash (car node)) node-box)
+      ((< hash (car node)) (dedupe-node-box (caddr node) hash))
+      (else (dedupe-node-box (cadddr node) hash)))
+    node-box))
+(define (dedupe-entry-index entries cnst)
+  (cond
+    ((nil? entries) false)
+    ((constant-dedupe=? (caar entries) cnst) (cadar entries))
+    (else (dedupe-entry-index (cdr entries) cnst))))
+(define (constant-writer-dedupe! cw cnst add!)
+  (if-let (hash (and (constant-writer-dedupe cw)
+                     (constant-dedupe-hash cnst)))
+    (let ((node-box (dedupe-node-box (constant-writer-dedupe cw) hash)))
+      (when (nil? (unbox node-box))
+        (box-set! node-box (list hash (box nil) (box nil) (box nil))))
+      (let ((entries (cadr (unbox node-box))))
+        (if-let (idx (dedupe-entry-index (unbox entries) cnst))
+          idx
+          (let ((idx (add! cw cnst)))
+            (box-swap! entries rcons (list cnst idx))
+            idx))))
+    (add! cw cnst)))
 
 (define (constant-writer-add0! cw cnst-bytes)
-  (box-swap! (car cw) rcons cnst-bytes)
-  (dec (box-swap! (cadr cw) inc)))
+  (set-constant-writer-constants! cw (cons cnst-bytes (constant-writer-constants cw)))
+  (let ((idx (constant-writer-length cw)))
+    (set-constant-writer-length! cw (inc idx))
+    idx))
 
+(define const-lambda 0)
 (define const-list 1)
 (define const-direct 2)
 (define const-symbol 3)
 (define const-string 4)
 
-(define (constant-writer-add! cw cnst)
+(define (constant-writer-encode! cw cnst)
   (let ((bv (new-bytevector 0)))
     (cond
       ((or (nil? cnst)
            (boolean? cnst))
-       (write-u32le! bv const-direct)
-       (write-u64le!
+       (bytevector-push-u32le! bv const-direct)
+       (bytevector-push-u64le!
         bv
         (case cnst
           ((()) 6) ;; nil
           ((#true) 10)
           ((#false) 14))))
       ((number? cnst)
-       (write-u32le! bv const-direct)
+       (bytevector-push-u32le! bv const-direct)
        ;; avoid overflow, tags are 2 bits
-       (write-u32le! bv (arithmetic-shift cnst 2))
-       (write-u32le! bv (arithmetic-shift cnst -30)))
+       (bytevector-push-u32le! bv (arithmetic-shift cnst 2))
+       (bytevector-push-u32le! bv (arithmetic-shift cnst -30)))
       ((char? cnst)
-       (write-u32le! bv const-direct)
-       (write-u32le! bv 2) ;; tag
-       (write-u32le! bv (char->integer cnst)))
+       (bytevector-push-u32le! bv const-direct)
+       (bytevector-push-u32le! bv 2) ;; tag
+       (bytevector-push-u32le! bv (char->integer cnst)))
       ((symbol? cnst)
-       (write-u32le! bv const-symbol)
+       (bytevector-push-u32le! bv const-symbol)
        (let ((bs (symbol->bytestring cnst)))
-         (write-u32le! bv (bytestring-length bs))
+         (bytevector-push-u32le! bv (bytestring-length bs))
          (bytevector-append! bv bs))
        (write-padding! bv))
       ((string? cnst)
-       (write-u32le! bv const-string)
+       (bytevector-push-u32le! bv const-string)
        (let ((bs (string->bytestring cnst)))
-         (write-u32le! bv (bytestring-length bs))
+         (bytevector-push-u32le! bv (bytestring-length bs))
          (bytevector-append! bv bs))
        (write-padding! bv))
       ((list? cnst)
-       (write-u32le! bv const-list)
-       (write-u32le! bv (count cnst))
+       (bytevector-push-u32le! bv const-list)
+       (bytevector-push-u32le! bv (count cnst))
        (run!
         (lambda (elt)
-          (write-u32le! bv (constant-writer-add! cw elt)))
+          (bytevector-push-u32le! bv (constant-writer-add! cw elt)))
         cnst))
       (else (raise (list "Could not encode constant" cnst))))
+    (let ((idx (constant-writer-add0! cw (bytevector->bytestring bv))))
+      (when (symbol? cnst)
+        (set-constant-writer-symbols!
+         cw
+         (cons (list idx (symbol-hash cnst)) (constant-writer-symbols cw))))
+      idx)))
+(define (constant-writer-add! cw cnst)
+  (constant-writer-dedupe!
+   cw cnst
+   (if (constant-writer-live? cw)
+       constant-writer-add0!
+       constant-writer-encode!)))
+(define (constant-writer-add-lambda! cw code)
+  (let ((bv (new-bytevector 0)))
+    (bytevector-push-u32le! bv const-lambda)
+    (bytevector-push-u32le! bv code)
+    (bytevector-push-u32le! bv 0) ;; no captures
     (constant-writer-add0! cw (bytevector->bytestring bv))))
-(define (constant-writer->bytes cw bv)
-  (when (unbox (car cw))
-    (write-u32le! bv sec-constants)
-    (write-u32le! bv (unbox (cadr cw)))
+(define (constant-writer->bytes cw bv drain!)
+  (when (constant-writer-constants cw)
+    (bytevector-push-u32le! bv sec-constants)
+    (bytevector-push-u32le! bv (constant-writer-length cw))
     (run!
      (lambda (cnst)
-       (bytevector-append! bv cnst))
-     (reverse (unbox (car cw))))))
+       (bytevector-append! bv cnst)
+       (drain! bv))
+     (reverse (constant-writer-constants cw)))))
+(define (constant-writer-symbols->bytes cw bv)
+  (when-let (syms (constant-writer-symbols cw))
+    (bytevector-push-u32le! bv sec-symbols)
+    (bytevector-push-u32le! bv (count syms))
+    (run!
+     (lambda (sym)
+       (bytevector-push-u32le! bv (car sym)) ;; symbol
+       (bytevector-push-u32le! bv (cadr sym)) ;; hash
+       )
+     (sort (lambda (l r) (< (cadr l) (cadr r))) syms))))
+
+(define-record-type codes-writer
+  (make-codes-writer codes length)
+  codes-writer?
+  ;; codes reverse list
+  (codes codes-writer-codes set-codes-writer-codes!)
+  (length codes-writer-length set-codes-writer-length!))
 
 (define (new-codes-writer)
-  (list
-   (box nil) ;; codes reverse list
-   (box 0) ;; length
-   ))
+  (make-codes-writer nil 0))
 (define (codes-writer-add! cw code)
-  (box-swap! (car cw) rcons code)
-  (dec (box-swap! (cadr cw) inc)))
-(define (codes-writer->bytes cw bv)
-  (when (unbox (car cw))
-    (write-u32le! bv sec-codes)
-    (write-u32le! bv (unbox (cadr cw)))
+  (set-codes-writer-codes! cw (cons code (codes-writer-codes cw)))
+  (let ((idx (codes-writer-length cw)))
+    (set-codes-writer-length! cw (inc idx))
+    idx))
+(define (codes-writer->bytes cw bv drain!)
+  (when (codes-writer-codes cw)
+    (bytevector-push-u32le! bv sec-codes)
+    (bytevector-push-u32le! bv (codes-writer-length cw))
     (run!
      (lambda (code)
-       (bytevector-append! bv code))
-     (reverse (unbox (car cw))))))
+       (bytevector-append! bv code)
+       (drain! bv))
+     (reverse (codes-writer-codes cw)))))
+
+(define-record-type code-body-writer
+  (make-code-body-writer code max-stack max-locals labels stack stackmap)
+  code-body-writer?
+  (code code-body-writer-code)
+  (max-stack code-body-writer-max-stack set-code-body-writer-max-stack!)
+  (max-locals code-body-writer-max-locals set-code-body-writer-max-locals!)
+  (labels code-body-writer-labels set-code-body-writer-labels!)
+  ;; current stack
+  (stack code-body-writer-stack set-code-body-writer-stack!)
+  (stackmap code-body-writer-stackmap))
 
 (define (new-code-body-writer)
-  (list
-   (new-bytevector 0) ;; code
-   (box 0) ;; max stack
-   (box 0) ;; max locals
-   (box empty-map) ;; labels
-   (box 0) ;; current stack
-   (new-bytevector 0) ;; stack map
-   ))
-(define (code-body-writer-labels* cw) (cadddr cw))
-(define (code-body-writer-stackmap cw) (cadr (cddddr cw)))
+  (make-code-body-writer (new-bytevector 0) 0 0 empty-map 0 (new-bytevector 0)))
 (define (code-body-writer->code cw)
-  (let ((insns-bv (car cw))
+  (let ((insns-bv (code-body-writer-code cw))
         (bv (new-bytevector (+ 12 (bytevector-length insns-bv)))))
-    (write-u32le! bv (bytevector-length insns-bv))
-    (write-u32le! bv (unbox (cadr cw)))
-    (write-u32le! bv (unbox (caddr cw)))
-    (write-u32le! bv (count (unbox (cadddr cw))))
+    (bytevector-push-u32le! bv (bytevector-length insns-bv))
+    (bytevector-push-u32le! bv (code-body-writer-max-stack cw))
+    (bytevector-push-u32le! bv (code-body-writer-max-locals cw))
+    (bytevector-push-u32le! bv (map-count (code-body-writer-labels cw)))
     (bytevector-append! bv (bytevector->bytestring insns-bv))
     (write-padding! bv)
     (bytevector-append! bv (bytevector->bytestring (code-body-writer-stackmap cw)))
     ;; no padding
     (bytevector->bytestring bv)))
 (define (cbw-ensure-local! cw locals)
-  (box-swap! (caddr cw) max (inc locals)))
+  (set-code-body-writer-max-locals!
+   cw (max (code-body-writer-max-locals cw) (inc locals))))
 (define (cbw-push! cw pushed)
-  (let ((new-stack (box-swap! (car (cddddr cw)) + pushed)))
-    (box-swap! (cadr cw) max new-stack)
+  (let ((new-stack (+ (code-body-writer-stack cw) pushed)))
+    (set-code-body-writer-stack! cw new-stack)
+    (set-code-body-writer-max-stack!
+     cw (max (code-body-writer-max-stack cw) new-stack))
     new-stack))
 
 (define opc-drop 1)
@@ -601,15 +681,15 @@
 (define opc-closure-ref 23)
 
 (define (cbw-emit-ldc! cw iw what)
-  (let ((bv (car cw)))
+  (let ((bv (code-body-writer-code cw)))
     (bytevector-push! bv opc-ldc)
-    (write-u32le!
+    (bytevector-push-u32le!
      bv
      (constant-writer-add!
       (image-writer-constants iw)
       what))))
 (define (code-body-writer-emit! cw iw insn)
-  (let ((bv (car cw)))
+  (let ((bv (code-body-writer-code cw)))
     (case (car insn)
       ((load)
        (cbw-push! cw 1)
@@ -656,8 +736,7 @@
               argc) ;; pops args
              ))))
       ((br-if-not br)
-       (let ((lbl (cadr insn))
-             (lbls* (code-body-writer-labels* cw)))
+       (let ((lbl (cadr insn)))
          (bytevector-push!
           bv
           (case (car insn)
@@ -667,103 +746,306 @@
             ((br-if-not)
              (cbw-push! cw -1)
              opc-br-if-not)))
-         (let ((ip (bytevector-length bv))
-               (found* (or (get (unbox lbls*) lbl) (box nil)))
-               (found (unbox found*))
-               (to-write
-                (cond
-                  ((number? found) found)
-                  (else
-                   (box-swap! found* rcons ip)
-                   (when (nil? found)
-                     (box-swap! lbls* assoc lbl found*))
-                   0))))
-           (write-u32le! bv (- (or found ip) ip)))))
+         ;; a label maps to a box of either its ip, once placed, or
+         ;; the positions of the offsets waiting for it; offsets are
+         ;; relative to the end of the branch, as the interpreter reads
+         ;; them
+         (let ((pos (bytevector-length bv))
+               (found* (or (get (code-body-writer-labels cw) lbl) (box nil)))
+               (found (unbox found*)))
+           (cond
+             ((number? found)
+              (bytevector-push-u32le! bv (- found (+ pos 4))))
+             (else
+              (box-swap! found* rcons pos)
+              (when (nil? found)
+                (set-code-body-writer-labels!
+                 cw (assoc (code-body-writer-labels cw) lbl found*)))
+              (bytevector-push-u32le! bv 0))))))
       ((label)
+       ;; every label gets a stack map entry, whether it is reached
+       ;; by branches from before or after it
        (let ((lbl (cadr insn))
-             (lbls* (code-body-writer-labels* cw))
-             (ip (bytevector-length bv)))
-         (box-swap!
-          lbls*
-          (lambda (lbls)
-            (let ((found* (get lbls lbl)))
-              (cond
-                (found*
-                 (run!
-                  (lambda (write-target)
-                    (write-u32le-at!
-                     bv
-                     write-target
-                     (- ip (+ write-target 4))))
-                  (unbox found*))
-                 (box-set! found* ip)
-                 (let ((sm (code-body-writer-stackmap cw)))
-                   (write-u32le! sm ip)
-                   (write-u32le! sm (cbw-push! cw 0)))
-                 lbls)
-                (else (assoc lbls lbl (box ip)))))))))
+             (ip (bytevector-length bv))
+             (lbls (code-body-writer-labels cw))
+             (found* (get lbls lbl)))
+         (cond
+           ((not found*)
+            (set-code-body-writer-labels! cw (assoc lbls lbl (box ip))))
+           ((number? (unbox found*))
+            (raise (list "Label placed twice" lbl)))
+           (else
+            (run!
+             (lambda (write-target)
+               (bytevector-set-u32le-at!
+                bv
+                write-target
+                (- ip (+ write-target 4))))
+             (unbox found*))
+            (box-set! found* ip)))
+         (let ((sm (code-body-writer-stackmap cw)))
+           (bytevector-push-u32le! sm ip)
+           (bytevector-push-u32le! sm (cbw-push! cw 0)))))
       ((lambda)
        (let ((argc (cadr insn))
              (body (caddr insn))
              (body-idx (bytecomp! iw body)))
          (cbw-push! cw (- (dec argc)))
          (bytevector-push! bv opc-lambda)
-         (write-u32le! bv body-idx)
-         (write-u16le! bv argc)))
+         (bytevector-push-u32le! bv body-idx)
+         (bytevector-push-u16le! bv argc)))
       (else (raise (list "Uncompilable insn" insn))))))
 (define (code-body-writer-flush! cw iw)
   (let ((height (cbw-push! cw 0))
-        (bv (car cw)))
+        (bv (code-body-writer-code cw)))
     (bytevector-push! bv opc-ret)
     (bytevector-push! bv height)))
 
-(define (new-image-writer)
-  (list
-   (new-constant-writer) ;; constants
-   (new-codes-writer) ;; codes
-   (box nil) ;; bindings
-   (box nil) ;; start
-   ))
-(define (image-writer-constants iw) (car iw))
-(define (image-writer-codes iw) (cadr iw))
-(define (image-writer-bindings iw) (unbox (caddr iw)))
+(define-record-type image-writer
+  (make-image-writer constants codes)
+  image-writer?
+  (constants image-writer-constants)
+  (codes image-writer-codes)
+  ;; unused by live image writers
+  (bindings image-writer-bindings set-image-writer-bindings!)
+  (start image-writer-start image-writer-set-start!))
+
+(define (new-image-writer) (new-image-writer* true))
+;; an image writer that only dedupes constants if dedupe? is true
+(define (new-image-writer* dedupe?)
+  (make-image-writer (new-constant-writer dedupe?) (new-codes-writer)))
+(define (new-live-image-writer)
+  (make-image-writer (new-live-constant-writer) (new-codes-writer)))
 (define (image-writer-add-binding! iw key val)
-  (box-swap! (caddr iw) rcons (list key val)))
-(define (image-writer-start iw) (unbox (cadddr iw)))
-(define (image-writer-set-start! iw s) (box-set! (cadddr iw) s))
+  (set-image-writer-bindings! iw (cons (list key val) (image-writer-bindings iw))))
 
 (define magic-u32le 7564391)
 (define sec-constants 1)
 (define sec-codes 2)
 (define sec-bindings 3)
 (define sec-start 4)
+(define sec-symbols 5)
 
 (define (image-writer->bytes iw bv)
-  (write-u32le! bv magic-u32le)
-  (write-u32le! bv 1) ;; version
-  (constant-writer->bytes (image-writer-constants iw) bv)
-  (codes-writer->bytes (image-writer-codes iw) bv)
+  (image-writer-write! iw bv (lambda (bv) nil)))
+
+;; write the image to a port, through a bytevector which is drained
+;; to the port whenever it fills up past a few kilobytes, so that the
+;; whole image never has to be held in memory at once
+(define (image-writer->port iw port)
+  (let ((drain!
+         (lambda (bv)
+           (when (< 4096 (bytevector-length bv))
+             (write-bytes port (bytevector->bytestring bv)))))
+        (bv (new-bytevector 0)))
+    (image-writer-write! iw bv drain!)
+    (write-bytes port (bytevector->bytestring bv))))
+
+;; write the image to bv, calling drain! with it whenever it may be
+;; emptied
+(define (image-writer-write! iw bv drain!)
+  (bytevector-push-u32le! bv magic-u32le)
+  (bytevector-push-u32le! bv 1) ;; version
+  (constant-writer->bytes (image-writer-constants iw) bv drain!)
+  (codes-writer->bytes (image-writer-codes iw) bv drain!)
   (when (image-writer-bindings iw)
-    (write-u32le! bv sec-bindings)
+    (bytevector-push-u32le! bv sec-bindings)
+    (bytevector-push-u32le! bv (count (image-writer-bindings iw)))
     (run!
      (lambda (bd)
-       (write-u32le! bv (car bd)) ;; symbol
-       (write-u32le! bv (cadr bd)) ;; value
+       (bytevector-push-u32le! bv (car bd)) ;; symbol
+       (bytevector-push-u32le! bv (cadr bd)) ;; value
        )
      (reverse (image-writer-bindings iw))))
   (when-let (start (image-writer-start iw))
-    (write-u32le! bv sec-start)
-    (write-u32le! bv start)))
+    (bytevector-push-u32le! bv sec-start)
+    (bytevector-push-u32le! bv start))
+  (constant-writer-symbols->bytes (image-writer-constants iw) bv))
 
 ;; write instructions generated by `compile' to bytecode
 ;; returns the code index
 (define (bytecomp! iw insns)
-  (let ((cw (new-code-body-writer)))
-    (run!
-     (lambda (insn)
-       (code-body-writer-emit! cw iw insn))
-     insns)
-    (code-body-writer-flush! cw iw)
-    (codes-writer-add!
-     (image-writer-codes iw)
-     (code-body-writer->code cw))))
+  (codes-writer-add!
+   (image-writer-codes iw)
+   (static-cond
+    ;; natively, with the same rules as `code-body-writer-emit!'
+    (gliss
+     (assemble-code
+      insns
+      (lambda (cnst) (constant-writer-add! (image-writer-constants iw) cnst))
+      (lambda (body) (bytecomp! iw body))))
+    (racket
+     (let ((cw (new-code-body-writer)))
+       (run!
+        (lambda (insn)
+          (code-body-writer-emit! cw iw insn))
+        insns)
+       (code-body-writer-flush! cw iw)
+       (code-body-writer->code cw))))))
+
+(define (image-writer->live-image iw)
+  (live-image
+   (reverse (codes-writer-codes (image-writer-codes iw)))
+   (reverse (constant-writer-constants (image-writer-constants iw)))))
+
+;; compile and run expr without writing an image to bytes, its
+;; constants are passed to the runtime as they are
+(define (eval-0 expr)
+  (let ((code (compile (empty-env) expr nil))
+        (iw (new-live-image-writer))
+        (start (bytecomp! iw code))
+        (image (image-writer->live-image iw))
+        (start-fn (new-image-closure image start)))
+    (start-fn)))
+
+;; top-level definitions of lambdas and literals are written as
+;; bindings, which the runtime sets before running the start code
+
+;; (name value) of a top-level definition that can be a binding, or false
+(define (top-binding form)
+  (and form
+       (list? form)
+       (eq? 'symbol-set-value! (car form))
+       (eq? 3 (count form))
+       (let ((target (cadr form))
+             (value (caddr form)))
+         (and (list? target)
+              (eq? 'quote (car target))
+              (or (literal? value)
+                  (and (list? value)
+                       (or (eq? 'lambda (car value))
+                           (eq? 'quote (car value)))))
+              (list (cadr target) value)))))
+
+;; quoted symbol that form assigns to, whatever the value, or false
+(define (assigned-symbol form)
+  (and (eq? 'symbol-set-value! (car form))
+       (eq? 3 (count form))
+       (let ((target (cadr form)))
+         (and target
+              (list? target)
+              (eq? 'quote (car target))
+              (symbol? (cadr target))
+              (cadr target)))))
+
+;; how many times each quoted symbol is assigned anywhere in form, so
+;; only symbols assigned exactly once are made bindings
+(define (count-assignments counts form)
+  (if (and form (list? form))
+      (let ((counts
+             (if-let (sym (assigned-symbol form))
+               (update counts sym (lambda (n) (inc (or n 0))))
+               counts)))
+        (foldl count-assignments counts form))
+      counts))
+
+(define (flatten-begins forms)
+  (foldr
+   (lambda (form rest)
+     (if (and form (list? form) (eq? 'begin (car form)))
+         (concat (flatten-begins (cdr form)) rest)
+         (cons form rest)))
+   nil
+   forms))
+
+;; write expanded top-level forms to the image writer,
+;; returns the start code index
+(define (bytecomp-program! iw expanded)
+  (let ((forms (flatten-begins expanded))
+        (counts (foldl count-assignments empty-map forms))
+        (cw (image-writer-constants iw)))
+    (bytecomp!
+     iw
+     (compile-expanded
+      (foldr
+       (lambda (form rest)
+         (let ((bd (top-binding form)))
+           (if (and bd (eq? 1 (get counts (car bd))))
+               (let ((insn (car (compile (empty-env) (cadr bd) nil))))
+                 (image-writer-add-binding!
+                  iw
+                  (constant-writer-add! cw (car bd))
+                  (case (car insn)
+                    ((lambda) (constant-writer-add-lambda! cw (bytecomp! iw (caddr insn))))
+                    ((const) (constant-writer-add! cw (cadr insn)))))
+                 rest)
+               (cons form rest))))
+       nil
+       forms)))))
+
+;; tree shaking: drop top-level bindings that are not reachable from
+;; `main' or the start code. Code that can reach eval may refer to
+;; any binding by name, so nothing is dropped then. Otherwise macro
+;; markings are dropped too, since nothing will expand with them.
+
+(define shake-dynamic-symbols '(eval eval-0))
+
+;; symbol marked as a macro by a top-level form, or false
+(define (top-macro-mark form)
+  (and form
+       (list? form)
+       (eq? 'symbol-set-macro! (car form))
+       (eq? 3 (count form))
+       (let ((target (cadr form)))
+         (and (list? target)
+              (eq? 'quote (car target))
+              (cadr target)))))
+
+;; every symbol in form, quoted or not, consed onto acc
+(define (collect-symbols acc form)
+  (cond
+    ((symbol? form) (cons form acc))
+    ((and form (list? form)) (foldl collect-symbols acc form))
+    (else acc)))
+
+;; mark the bindings reachable from sym, false if eval is reachable
+(define (shake-visit! marked bindings sym)
+  (cond
+    ((some (lambda (dyn) (eq? dyn sym)) shake-dynamic-symbols) false)
+    ((find (unbox marked) sym) true)
+    (else
+     (if-let (bd (find bindings sym))
+       (begin
+         (box-swap! marked assoc sym true)
+         (all (lambda (sym) (shake-visit! marked bindings sym))
+              (collect-symbols nil (cadr bd))))
+       true))))
+
+;; remove unreachable top-level definitions from expanded forms
+(define (shake-program expanded)
+  (let ((forms (flatten-begins expanded))
+        (counts (foldl count-assignments empty-map forms))
+        (binding-of
+         (lambda (form)
+           (when-let (bd (top-binding form))
+             (and (eq? 1 (get counts (car bd))) bd))))
+        (bindings
+         (foldl
+          (lambda (acc form)
+            (if-let (bd (binding-of form))
+              (assoc acc (car bd) (cadr bd))
+              acc))
+          empty-map
+          forms))
+        (roots
+         (foldl
+          (lambda (acc form)
+            (if (or (binding-of form) (top-macro-mark form))
+                acc
+                (collect-symbols acc form)))
+          '(main)
+          forms))
+        (marked (box empty-map)))
+    (if (all (lambda (sym) (shake-visit! marked bindings sym)) roots)
+        (foldr
+         (lambda (form rest)
+           (cond
+             ((binding-of form)
+              (if (find (unbox marked) (car (binding-of form)))
+                  (cons form rest)
+                  rest))
+             ((top-macro-mark form) rest)
+             (else (cons form rest))))
+         nil
+         forms)
+        expanded)))
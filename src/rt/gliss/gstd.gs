@@ -194,6 +194,19 @@
 (defmacro (static-when pred & body)
   `(static-cond (~pred ~@body)))
 
+;; native in the gliss VM, where they call f without an interpreted
+;; frame per element and don't recurse on long lists; the definitions
+;; above serve until here, and on Racket
+(static-cond
+ (gliss
+  (define map-0 list-map)
+  (define map list-map)
+  (define some list-some)
+  (define all list-all)
+  (define foldl list-foldl)
+  (define foldr list-foldr)
+  (define concat list-concat)))
+
 (defmacro (and & exprs)
   (if exprs
       (if (cdr exprs)
@@ -261,58 +274,109 @@
          x))
    x forms))
 
-(define (list* & args)
-  (cond
-    ((nil? args) nil)
-    ((nil? (cdr args)) (car args))
-    (else (cons (car args)
-                (apply list* (cdr args))))))
-
-(define (enumerate-from i xs)
-  (if xs
-      (cons
-       (list i (car xs))
-       (enumerate-from
-        (+ i 1)
-        (cdr xs)))
-      nil))
-
-(define (enumerate xs)
-  (enumerate-from 0 xs))
+;; native in the gliss VM
+(static-cond
+ (gliss)
+ (racket
+  (define (list* & args)
+    (cond
+      ((nil? args) nil)
+      ((nil? (cdr args)) (car args))
+      (else (cons (car args)
+                  (apply list* (cdr args))))))
 
-(define (count xs)
-  (if (list? xs)
-      ((lambda recur (n xs)
+  (define (enumerate-from i xs)
+    (if xs
+        (cons
+         (list i (car xs))
+         (enumerate-from
+          (+ i 1)
+          (cdr xs)))
+        nil))
+
+  (define (enumerate xs)
+    (enumerate-from 0 xs))
+
+  (define (count xs)
+    (if (list? xs)
+        ((lambda recur (n xs)
+           (if xs
+               (recur (inc n) (cdr xs))
+               n))
+         0 xs)
+        (raise (list "Not a list" xs))))
+
+  (define (reverse xs)
+    ((lambda recur (xs tl)
+       (if xs
+           (recur (cdr xs) (cons (car xs) tl))
+           tl))
+     xs nil))))
+
+(define (merge-sorted less? xs ys)
+  ((lambda recur (xs ys acc)
+     (cond
+       ((nil? xs) (foldl rcons ys acc))
+       ((nil? ys) (foldl rcons xs acc))
+       ((less? (car ys) (car xs)) (recur xs (cdr ys) (cons (car ys) acc)))
+       (else (recur (cdr xs) ys (cons (car xs) acc)))))
+   xs ys nil))
+
+;; merge sort, not stable
+(define (sort less? xs)
+  (if (or (nil? xs) (nil? (cdr xs)))
+      xs
+      ((lambda recur (xs l r)
          (if xs
-             (recur (inc n) (cdr xs))
-             n))
-       0 xs)
-      (raise (list "Not a list" xs))))
+             (recur (cdr xs) r (cons (car xs) l))
+             (merge-sorted less? (sort less? l) (sort less? r))))
+       xs nil nil)))
 
-(define (reverse xs)
-  ((lambda recur (xs tl)
-     (if xs
-         (recur (cdr xs) (cons (car xs) tl))
-         tl))
-   xs nil))
-
-;; TODO implement maps
+;; maps, keyed by eq?; nil is the empty map
 
 (define empty-map nil)
 
-(define (find assoc key)
-  (cond
-    ((not assoc) nil)
-    ((eq? (caar assoc) key) (car assoc))
-    (else (find (cdr assoc) key))))
+;; these are native hash array mapped tries in the gliss VM, and
+;; association lists on Racket
+(static-cond
+ (gliss
+  (define get hash-map-get)
+  (define assoc hash-map-assoc)
+  (define dissoc hash-map-dissoc)
+  (define map-count hash-map-count)
+  ;; the entries of a map as (key value) lists, in no particular order
+  (define map->list hash-map->list)
+
+  (define find-missing (gensym "missing"))
+  ;; the (key value) entry of key, or nil
+  (define (find map key)
+    (let ((value (hash-map-get map key find-missing)))
+      (if (eq? value find-missing)
+          nil
+          (list key value)))))
+ (racket
+  (define (find assoc key)
+    (cond
+      ((not assoc) nil)
+      ((eq? (caar assoc) key) (car assoc))
+      (else (find (cdr assoc) key))))
+
+  (define (get assoc key)
+    (if-let (kv (find assoc key))
+      (cadr kv)
+      nil))
+
+  (define (dissoc assoc key)
+    (cond
+      ((not assoc) nil)
+      ((eq? (caar assoc) key) (cdr assoc))
+      (else (cons (car assoc) (dissoc (cdr assoc) key)))))
 
-(define (get assoc key)
-  (if-let (kv (find assoc key))
-    (cadr kv)
-    nil))
+  (define (assoc assoc key val)
+    (cons (list key val) (dissoc assoc key)))
 
-(define (assoc assoc key val)
-  (cons (list key val) assoc))
+  (define (map-count assoc) (count assoc))
+  (define (map->list assoc) assoc)))
 
 (define (update map key f & args)
   (assoc
@@ -343,13 +407,21 @@
   (let ((new-v (apply f (unbox bx) args)))
     (box-set! bx new-v)
     new-v))
+(define (vector-swap! vec idx f & args)
+  (let ((new-v (apply f (vector-ref vec idx) args)))
+    (vector-set! vec idx new-v)
+    new-v))
 
 ;; bytestrings
 
-(define (bytestring-slice bytes pos len)
-  (let ((bs (new-bytestring len)))
-    (bytestring-copy! bs 0 bytes pos len)
-    bs))
+;; native in the gliss VM, where it shares the bytes instead of copying
+(static-cond
+ (gliss)
+ (racket
+  (define (bytestring-slice bytes pos len)
+    (let ((bs (new-bytestring len)))
+      (bytestring-copy! bs 0 bytes pos len)
+      bs))))
 
 (define (bytestring-resize bytes new-size)
   (let ((old-size (bytestring-length bytes)))
@@ -377,52 +449,147 @@
 
 ;; bytevectors
 
-(define (new-bytevector initial-cap)
-  (list
-   (box 0)
-   (box (new-bytestring (or initial-cap 16)))))
-
-(define (bytevector-length bv)
-  (unbox (car bv)))
-
-(define (bytevector-set-len! bv len)
-  (box-set! (car bv) len))
-
-(define (bytevector-buf bv)
-  (unbox (cadr bv)))
-
-(define (bytevector-resize-buf! bv new-cap)
-  (box-swap! (cadr bv) bytestring-resize new-cap))
-
-(define (bytevector->bytestring bv)
-  (bytestring-resize (bytevector-buf bv) (bytevector-length bv)))
-
-(define (double-until n expected)
-  (if (>= n expected) n
-      (double-until
-       (if (= 0 n) 4 (* 2 n))
-       expected)))
-
-(define (bytevector-ensure! bv space)
-  (let ((buf (bytevector-buf bv))
-        (cap (bytestring-length buf))
-        (len (bytevector-length bv))
-        (space-rem (- cap len)))
-    (when (< space-rem space)
-      (let ((new-cap (double-until cap (+ len space))))
-        (bytevector-resize-buf! bv new-cap)))))
-
-(define (bytevector-append! bv bs)
-  (let ((n (bytestring-length bs)))
-    (bytevector-ensure! bv n)
+;; these are native in the gliss VM, where they grow a buffer in place
+;; rather than resizing a bytestring in a box
+(static-cond
+ (gliss)
+ (racket
+  (define (new-bytevector initial-cap)
+    (list
+     (box 0)
+     (box (new-bytestring (or initial-cap 16)))))
+
+  (define (bytevector-length bv)
+    (unbox (car bv)))
+
+  (define (bytevector-buf bv)
+    (unbox (cadr bv)))
+
+  (define (bytevector-resize-buf! bv new-cap)
+    (box-swap! (cadr bv) bytestring-resize new-cap))
+
+  ;; leaves the bytevector empty, as the native one does
+  (define (bytevector->bytestring bv)
+    (let ((bs (bytestring-resize (bytevector-buf bv) (bytevector-length bv))))
+      (box-set! (car bv) 0)
+      (box-set! (cadr bv) (new-bytestring 16))
+      bs))
+
+  (define (double-until n expected)
+    (if (>= n expected) n
+        (double-until
+         (if (= 0 n) 4 (* 2 n))
+         expected)))
+
+  (define (bytevector-ensure! bv space)
     (let ((buf (bytevector-buf bv))
-          (i (bytevector-length bv)))
-      (bytestring-copy! buf i bs 0 n)
-      (bytevector-set-len! bv (+ i n))))
-  bv)
-
-(define (bytevector-push! bv & bs)
-  (bytevector-append! bv (list->bytestring bs)))
+          (cap (bytestring-length buf))
+          (len (bytevector-length bv))
+          (space-rem (- cap len)))
+      (when (< space-rem space)
+        (let ((new-cap (double-until cap (+ len space))))
+          (bytevector-resize-buf! bv new-cap)))))
+
+  (define (bytevector-set-len! bv len)
+    (bytevector-ensure! bv (- len (bytevector-length bv)))
+    (box-set! (car bv) len))
+
+  (define (bytevector-append! bv bs)
+    (let ((n (bytestring-length bs)))
+      (bytevector-ensure! bv n)
+      (let ((buf (bytevector-buf bv))
+            (i (bytevector-length bv)))
+        (bytestring-copy! buf i bs 0 n)
+        (box-set! (car bv) (+ i n))))
+    bv)
+
+  (define (bytevector-push! bv & bs)
+    (bytevector-append! bv (list->bytestring bs)))
+
+  (define (bytevector-push-le! bv int n)
+    (when (> n 0)
+      (bytevector-push! bv (bitwise-and 255 int))
+      (bytevector-push-le! bv (arithmetic-shift int -8) (- n 1)))
+    bv)
+  (define (bytevector-push-u16le! bv int)
+    (bytevector-push-le! bv int 2))
+  (define (bytevector-push-u32le! bv int)
+    (bytevector-push-le! bv int 4))
+  (define (bytevector-push-u64le! bv int)
+    (bytevector-push-le! bv int 8))
+
+  (define (bytevector-set-u32le-at! bv pos int)
+    (let ((buf (bytevector-buf bv)))
+      (bytestring-set! buf pos
+                       (bitwise-and 255 int))
+      (bytestring-set! buf (+ pos 1)
+                       (bitwise-and 255 (arithmetic-shift int -8)))
+      (bytestring-set! buf (+ pos 2)
+                       (bitwise-and 255 (arithmetic-shift int -16)))
+      (bytestring-set! buf (+ pos 3)
+                       (bitwise-and 255 (arithmetic-shift int -24)))))))
+
+;; records
+
+;; (define-record-type name (constructor field ...) predicate?
+;;   (field accessor [modifier]) ...)
+;; defines name as the record type, and the functions given; fields
+;; not taken by the constructor start as nil
+(defmacro (define-record-type name ctor pred & field-specs)
+  `(begin
+     (define ~name (new-record-type '~name '~(map car field-specs)))
+     (define ~(car ctor) (record-constructor ~name '~(cdr ctor)))
+     (define ~pred (record-predicate ~name))
+     ~@(map
+        (lambda (spec)
+          `(define ~(cadr spec) (record-accessor ~name '~(car spec))))
+        field-specs)
+     ~@(apply
+        concat
+        (map
+         (lambda (spec)
+           (when (cddr spec)
+             (list `(define ~(caddr spec) (record-modifier ~name '~(car spec))))))
+         field-specs))))
+
+;; these are native in the gliss VM, where each record type is a GC
+;; type of its own; on Racket records are vectors headed by their type
+(static-cond
+ (gliss)
+ (racket
+  (define (new-record-type name fields)
+    (vector name fields))
+
+  (define (record-field-index rt field)
+    ((lambda recur (i fields)
+       (cond
+         ((nil? fields) (raise (list "No such record field" field)))
+         ((eq? field (car fields)) i)
+         (else (recur (inc i) (cdr fields)))))
+     1 (vector-ref rt 1)))
+
+  (define (record-constructor rt fields)
+    (let ((idxs (map (lambda (field) (record-field-index rt field)) fields)))
+      (lambda (& args)
+        (let ((rec (make-vector (inc (count (vector-ref rt 1))))))
+          (vector-set! rec 0 rt)
+          (run! (lambda (pair) (vector-set! rec (car pair) (cadr pair)))
+                (map list idxs args))
+          rec))))
+
+  (define (record-predicate rt)
+    (lambda (x)
+      (and (vector? x)
+           (< 0 (vector-length x))
+           (eq? rt (vector-ref x 0)))))
+
+  (define (record-accessor rt field)
+    (let ((idx (record-field-index rt field)))
+      (lambda (rec) (vector-ref rec idx))))
+
+  (define (record-modifier rt field)
+    (let ((idx (record-field-index rt field)))
+      (lambda (rec x) (vector-set! rec idx x))))))
 
 ;; boxlists/iterators
 
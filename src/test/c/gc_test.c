@@ -32,6 +32,38 @@ DEFINE_GC_TYPE(
   GC(RSZ(len), Tagged), ValArray, vals
 );
 
+// Passes through to another allocator, checking that the last thing
+// allocated is freed with the same size.
+typedef struct SizeCheckingAlloc {
+  Allocator alloc;
+  Allocator *inner;
+  anyptr last;
+  AllocMeta lastMeta;
+  bool mismatched;
+} SizeCheckingAlloc;
+
+static anyptr checking_alloc(Allocator *self, AllocMeta meta) {
+  SizeCheckingAlloc *sca = (SizeCheckingAlloc *) self;
+  sca->lastMeta = meta;
+  return sca->last = sca->inner->table->alloc(sca->inner, meta);
+}
+
+static anyptr checking_realloc(Allocator *self, anyptr ptr, AllocMeta oldMeta, AllocMeta newMeta) {
+  SizeCheckingAlloc *sca = (SizeCheckingAlloc *) self;
+  return sca->inner->table->realloc(sca->inner, ptr, oldMeta, newMeta);
+}
+
+static void checking_free(Allocator *self, anyptr ptr, AllocMeta meta) {
+  SizeCheckingAlloc *sca = (SizeCheckingAlloc *) self;
+  if (ptr == sca->last) {
+    sca->mismatched |= meta.size * meta.count != sca->lastMeta.size * sca->lastMeta.count;
+    sca->last = NULL;
+  }
+  sca->inner->table->free(sca->inner, ptr, meta);
+}
+
+static AllocatorVt checking_alloc_vt = {checking_alloc, checking_realloc, checking_free};
+
 Err *gs_main() {
   {
     u8 exampleHeader[sizeof(u64) * 3];
@@ -84,11 +116,18 @@ Err *gs_main() {
   PTR_REF(Array, array).vals[0] = FIX2VAL(10);
   PTR_REF(Array, array).vals[1] = PTR2VAL_GC(pair5);
 
+  // large objects are promoted in place, and their fields still traced
+  anyptr large;
+  gs_gc_force_next_large();
+  GS_TRY(gs_gc_alloc_array(arrayIdx, 1, &large));
+  PTR_REF(Array, large).vals[0] = PTR2VAL_GC(pair4);
+
   Val toPreserve[] = {
     PTR2VAL_GC(pair3),
     PTR2VAL_GC(array),
+    PTR2VAL_GC(large),
   };
-  PUSH_DIRECT_GC_ROOTS(2, top, toPreserve);
+  PUSH_DIRECT_GC_ROOTS(3, top, toPreserve);
 
   GS_FAIL_IF_C(
     pair1 == pair2 ||
@@ -102,5 +141,98 @@ Err *gs_main() {
   GS_TRY(gs_gc_pop_scope());
   POP_GC_ROOTS(top);
 
+  GS_FAIL_IF(VAL2PTR(u8, toPreserve[2]) != large, "Large object moved", NULL);
+  {
+    LargeObject *lo = gs_global_gc->scopes[gs_global_gc->topScope].largeObjects;
+    while (lo && lo != GC_LARGE_OBJECT(GC_PTR_HEADER_REF(large))) lo = lo->next;
+    GS_FAIL_IF(!lo || lo->gen != gs_global_gc->topScope, "Large object not promoted", NULL);
+  }
+  Val moved = PTR_REF(Array, large).vals[0];
+  GS_FAIL_IF(
+    !VAL_IS_GC_PTR(moved) || PTR_REF(Cons, VAL2PTR(u8, moved)).car != FIX2VAL(0),
+    "Large object field not traced",
+    NULL
+  );
+
+  {
+    // large objects are freed with the size they were allocated with
+    SizeCheckingAlloc sca = {{&checking_alloc_vt}, gs_current_alloc, NULL, {0}, false};
+    Err *err = NULL;
+    anyptr unrooted = NULL;
+    GS_WITH_ALLOC(&sca.alloc) {
+      err = gs_gc_push_scope();
+      if (err) continue;
+      gs_gc_force_next_large();
+      err = gs_gc_alloc_array(arrayIdx, 3, &unrooted);
+      if (err) continue;
+      err = gs_gc_pop_scope();
+    }
+    GS_TRY(err);
+    GS_FAIL_IF(unrooted != NULL && sca.last != NULL, "Large object not freed", NULL);
+    GS_FAIL_IF(sca.mismatched, "Large object freed with the wrong size", NULL);
+  }
+
+  {
+    // the type table grows past its initial capacity, keeping the
+    // types already in it
+    u32 initialCap = gs_global_gc->typeCap;
+    for (u32 i = gs_global_gc->typec; i < initialCap * 2; ++i) {
+      TypeIdx idx;
+      GS_TRY(gs_gc_push_type(Cons_INFO, &idx));
+      GS_FAIL_IF(idx != i, "Types not numbered in order", NULL);
+    }
+    GS_FAIL_IF(gs_global_gc->typec != initialCap * 2, "Wrong type count", NULL);
+    GS_FAIL_IF(gs_global_gc->typeCap < initialCap * 2, "Type table did not grow", NULL);
+    TypeInfo *types = gs_global_gc->types;
+    GS_FAIL_IF(
+      types[arrayIdx].layout.size != Array_INFO.layout.size ||
+      types[initialCap * 2 - 1].layout.size != Cons_INFO.layout.size,
+      "Types lost when growing the table",
+      NULL
+    );
+  }
+
+  {
+    // objects promoted into a scope whose current page is exactly
+    // full are still scanned, when the first gray is just past its end
+    Generation *scope = &gs_global_gc->scopes[gs_global_gc->topScope];
+    anyptr filler;
+    while (MINI_PAGE_DATA_SIZE - scope->current->size > 1024) {
+      GS_TRY(gs_gc_alloc(consIdx, &filler));
+    }
+    u32 rest = MINI_PAGE_DATA_SIZE - scope->current->size;
+    GS_TRY(gs_gc_alloc_array(arrayIdx, (rest - sizeof(u64) - Array_INFO.layout.size) / sizeof(Val), &filler));
+    GS_FAIL_IF(scope->current->size != MINI_PAGE_DATA_SIZE, "Could not fill the page", NULL);
+
+    GS_TRY(gs_gc_push_scope());
+    anyptr inner, outer;
+    GS_TRY(gs_gc_alloc(consIdx, &inner));
+    PTR_REF(Cons, inner).car = FIX2VAL(7);
+    PTR_REF(Cons, inner).cdr = VAL_NIL;
+    GS_TRY(gs_gc_alloc(consIdx, &outer));
+    PTR_REF(Cons, outer).car = PTR2VAL_GC(inner);
+    PTR_REF(Cons, outer).cdr = VAL_NIL;
+    Val promoted[] = {PTR2VAL_GC(outer)};
+    PUSH_DIRECT_GC_ROOTS(1, fullPage, promoted);
+    GS_TRY(gs_gc_pop_scope());
+    POP_GC_ROOTS(fullPage);
+
+    Val innerVal = PTR_REF(Cons, VAL2PTR(u8, promoted[0])).car;
+    GS_FAIL_IF(
+      !VAL_IS_GC_PTR(innerVal) ||
+      GC_HEADER_GEN(GC_PTR_HEADER_REF(VAL2PTR(u8, innerVal))) != gs_global_gc->topScope ||
+      PTR_REF(Cons, VAL2PTR(u8, innerVal)).car != FIX2VAL(7),
+      "Promoted object not scanned",
+      NULL
+    );
+  }
+
+  {
+    // array sizes that don't fit in a u32 are refused, not wrapped
+    anyptr huge;
+    GS_FAIL_IF(!gs_gc_alloc_array(arrayIdx, UINT32_MAX / sizeof(Val) + 1, &huge), "Overflowing array allocated", NULL);
+    GS_FAIL_IF(!gs_gc_alloc_array(arrayIdx, UINT32_MAX, &huge), "Overflowing array allocated", NULL);
+  }
+
   GS_RET_OK;
 }
@@ -17,6 +17,16 @@
 
 #include "bytecode/image.h"
 
+// whether err failed with msg somewhere in its trace; errors are all
+// gs_current_err, which the next failure overwrites, so they are not freed
+static bool failed_with(Err *err, const char *msg) {
+  if (!err) return false;
+  for (u32 i = 0; i < err->len && i < GS_ERR_MAX_TRACE; ++i) {
+    if (gs_bytes_cmp(err->frames[i].msg, GS_UTF8_CSTR_DYN(msg)) == 0) return true;
+  }
+  return false;
+}
+
 Err *gs_main(void) {
   alignas(u32) u8 buf[] = {
     'g', 'l', 's', '\0', // magic header
@@ -50,9 +60,88 @@ Err *gs_main(void) {
     0x03, 0x00, 0x00, 0x00, //      , value
     0x04, 0x00, 0x00, 0x00, // start
     0x00, 0x00, 0x00, 0x00, //   code
+    0x05, 0x00, 0x00, 0x00, // symbols
+    0x01, 0x00, 0x00, 0x00, //  [length]
+    0x00, 0x00, 0x00, 0x00, //   [0]: symbol
+    0x50, 0x94, 0x01, 0x00, //      , hash
   };
   Image *img;
   GS_TRY(gs_index_image(sizeof(buf), buf, &img));
+  GS_FAIL_IF(img->symbols.len != 1, "symbols not indexed", NULL);
+  GS_FAIL_IF(GS_LAZY_VERIFY && img->verifiedc != 0, "verified eagerly", NULL);
+  GS_TRY(gs_verify_image(img));
+  GS_FAIL_IF(!gs_code_verified(img, 0), "code not marked verified", NULL);
+  GS_FAIL_IF(!img->symbols.verified, "symbols not marked verified", NULL);
+
+  // hashes are checked by verification, not when indexing
+  buf[sizeof(buf) - 4] ^= 1;
+  GS_TRY(gs_index_image(sizeof(buf), buf, &img));
+  GS_FAIL_IF(!failed_with(gs_verify_symbols(img), "Wrong symbol hash"), "wrong symbol hash passed verification", NULL);
+  GS_FAIL_IF(img->symbols.verified, "wrong symbol hash marked verified", NULL);
+  buf[sizeof(buf) - 4] ^= 1;
+
+  alignas(u32) u8 unsortedBuf[] = {
+    'g', 'l', 's', '\0', // magic header
+    0x01, 0x00, 0x00, 0x00, // version
+    0x01, 0x00, 0x00, 0x00, // constant section
+    0x01, 0x00, 0x00, 0x00, //  [length]
+    0x03, 0x00, 0x00, 0x00, //   [0]: symbol
+    0x03, 0x00, 0x00, 0x00, //    [length]
+    'h', 'o', 'w', 0,
+    0x05, 0x00, 0x00, 0x00, // symbols
+    0x02, 0x00, 0x00, 0x00, //  [length]
+    0x00, 0x00, 0x00, 0x00, //   [0]: symbol
+    0x02, 0x00, 0x00, 0x00, //      , hash
+    0x00, 0x00, 0x00, 0x00, //   [1]: symbol
+    0x01, 0x00, 0x00, 0x00, //      , hash
+  };
+  GS_FAIL_IF(
+    !failed_with(gs_index_image(sizeof(unsortedBuf), unsortedBuf, &img), "symbols not sorted by hash"),
+    "unsorted symbols were indexed",
+    NULL
+  );
+
+  alignas(u32) u8 stringBuf[] = {
+    'g', 'l', 's', '\0', // magic header
+    0x01, 0x00, 0x00, 0x00, // version
+    0x01, 0x00, 0x00, 0x00, // constant section
+    0x01, 0x00, 0x00, 0x00, //  [length]
+    0x04, 0x00, 0x00, 0x00, //   [0]: string
+    0x03, 0x00, 0x00, 0x00, //    [length]
+    'a', 0xC3, 0xA9, 0,
+  };
+  GS_TRY(gs_index_image(sizeof(stringBuf), stringBuf, &img));
+  GS_FAIL_IF(((u32 *) img->stringLengths->bytes)[0] != 2, "wrong string length", NULL);
+  stringBuf[sizeof(stringBuf) - 2] = 0xFF;
+  GS_FAIL_IF(
+    !failed_with(gs_index_image(sizeof(stringBuf), stringBuf, &img), "invalid UTF-8 in string constant"),
+    "invalid UTF-8 was indexed",
+    NULL
+  );
+
+  alignas(u32) u8 badBuf[] = {
+    'g', 'l', 's', '\0', // magic header
+    0x01, 0x00, 0x00, 0x00, // version
+    0x02, 0x00, 0x00, 0x00, // code section
+    0x01, 0x00, 0x00, 0x00, //  [length]
+    0x01, 0x00, 0x00, 0x00, //   [0]: len
+    0x00, 0x00, 0x00, 0x00, //      , locals
+    0x00, 0x00, 0x00, 0x00, //      , maxStack
+    0x00, 0x00, 0x00, 0x00, //      , stackMapLen
+    0xFF, 0x00, 0x00, 0x00, //      , code (invalid)
+  };
+  Image *badImg;
+  if (GS_LAZY_VERIFY) {
+    GS_TRY(gs_index_image(sizeof(badBuf), badBuf, &badImg));
+    GS_FAIL_IF(!failed_with(gs_verify_code_ref(badImg, 0), "Verification failed"), "invalid code passed verification", NULL);
+    GS_FAIL_IF(gs_code_verified(badImg, 0), "invalid code marked verified", NULL);
+  } else {
+    GS_FAIL_IF(
+      !failed_with(gs_index_image(sizeof(badBuf), badBuf, &badImg), "Verification failed"),
+      "invalid code passed verification",
+      NULL
+    );
+  }
 
   GS_RET_OK;
 }
@@ -17,6 +17,10 @@
 
 #include "rt.h"
 #include "bytecode/interp.h"
+#include "bytecode/hash_map.h"
+#include "bytecode/serialize.h"
+#include "bytecode/utf8.h"
+#include "util/sha256.h"
 
 Err *gs_main() {
   GS_TRY(gs_alloc_sym_table());
@@ -31,9 +35,88 @@ Err *gs_main() {
   GS_TRY(gs_intern(GS_UTF8_CSTR("concat"), &concat));
   GS_FAIL_IF(car == concat, "Equal symbols", NULL);
 
+  // a known hash is only checked when a symbol is created, which a
+  // wrong one would otherwise duplicate
+  u32 carHash = (u32) gs_hash_bytes(GS_UTF8_CSTR("car"));
+  Symbol *car2;
+  GS_TRY(gs_intern_hashed(GS_UTF8_CSTR("car"), carHash, &car2));
+  GS_FAIL_IF(car2 != car, "Unequal symbols", NULL);
+  GS_FAIL_IF(!gs_intern_hashed(GS_UTF8_CSTR("car"), carHash + 1, &car2), "Wrong hash accepted", NULL);
+  GS_FAIL_IF(!gs_intern_hashed(GS_UTF8_CSTR("cdr"), carHash, &car2), "Wrong hash accepted", NULL);
+
   Val c = CHAR2VAL(100);
   GS_FAIL_IF(!VAL_IS_CHAR(c), "Not a char", NULL);
   GS_FAIL_IF(VAL2CHAR(c) != 100, "Wrong char value", NULL);
 
+  u32 cpLen;
+  // long enough to take the vectorised path, with a code point crossing a block
+  const char *mixed = "0123456789abcdef0123456789abcde\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80 and the rest";
+  GS_FAIL_IF(!gs_utf8_validate(GS_UTF8_CSTR_DYN(mixed), &cpLen), "Valid UTF-8 rejected", NULL);
+  GS_FAIL_IF(cpLen != 31 + 3 + 13, "Wrong code point count", NULL);
+  const char *invalid[] = {
+    "0123456789abcdef0123456789abcde\xC3",
+    "\xC0\xAF", // overlong
+    "\xED\xA0\x80", // surrogate
+    "\xF4\x90\x80\x80", // past the last code point
+    "0123456789abcdef0123456789abcdef\x80",
+  };
+  for (u32 i = 0; i < sizeof(invalid) / sizeof(*invalid); ++i) {
+    GS_FAIL_IF(gs_utf8_validate(GS_UTF8_CSTR_DYN(invalid[i]), &cpLen), "Invalid UTF-8 accepted", NULL);
+  }
+  u8 enc[4];
+  u32 decoded;
+  GS_FAIL_IF(gs_utf8_encode(0x1F600, enc) != 4, "Wrong encoded length", NULL);
+  GS_FAIL_IF(gs_utf8_decode(enc, &decoded) != 4 || decoded != 0x1F600, "Wrong decoded char", NULL);
+  GS_FAIL_IF(gs_utf8_encode(0xD800, enc) != 0, "Encoded a surrogate", NULL);
+
+  // only symbols and immediates can be hash map keys
+  HashMap *map;
+  GS_TRY(gs_hash_map_assoc(NULL, PTR2VAL_GC(car), FIX2VAL(1), &map));
+  GS_TRY(gs_hash_map_assoc(map, c, FIX2VAL(2), &map));
+  GS_FAIL_IF(!gs_hash_map_assoc(map, PTR2VAL_GC(car->name), FIX2VAL(3), &map), "Heap key accepted", NULL);
+  GS_FAIL_IF(map->count != 2, "Wrong map count", NULL);
+
+  InlineBytes *ser;
+  Val deser;
+  GS_TRY(gs_serialize(PTR2VAL_GC(car), &ser));
+  GS_TRY(gs_deserialize(GS_DECAY_BYTES(ser), &deser));
+  GS_FAIL_IF(deser != PTR2VAL_GC(car), "Symbol not interned on deserialize", NULL);
+  // every prefix is truncated
+  for (u32 i = 0; i < ser->len; ++i) {
+    GS_FAIL_IF(!gs_deserialize((Bytes) { ser->bytes, i }, &deser), "Truncated data accepted", NULL);
+  }
+
+  // only the constants a program can see are read back
+  GS_TRY(gs_serialize(VAL_NIL, &ser));
+  GS_TRY(gs_deserialize(GS_DECAY_BYTES(ser), &deser));
+  GS_FAIL_IF(deser != VAL_NIL, "Constant not read back", NULL);
+  GS_FAIL_IF(ser->bytes[ser->len - 1] != VAL_NIL, "Constant not written as its word", NULL);
+  ser->bytes[ser->len - 1] = 0x12;
+  GS_FAIL_IF(!gs_deserialize(GS_DECAY_BYTES(ser), &deser), "Slot marker accepted", NULL);
+  ser->bytes[ser->len - 1] = 0x1A;
+  GS_FAIL_IF(!gs_deserialize(GS_DECAY_BYTES(ser), &deser), "Slot marker accepted", NULL);
+
+  // FIPS 180-2 test vectors, the second fed in pieces across its two blocks
+  const u8 abcDigest[GS_SHA256_LEN] = {
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+  };
+  const u8 longDigest[GS_SHA256_LEN] = {
+    0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+    0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1,
+  };
+  const char *longMsg = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  Sha256 sha;
+  u8 digest[GS_SHA256_LEN];
+  gs_sha256_init(&sha);
+  gs_sha256_update(&sha, (const u8 *) "abc", 3);
+  gs_sha256_final(&sha, digest);
+  GS_FAIL_IF(memcmp(digest, abcDigest, GS_SHA256_LEN) != 0, "Wrong SHA-256 digest", NULL);
+  gs_sha256_init(&sha);
+  gs_sha256_update(&sha, (const u8 *) longMsg, 5);
+  gs_sha256_update(&sha, (const u8 *) longMsg + 5, strlen(longMsg) - 5);
+  gs_sha256_final(&sha, digest);
+  GS_FAIL_IF(memcmp(digest, longDigest, GS_SHA256_LEN) != 0, "Wrong SHA-256 digest", NULL);
+
   GS_RET_OK;
 }
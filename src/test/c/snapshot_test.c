@@ -0,0 +1,101 @@
+/**
+ * Copyright (C) 2023 eutro
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rt.h"
+#include "bytecode/image.h"
+#include "bytecode/interp.h"
+#include "bytecode/primitives.h"
+#include "bytecode/snapshot.h"
+
+#include <string.h>
+
+Err *gs_main(void) {
+  alignas(u32) u8 buf[] = {
+    'g', 'l', 's', '\0', // magic header
+    0x01, 0x00, 0x00, 0x00, // version
+    0x01, 0x00, 0x00, 0x00, // constant section
+    0x01, 0x00, 0x00, 0x00, //  [length]
+    0x03, 0x00, 0x00, 0x00, //   [0]: symbol
+    0x03, 0x00, 0x00, 0x00, //    [length]
+    'h', 'o', 'w', 0,
+    0x02, 0x00, 0x00, 0x00, // code section
+    0x01, 0x00, 0x00, 0x00, //  [length]
+    0x05, 0x00, 0x00, 0x00, //   [0]: len
+    0x00, 0x00, 0x00, 0x00, //      , locals
+    0x01, 0x00, 0x00, 0x00, //      , maxStack
+    0x00, 0x00, 0x00, 0x00, //      , stackMapLen
+    0x02, 0x00, 0x00, 0x00, //      , code (RET 0)
+    0x00, 0x00, 0x00, 0x00, //
+  };
+
+  GS_TRY(gs_alloc_sym_table());
+  GS_TRY(gs_add_primitives());
+
+  Image *img;
+  GS_TRY(gs_index_image(sizeof(buf), buf, &img));
+  InterpClosure *cls;
+  GS_TRY(gs_interp_closure(img, 0, NULL, 0, &cls));
+  Symbol *fn;
+  GS_TRY(gs_intern(GS_UTF8_CSTR("fn"), &fn));
+  GS_TRY(gs_set_symbol_value(fn, PTR2VAL_GC(cls)));
+
+  Val elts[] = { FIX2VAL(1), CHAR2VAL('x'), PTR2VAL_GC(fn) };
+  Val list;
+  GS_TRY(gs_alloc_list(elts, 3, &list));
+  Symbol *ls;
+  GS_TRY(gs_intern(GS_UTF8_CSTR("ls"), &ls));
+  GS_TRY(gs_set_symbol_value(ls, list));
+
+  AllocMeta meta;
+  u8 *snapshot;
+  GS_TRY(gs_snapshot_save(42, &meta, &snapshot));
+
+  SymTable *oldSyms = gs_global_syms;
+  bool loaded;
+  GS_TRY(gs_snapshot_load(43, meta.count, snapshot, &loaded));
+  GS_FAIL_IF(loaded || gs_global_syms != oldSyms, "loaded snapshot of another image", NULL);
+  GS_TRY(gs_snapshot_load(42, meta.count, snapshot, &loaded));
+  gs_free(snapshot, meta);
+  GS_FAIL_IF(!loaded || gs_global_syms == oldSyms, "snapshot not loaded", NULL);
+
+  Symbol *newLs, *newFn;
+  GS_TRY(gs_intern(GS_UTF8_CSTR("ls"), &newLs));
+  GS_TRY(gs_intern(GS_UTF8_CSTR("fn"), &newFn));
+  GS_FAIL_IF(newLs == ls || newFn == fn, "symbols not relocated", NULL);
+
+  Val *pair = VAL2PTR(Val, newLs->value);
+  GS_FAIL_IF(pair[0] != FIX2VAL(1), "wrong first element", NULL);
+  pair = VAL2PTR(Val, pair[1]);
+  GS_FAIL_IF(pair[0] != CHAR2VAL('x'), "wrong second element", NULL);
+  pair = VAL2PTR(Val, pair[1]);
+  GS_FAIL_IF(pair[0] != PTR2VAL_GC(newFn), "symbol identity not preserved", NULL);
+  GS_FAIL_IF(pair[1] != VAL_NIL, "wrong list end", NULL);
+
+  InterpClosure *newCls = VAL2PTR(InterpClosure, newFn->value);
+  GS_FAIL_IF(newCls->parent.call != cls->parent.call, "closure function not relocated", NULL);
+  GS_FAIL_IF(newCls->assignedTo != newFn, "closure name not relocated", NULL);
+  Image *newImg = newCls->img;
+  GS_FAIL_IF(newImg == img, "image not relocated", NULL);
+  GS_FAIL_IF(
+    (u8 *) newImg->codes->values[0] != newImg->buf->bytes + ((u8 *) img->codes->values[0] - img->buf->bytes),
+    "code pointer not relocated",
+    NULL
+  );
+  GS_TRY(gs_call(&newCls->parent, 0, NULL, 0, NULL));
+
+  GS_RET_OK;
+}
@@ -79,8 +79,230 @@
    (let ((bs (bytevector->bytestring bvec)))
      (assert-eq? 1 (bytestring-ref bs 0))
      (assert-eq? 3 (bytestring-ref bs 2))
-     (assert-eq? 5 (bytestring-ref bs 4)))))
+     (assert-eq? 5 (bytestring-ref bs 4))
+     (assert-eq? 5 (bytestring-length bs))
+     (assert-eq? 0 (bytevector-length bvec))))
+
+ (let ((bvec (new-bytevector 2)))
+   (bytevector-push-u16le! bvec 258)
+   (bytevector-push-u32le! bvec -2)
+   (bytevector-push-u64le! bvec 1)
+   (assert-eq? 14 (bytevector-length bvec))
+   (bytevector-set-u32le-at! bvec 2 67305985)
+   (bytevector-append! bvec "ab")
+   (bytevector-set-len! bvec 20)
+   (let ((bs (bytevector->bytestring bvec)))
+     (assert-eq? 20 (bytestring-length bs))
+     (assert-eq? 2 (bytestring-ref bs 0))
+     (assert-eq? 1 (bytestring-ref bs 1))
+     (assert-eq? 1 (bytestring-ref bs 2))
+     (assert-eq? 4 (bytestring-ref bs 5))
+     (assert-eq? 1 (bytestring-ref bs 6))
+     (assert-eq? 0 (bytestring-ref bs 13))
+     (assert-eq? 97 (bytestring-ref bs 14))
+     (assert-eq? 0 (bytestring-ref bs 19))))
+
+ (let ((bvec (new-bytevector 0)))
+   ((lambda recur (n)
+      (when (< 0 n)
+        (bytevector-push-u32le! bvec -1)
+        (recur (dec n))))
+    1000)
+   (assert-eq? 4000 (bytevector-length bvec))
+   (assert-eq? 255 (bytestring-ref (bytevector->bytestring bvec) 3999))))
+
+(test
+ vector-tests
+
+ (let ((vec (vector 1 'two "three")))
+   (assert-eq? true (vector? vec))
+   (assert-eq? false (vector? '(1 2)))
+   (assert-eq? 3 (vector-length vec))
+   (assert-eq? 'two (vector-ref vec 1))
+   (assert-eq? 'four (vector-set! vec 1 'four))
+   (assert-fn equal? '(1 four "three") (vector->list vec))
+   (assert-eq? 3 (vector-swap! vec 0 + 2)))
+
+ (let ((vec (make-vector 5))
+       (src (list->vector '(a b c d))))
+   (assert-eq? nil (vector-ref vec 4))
+   (assert-eq? 0 (vector-ref (make-vector 2 0) 1))
+   (vector-copy! vec 1 src 1 3)
+   (assert-fn equal? '(() b c () ()) (vector->list vec))
+   (vector-copy! src 1 src 0 3)
+   (assert-fn equal? '(a a b c) (vector->list src))
+   (assert-eq? 0 (vector-length (list->vector nil)))))
+
+;; defined at the top level, so they are in the snapshot too
+(define-record-type point (make-point x y) point?
+  (x point-x)
+  (y point-y set-point-y!)
+  (label point-label set-point-label!))
+(define origin (make-point 0 0))
+
+(test
+ record-tests
+
+ (let ((p (make-point 1 (list 2))))
+   (assert-eq? true (point? p))
+   (assert-eq? false (point? (vector point 1 2 nil)))
+   (assert-eq? 1 (point-x p))
+   (assert-fn equal? '(2) (point-y p))
+   (assert-eq? nil (point-label p))
+   (set-point-label! p "p")
+   (assert-fn equal? "p" (point-label p)))
+
+ (assert-eq? true (point? origin))
+ (assert-eq? 0 (point-y origin)))
+
+;; assigned twice, so neither assignment can become an image binding
+(define redefined (identity 1))
+(define redefined 5)
+
+(test
+ redefinition-tests
+
+ (assert-eq? 5 redefined))
+
+;; a slice of a string that is otherwise unreachable
+(define greeting (substring (list->string (string->list "hello, world")) 7))
+
+(test
+ slice-tests
+
+ (let ((str "hello, world"))
+   (assert-fn equal? "world" (substring str 7))
+   (assert-fn equal? "lo" (substring str 3 5))
+   (assert-fn equal? "o" (substring (substring str 3 5) 1))
+   (assert-fn string=? "hello" (string-compact (substring str 0 5)))
+   (assert-eq? str (string-compact str)))
+
+ (let ((bs (string->bytestring "abcdef"))
+       (sl (bytestring-slice bs 1 4))
+       (sl2 (bytestring-slice sl 2 2)))
+   (assert-eq? 4 (bytestring-length sl))
+   (assert-eq? 98 (bytestring-ref sl 0))
+   (assert-eq? 100 (bytestring-ref sl2 0))
+   ;; slices share their owner's bytes until they are compacted
+   (let ((copy (bytestring-compact sl2)))
+     (bytestring-set! sl2 0 120)
+     (assert-eq? 120 (bytestring-ref bs 3))
+     (assert-eq? 100 (bytestring-ref copy 0)))
+   (bytestring-copy! bs 0 sl 0 3)
+   (assert-fn equal? (string->bytestring "bcxxef") bs))
+
+ (assert-fn equal? "world" (call-in-new-scope (lambda () (substring (list->string (string->list "hello, world")) 7))))
+ (assert-fn equal? "world" greeting))
+
+(test
+ string-builder-tests
+
+ (let ((sb (make-string-builder)))
+   (assert-eq? true (string-builder? sb))
+   (sb-push-char! sb #\a)
+   (sb-append! sb (substring "xbcx" 1 3))
+   (sb-print! sb '(1 "two" #\3))
+   (assert-fn string=? "abc(1 \"two\" #\\3)" (sb->string sb))
+   (assert-fn string=? "" (sb->string sb)))
+
+ (let ((sb (make-string-builder 1)))
+   ((lambda recur (n)
+      (when (< 0 n)
+        (sb-append! sb "abcd")
+        (recur (dec n))))
+    1000)
+   (assert-eq? 4000 (string-length (sb->string sb)))))
+
+;; a long string that is not ASCII, which builds an index when it is indexed
+(define accents
+  (let ((sb (make-string-builder)))
+    ((lambda recur (n)
+       (when (< 0 n)
+         (sb-append! sb "aé€")
+         (recur (dec n))))
+     40)
+    (sb->string sb)))
+
+(test
+ utf8-tests
+
+ (let ((str "héllo, wörld"))
+   (assert-eq? 12 (string-length str))
+   (assert-eq? #\é (string-ref str 1))
+   (assert-eq? #\d (string-ref str 11))
+   (assert-fn string=? "wörld" (substring str 7))
+   (assert-fn string=? "ör" (substring (substring str 7) 1 3))
+   (assert-eq? 2 (string-length (substring (substring str 7) 1 3)))
+   (assert-fn equal? '(#\w #\ö #\r #\l #\d) (string->list (substring str 7)))
+   (assert-fn string=? str (list->string (string->list str)))
+   (assert-eq? 14 (bytestring-length (string->bytestring str))))
+
+ (assert-eq? 120 (string-length accents))
+ (assert-eq? #\€ (string-ref accents 119))
+ (assert-eq? #\é (string-ref accents 64))
+ (assert-eq? #\a (string-ref accents 33))
+ (assert-fn string=? "aé€a" (substring accents 60 64))
+ (assert-eq? #\é (string-ref (substring accents 50) 2))
+
+ ;; a length that is a multiple of the index stride has no index entry
+ ;; for its end
+ (let ((lambdas (let ((sb (make-string-builder)))
+                  ((lambda recur (n)
+                     (when (< 0 n)
+                       (sb-push-char! sb #\λ)
+                       (recur (dec n))))
+                   64)
+                  (sb->string sb))))
+   (assert-eq? 64 (string-length lambdas))
+   (assert-eq? 63 (string-length (substring lambdas 1)))
+   (assert-fn string=? (substring lambdas 0 63) (substring lambdas 1))
+   (assert-eq? 64 (bytestring-length (string->bytestring (substring lambdas 32 64)))))
+
+ (let ((sb (make-string-builder)))
+   (sb-push-char! sb #\€)
+   (sb-print! sb #\é)
+   (let ((str (sb->string sb)))
+     (assert-eq? 4 (string-length str))
+     (assert-fn string=? "€#\\é" str))))
+
+(test
+ list-tests
+
+ (assert-fn equal? '(3 2 1) (reverse '(1 2 3)))
+ (assert-eq? nil (reverse nil))
+ (assert-fn equal? '(1 2 3 4) (concat '(1) nil '(2 3) '(4)))
+ (let ((tl (list 3 4)))
+   (assert-eq? tl (cddr (concat '(1 2) tl nil))))
+ (assert-eq? nil (concat))
+ (assert-fn equal? '(1 2 3 4) (list* 1 2 '(3 4)))
+ (assert-eq? 5 (list* 5))
+ (assert-eq? nil (list*))
+ (assert-fn equal? '((0 a) (1 b)) (enumerate '(a b)))
+ (assert-fn equal? '(2 3 4) (map inc '(1 2 3)))
+ (assert-fn equal? '(5 7) (map + '(1 2 3) '(4 5)))
+ (assert-fn equal? '(3 2 1) (foldl rcons nil '(1 2 3)))
+ (assert-fn equal? '(1 2 3) (foldr cons nil '(1 2 3)))
+ (assert-eq? 4 (some (lambda (x) (and (> x 3) x)) '(1 4 5)))
+ (assert-eq? false (some nil? '(1 2)))
+ (assert-eq? true (all number? '(1 2)))
+ (assert-eq? false (all number? '(1 a)))
+
+ ;; long enough that recursing per element would overflow
+ (let ((long (vector->list (make-vector 20000 1))))
+   (assert-eq? 20000 (count long))
+   (assert-eq? 20000 (foldr + 0 long))
+   (assert-eq? 40000 (foldl + 0 (map + long long)))
+   (assert-eq? 40001 (count (concat long long '(1)))))
+ ;;
+ )
 
 (define (main)
   (simple-tests)
-  (bytevector-tests))
+  (bytevector-tests)
+  (vector-tests)
+  (record-tests)
+  (redefinition-tests)
+  (slice-tests)
+  (string-builder-tests)
+  (utf8-tests)
+  (list-tests))
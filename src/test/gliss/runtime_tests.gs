@@ -20,8 +20,378 @@
 
   (assert-eq? (read (box '(#\a #\b #\c)))
               'abc)
+
+  ;; the native reader agrees with the char list one
+  (let ((src "(foo 'bar `(x ~y ~@z) \"a\\\"b\" #\\a #\\space #\\newline)
+              -12 +3 1_000 true #false nil ; a comment
+              a\\ b last")
+        (expected (read-all (open-string src))))
+    (assert-eq? 9 (count expected))
+    (assert-fn datum=? expected (read-all (open-bytes src)))
+    (assert-fn datum=? expected (read-all (open-bytes (string->bytestring src)))))
+
+  (assert-eq? eof (read (open-bytes "  ; only a comment")))
+  (let ((s (open-bytes "a b")))
+    (assert-eq? 'a (read s))
+    (assert-eq? 'b (read s))
+    (assert-eq? eof (read s)))
   ;;
   )
 
+(define (datum=? l r)
+  (cond
+    ((and l r (list? l) (list? r))
+     (and (datum=? (car l) (car r))
+          (datum=? (cdr l) (cdr r))))
+    ((and (string? l) (string? r)) (string=? l r))
+    (else (eq? l r))))
+
+(define (repeat n x)
+  (if (= n 0)
+      nil
+      (cons x (repeat (- n 1) x))))
+
+;; write an image whose start function returns the value of expr,
+;; returns the start code index and the image bytes
+(define (write-image iw expr)
+  (let ((start (bytecomp! iw (compile (empty-env) expr nil)))
+        (bv (new-bytevector 0)))
+    (image-writer-set-start! iw start)
+    (image-writer->bytes iw bv)
+    (list start (bytevector->bytestring bv))))
+
+;; write and run an image, returns the value of expr, the image size
+;; and the time taken by the first call, which bakes the image, in
+;; nanoseconds
+(define (write-and-run-image iw expr)
+  (let ((written (write-image iw expr))
+        (bs (cadr written))
+        (start-fn (new-image-closure (index-image bs) (car written)))
+        (before (monotonic-nanos))
+        (value (start-fn))
+        (after (monotonic-nanos)))
+    (list value (bytestring-length bs) (- after before))))
+
+(test
+ constant-dedupe-tests
+
+ (let ((expr `(list ~@(repeat 60 ''repeated-symbol)
+                    ~@(repeat 60 "repeated string")
+                    ~@(repeat 60 1234)))
+       (deduped (write-and-run-image (new-image-writer) expr))
+       (undeduped (write-and-run-image (new-image-writer* false) expr)))
+   (assert-eq? 180 (count (car deduped)))
+   (assert-eq? 'repeated-symbol (car (car deduped)))
+   (assert-eq? 1234 (car (reverse (car deduped))))
+   (assert-eq? true (some (lambda (x) (and (string? x) (string=? x "repeated string")))
+                          (car deduped)))
+   (assert-fn < (cadr deduped) (cadr undeduped))
+   (dbg (list 'image-bytes (cadr deduped) (cadr undeduped)
+              'bake-nanos (caddr deduped) (caddr undeduped))))
+ ;;
+ )
+
+;; a loop that branches back to a label placed before the branch,
+;; and out of it to a label reached by two branches
+(define loop-insns
+  '((const true)
+    (set! (var 0))
+    (label top)
+    (load (var 0))
+    (br-if-not done)
+    (load (var 0))
+    (br-if-not done)
+    (const false)
+    (set! (var 0))
+    (br top 0)
+    (label done)
+    (const loop-done)))
+
+(test
+ assembler-tests
+
+ ;; the native assembler writes the same code as code-body-writer-emit!
+ (let ((native-iw (new-live-image-writer))
+       (start (bytecomp! native-iw loop-insns))
+       (native (car (codes-writer-codes (image-writer-codes native-iw))))
+       (iw (new-live-image-writer))
+       (cw (new-code-body-writer))
+       (_ (run! (lambda (insn) (code-body-writer-emit! cw iw insn)) loop-insns))
+       (_ (code-body-writer-flush! cw iw))
+       (written (code-body-writer->code cw)))
+   (assert-eq? 0 (bytestring-compare native written))
+   (assert-eq? 'loop-done
+               ((new-image-closure (image-writer->live-image native-iw) start))))
+ ;;
+ )
+
+(test
+ file-bytes-tests
+
+ (let ((written (write-image (new-image-writer) '(list 'from "a file")))
+       (start (car written))
+       (bs (cadr written))
+       (path "gliss_runtime_tests_file.gi")
+       (_ (write-file path bs))
+       (in (read-file-bytes path))
+       (mapped (map-file-bytes path)))
+   (assert-eq? true (bytestring? mapped))
+   (assert-eq? (bytestring-length bs) (bytestring-length in))
+   (assert-eq? (bytestring-length bs) (bytestring-length mapped))
+   (assert-eq? (string-hash bs) (string-hash in))
+   (assert-eq? (string-hash bs) (string-hash mapped))
+   (assert-fn datum=? '(from "a file") ((new-image-closure (index-image in) start)))
+   (assert-fn datum=? '(from "a file") ((new-image-closure (index-image mapped) start))))
+ ;;
+ )
+
+(test
+ port-tests
+
+ (let ((path "gliss_runtime_tests_port.txt")
+       (out (open-output-port path))
+       (_ (write-bytes out "first line
+second"))
+       (_ (write-bytes out (list->bytestring (list 120 10 10 97 98 99)) 1 6))
+       (_ (close-port out))
+       (in (open-input-port path)))
+   (assert-eq? true (port? in))
+   (assert-eq? 102 (peek-byte in))
+   (assert-fn string=? "first line" (read-line in))
+   (assert-fn string=? "second" (read-line in))
+   (assert-fn string=? "" (read-line in))
+   (assert-eq? 97 (read-byte in))
+   (assert-fn string=? "bc" (read-line in))
+   (assert-eq? eof (read-line in))
+   (assert-eq? eof (read-byte in))
+   (close-port in))
+
+ (let ((written (write-image (new-image-writer) '(list 'from "a port")))
+       (path "gliss_runtime_tests_port.gi")
+       (iw (new-image-writer))
+       (start (bytecomp! iw (compile (empty-env) '(list 'from "a port") nil)))
+       (_ (image-writer-set-start! iw start))
+       (out (open-output-port path))
+       (_ (image-writer->port iw out))
+       (_ (close-port out))
+       (streamed (read-file-bytes path)))
+   (assert-eq? (bytestring-length (cadr written)) (bytestring-length streamed))
+   (assert-eq? (string-hash (cadr written)) (string-hash streamed))
+   (assert-fn datum=? '(from "a port") ((new-image-closure (index-image streamed) start))))
+ ;;
+ )
+
+(define (range-to n)
+  ((lambda recur (i acc)
+     (if (< i 0)
+         acc
+         (recur (dec i) (cons i acc))))
+   (dec n) nil))
+
+(test
+ hash-map-tests
+
+ (let ((ns (range-to 2000))
+       ;; these share a name, but not a hash
+       (gensyms (map (lambda (n) (list (gensym "key") n)) (range-to 40)))
+       (m (foldl (lambda (m n) (assoc m n (* n 2))) empty-map ns))
+       (m (foldl (lambda (m g) (assoc m (car g) (cadr g))) m gensyms))
+       (m (assoc m 'sym 'val)))
+   (assert-eq? 2041 (map-count m))
+   (assert-eq? 2041 (count (map->list m)))
+   (assert-eq? true (all (lambda (n) (eq? (* n 2) (get m n))) ns))
+   (assert-eq? true (all (lambda (g) (eq? (cadr g) (get m (car g)))) gensyms))
+   (assert-eq? 'val (get m 'sym))
+   (assert-eq? nil (get m 'missing))
+   (assert-eq? 'default (hash-map-get m 'missing 'default))
+   (assert-eq? nil (find m 'missing))
+   (assert-fn datum=? '(sym val) (find m 'sym))
+   (assert-eq? m (assoc m 'sym 'val))
+   ;; other objects can't be keys, so are never in a map
+   (assert-eq? nil (get m (list 1)))
+   (assert-eq? m (dissoc m (list 1)))
+
+   (let ((m2 (foldl (lambda (m n) (if (eq? 0 (modulo n 3)) (dissoc m n) m)) m ns))
+         (m2 (foldl (lambda (m g) (dissoc m (car g))) m2 (cdr gensyms))))
+     (assert-eq? 1335 (map-count m2))
+     (assert-eq? true (all (lambda (n)
+                             (if (eq? 0 (modulo n 3))
+                                 (nil? (find m2 n))
+                                 (eq? (* n 2) (get m2 n))))
+                           ns))
+     (assert-eq? 0 (get m2 (caar gensyms)))
+     ;; the original is untouched
+     (assert-eq? 0 (get m 0))
+     (assert-eq? 2041 (map-count m))
+     (assert-eq? nil (foldl dissoc m2 (map car (map->list m2))))))
+ ;;
+ )
+
+(test
+ hash-table-tests
+
+ (assert-eq? true (equal? '(1 "two" (#\3)) (list 1 "two" (list #\3))))
+ (assert-eq? false (equal? '(1 2) '(1 2 3)))
+ (assert-eq? false (equal? "ab" (string->bytestring "ab")))
+ (assert-eq? (equal-hash (list "x" 'y 3)) (equal-hash (list "x" 'y 3)))
+
+ ;; keys are hashed by address, and move when the scope is popped
+ (let ((built (call-in-new-scope
+               (lambda ()
+                 (let ((t (new-hash-table))
+                       (cells (map list (range-to 100))))
+                   (foldl (lambda (_ c) (hash-table-set! t c (car c))) nil cells)
+                   (hash-table-set! t 'sym 'val)
+                   (list t cells)))))
+       (t (car built))
+       (cells (cadr built)))
+   (assert-eq? 101 (hash-table-count t))
+   (assert-eq? true (all (lambda (c) (eq? (car c) (hash-table-ref t c))) cells))
+   (assert-eq? 'val (hash-table-ref t 'sym))
+   (assert-eq? nil (hash-table-ref t (list 0)))
+   (assert-eq? 'default (hash-table-ref t 'missing 'default))
+   (assert-eq? true (hash-table-remove! t (car cells)))
+   (assert-eq? false (hash-table-remove! t (car cells)))
+   (assert-eq? 100 (count (hash-table->list t))))
+
+ (let ((t (new-equal-hash-table))
+       (key (lambda (n) (list n (list->string (list #\k))))))
+   (foldl (lambda (_ n) (hash-table-set! t (key n) n)) nil (range-to 1000))
+   (foldl (lambda (_ n) (if (eq? 0 (modulo n 2)) (hash-table-remove! t (key n)) nil))
+          nil (range-to 1000))
+   (hash-table-set! t "key" 'string)
+   (hash-table-set! t (string->bytestring "key") 'bytes)
+   (assert-eq? 502 (hash-table-count t))
+   (assert-eq? 7 (hash-table-ref t (list 7 "k")))
+   (assert-eq? nil (hash-table-ref t (list 8 "k")))
+   (assert-eq? 'string (hash-table-ref t "key"))
+   (assert-eq? 'bytes (hash-table-ref t (string->bytestring "key"))))
+ ;;
+ )
+
+;; the interpreted equivalent of bytestring-count, split in halves to
+;; keep the recursion shallow
+(define (count-byte-loop bs byte start end)
+  (if (< (- end start) 64)
+      ((lambda recur (i acc)
+         (if (= i end)
+             acc
+             (recur (inc i) (if (= byte (bytestring-ref bs i)) (inc acc) acc))))
+       start 0)
+      (let ((mid (+ start (arithmetic-shift (- end start) -1))))
+        (+ (count-byte-loop bs byte start mid)
+           (count-byte-loop bs byte mid end)))))
+
+;; the nanoseconds it takes to call f
+(define (time-nanos f)
+  (let ((before (monotonic-nanos))
+        (_ (f))
+        (after (monotonic-nanos)))
+    (- after before)))
+
+(test
+ bytestring-ops-tests
+
+ (let ((bs (string->bytestring "the quick brown fox jumps over the lazy dog, the end")))
+   (assert-eq? 3 (bytestring-index bs 32))
+   (assert-eq? 9 (bytestring-index bs 32 4 20))
+   (assert-eq? false (bytestring-index bs 120 0 10))
+   (assert-eq? 10 (bytestring-count bs 32))
+   (assert-eq? 1 (bytestring-count bs 32 0 5))
+   (assert-eq? 4 (bytestring-search bs (string->bytestring "quick")))
+   (assert-eq? 31 (bytestring-search bs (string->bytestring "the") 1))
+   (assert-eq? 45 (bytestring-search bs (string->bytestring "the") 32))
+   (assert-eq? false (bytestring-search bs (string->bytestring "cat")))
+   (assert-eq? 0 (bytestring-search bs (new-bytestring 0)))
+   (bytestring-fill! bs 42 0 3)
+   (assert-eq? 42 (bytestring-ref bs 2))
+   (assert-eq? 32 (bytestring-ref bs 3))
+   (assert-eq? -1 (bytestring-compare (string->bytestring "abc") (string->bytestring "abd")))
+   (assert-eq? 1 (bytestring-compare (string->bytestring "abc") (string->bytestring "ab")))
+   (assert-eq? 0 (bytestring-compare (string->bytestring "end") (bytestring-slice bs 49 3)))
+   (assert-eq? 0 (bytestring-compare (new-bytestring 0) (bytestring-slice bs 50 0))))
+
+ ;; long enough for the vectorised paths, with matches straddling blocks
+ (let ((bs (new-bytestring 100000)))
+   (bytestring-fill! bs 97)
+   (bytestring-fill! bs 98 99990 99997)
+   (bytestring-set! bs 31 98)
+   (bytestring-set! bs 32 98)
+   (assert-eq? 9 (bytestring-count bs 98))
+   (assert-eq? 31 (bytestring-index bs 98))
+   (assert-eq? 99989 (bytestring-search bs (string->bytestring "abbbbbbba")))
+   (assert-eq? 30 (bytestring-search bs (string->bytestring "abba")))
+   (assert-eq? (count-byte-loop bs 98 0 100000) (bytestring-count bs 98))
+   (dbg (list 'count-nanos
+              'native (time-nanos (lambda () (bytestring-count bs 98)))
+              'interpreted (time-nanos (lambda () (count-byte-loop bs 98 0 100000))))))
+ ;;
+ )
+
+(test
+ bytestring-le-tests
+
+ (let ((bs (new-bytestring 11)))
+   (bytestring-fill! bs 0)
+   ;; unaligned on purpose
+   (bytestring-u32le-set! bs 1 305419896)
+   (assert-eq? 120 (bytestring-ref bs 1))
+   (assert-eq? 18 (bytestring-ref bs 4))
+   (assert-eq? 305419896 (bytestring-u32le-ref bs 1))
+   (assert-eq? 22136 (bytestring-u16le-ref bs 1))
+   (bytestring-s16le-set! bs 5 -2)
+   (assert-eq? 65534 (bytestring-u16le-ref bs 5))
+   (assert-eq? -2 (bytestring-s16le-ref bs 5))
+   (bytestring-u16le-set! bs 5 65536)
+   (assert-eq? 0 (bytestring-u16le-ref bs 5))
+   (bytestring-s32le-set! bs 7 -1)
+   (assert-eq? -1 (bytestring-s32le-ref bs 7))
+   (assert-eq? 4294967295 (bytestring-u32le-ref bs 7))
+   (bytestring-u64le-set! bs 3 1234567890123)
+   (assert-eq? 1234567890123 (bytestring-u64le-ref bs 3))
+   (bytestring-s64le-set! bs 3 -1234567890123)
+   (assert-eq? -1234567890123 (bytestring-s64le-ref bs 3))
+   (assert-eq? -1234567890123 (bytestring-s64le-ref (bytestring-slice bs 3 8) 0)))
+ ;;
+ )
+
+(test
+ serialize-tests
+
+ (let ((datum '(1 -2 4611686018427387903 #\a #\é "str" sym nil true (nested (list)) eof)))
+   (assert-fn datum=? datum (deserialize (serialize datum))))
+
+ (let ((bs (bytestring-slice (string->bytestring "xbytesx") 1 5))
+       (back (deserialize (serialize (vector bs 'sym "ünïcode")))))
+   (assert-eq? 0 (bytestring-compare bs (vector-ref back 0)))
+   (assert-eq? 'sym (vector-ref back 1))
+   (assert-fn string=? "ünïcode" (vector-ref back 2)))
+
+ ;; shared structure stays shared, and cycles survive
+ (let ((shared (list "shared" 1 2))
+       (vec (make-vector 3))
+       (_ (vector-set! vec 0 shared))
+       (_ (vector-set! vec 1 shared))
+       (_ (vector-set! vec 2 vec))
+       (back (deserialize (serialize vec))))
+   (assert-fn datum=? shared (vector-ref back 0))
+   (assert-eq? (vector-ref back 0) (vector-ref back 1))
+   (assert-eq? back (vector-ref back 2)))
+
+ ;; long lists don't recurse
+ (let ((long (vector->list (make-vector 100000 'x))))
+   (assert-eq? 100000 (vector-length (list->vector (deserialize (serialize long))))))
+ ;;
+ )
+
 (define (main)
-  (reader-tests))
+  (reader-tests)
+  (hash-map-tests)
+  (hash-table-tests)
+  (constant-dedupe-tests)
+  (assembler-tests)
+  (call-in-new-scope file-bytes-tests)
+  (call-in-new-scope port-tests)
+  (bytestring-ops-tests)
+  (bytestring-le-tests)
+  (serialize-tests))